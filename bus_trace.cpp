@@ -0,0 +1,142 @@
+#include "bus_trace.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    constexpr char MAGIC[] = "GBTRACE";
+    constexpr uint8_t VERSION = 1;
+
+    constexpr uint8_t TAG_GAP = 3;
+    constexpr uint8_t TAG_PC_CHANGED = 0x04;
+    constexpr uint8_t TAG_BANK_CHANGED = 0x08;
+
+    void put_varint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    void put_zigzag(std::vector<uint8_t>& out, int32_t value)
+    {
+        put_varint(out, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+    }
+
+    /// @brief Delta encoder state, the previous access record.
+    struct Encoder
+    {
+        BusEvent last{};
+
+        void encode(std::vector<uint8_t>& out, const BusEvent& event)
+        {
+            uint8_t tag = static_cast<uint8_t>(event.access);
+            if (event.pc != last.pc) tag |= TAG_PC_CHANGED;
+            if (event.bank != last.bank) tag |= TAG_BANK_CHANGED;
+
+            out.push_back(tag);
+            put_varint(out, event.cycle - last.cycle);
+            put_zigzag(out, static_cast<int32_t>(event.address) - last.address);
+            out.push_back(event.value);
+
+            if (tag & TAG_PC_CHANGED) put_zigzag(out, static_cast<int32_t>(event.pc) - last.pc);
+            if (tag & TAG_BANK_CHANGED) put_varint(out, event.bank);
+
+            last = event;
+        }
+    };
+}
+
+BusTrace::BusTrace() :
+    ring(std::make_unique<BusEvent[]>(CAPACITY))
+{}
+
+BusTrace::~BusTrace()
+{
+    stop();
+}
+
+bool BusTrace::start(const std::string& path)
+{
+    stop();
+
+    // Fail here rather than on the drain thread, where nobody could tell
+    if (!std::ofstream(path, std::ios::binary))
+    {
+        std::cerr << "Could not open " << path << " for writing\n";
+        return false;
+    }
+
+    write_index.store(0, std::memory_order_relaxed);
+    read_index.store(0, std::memory_order_relaxed);
+    cached_read_index = 0;
+    dropped.store(0, std::memory_order_relaxed);
+
+    running.store(true, std::memory_order_release);
+    drain_thread = std::thread(&BusTrace::drain_loop, this, path);
+
+    return true;
+}
+
+void BusTrace::stop()
+{
+    if (!drain_thread.joinable()) return;
+
+    running.store(false, std::memory_order_release);
+    drain_thread.join();
+}
+
+void BusTrace::drain_loop(std::string path)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return;
+
+    std::vector<uint8_t> out(MAGIC, MAGIC + sizeof(MAGIC) - 1);
+    out.push_back(VERSION);
+
+    Encoder encoder;
+    uint64_t reported_dropped = 0;
+    uint64_t events = 0;
+
+    while (true)
+    {
+        // Checked before draining, so the last events recorded before stop() are not left behind
+        bool stopping = !running.load(std::memory_order_acquire);
+
+        size_t tail = read_index.load(std::memory_order_relaxed);
+        size_t head = write_index.load(std::memory_order_acquire);
+
+        for (size_t i = tail; i != head; ++i)
+            encoder.encode(out, ring[i & (CAPACITY - 1)]);
+
+        read_index.store(head, std::memory_order_release);
+        events += head - tail;
+
+        // Drops happened while the ring was full, i.e. right after what was just drained
+        uint64_t total_dropped = dropped.load(std::memory_order_relaxed);
+        if (total_dropped != reported_dropped)
+        {
+            out.push_back(TAG_GAP);
+            put_varint(out, total_dropped - reported_dropped);
+            reported_dropped = total_dropped;
+        }
+
+        file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+        out.clear();
+
+        if (stopping) break;
+
+        if (head == tail)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    file.close();
+
+    std::cout << "Bus trace written to " << path << " (" << events << " accesses, " << reported_dropped << " dropped)\n";
+}
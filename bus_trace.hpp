@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Build with -DGB_TRACE_BUS=1 to be able to record every CPU bus access to a file.
+// Disabled builds contain none of it.
+#ifndef GB_TRACE_BUS
+#define GB_TRACE_BUS 0
+#endif
+
+enum class BusAccess : uint8_t { Read, Write, Fetch };
+
+/// @brief One CPU bus access.
+struct BusEvent
+{
+    uint64_t cycle = 0; // T-cycle the access happened on
+    uint16_t address = 0;
+    uint16_t pc = 0; // Start of the instruction making the access
+    uint16_t bank = 0; // ROM bank for ROM addresses, external RAM bank for 0xA000-0xBFFF, 0 otherwise
+    uint8_t value = 0; // Byte read or written
+    BusAccess access = BusAccess::Read;
+};
+
+/// @brief Records bus accesses into a lock-free single producer/single consumer ring,
+/// which a background thread drains to a file.
+///
+/// The emulation thread never waits: if the ring is full, events are dropped and the
+/// file gets a gap record with how many were. The file starts with "GBTRACE" and a
+/// version byte (1), followed by records starting with a tag byte:
+///   bits 0-1: 0 read, 1 write, 2 fetch, 3 gap
+///   bit 2: PC changed, bit 3: bank changed (access records only)
+/// Gap records are followed by a varint count of dropped events. Access records are
+/// followed by a varint cycle delta, a zigzag varint address delta, the value byte, then
+/// a zigzag varint PC delta and a varint bank if they changed. Deltas are from the
+/// previous access record, varints are LEB128.
+class BusTrace
+{
+public:
+    static constexpr size_t CAPACITY = 1 << 16; // Events, a power of 2
+
+    BusTrace();
+    ~BusTrace();
+
+    BusTrace(const BusTrace&) = delete;
+    BusTrace& operator=(const BusTrace&) = delete;
+
+    /// @brief Starts writing recorded events to `path`, replacing a running trace.
+    /// @returns false if the file could not be opened.
+    bool start(const std::string& path);
+
+    /// @brief Writes out everything recorded so far and closes the file.
+    void stop();
+
+    bool is_running() const { return running.load(std::memory_order_relaxed); }
+
+    /// @brief Adds an event, or drops it if the ring is full. Only to be called from one thread.
+    void record(const BusEvent& event)
+    {
+        if (!is_running()) return;
+
+        size_t head = write_index.load(std::memory_order_relaxed);
+
+        // The read index is only reloaded once the ring looks full
+        if (head - cached_read_index >= CAPACITY)
+        {
+            cached_read_index = read_index.load(std::memory_order_acquire);
+
+            if (head - cached_read_index >= CAPACITY)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        ring[head & (CAPACITY - 1)] = event;
+        write_index.store(head + 1, std::memory_order_release);
+    }
+
+private:
+    std::unique_ptr<BusEvent[]> ring;
+
+    // Producer and consumer indices on separate cache lines, so neither keeps invalidating the other
+    alignas(64) std::atomic<size_t> write_index{ 0 };
+    size_t cached_read_index = 0; // Producer's last look at read_index
+    alignas(64) std::atomic<size_t> read_index{ 0 };
+    alignas(64) std::atomic<uint64_t> dropped{ 0 };
+
+    std::atomic<bool> running{ false };
+    std::thread drain_thread;
+
+    void drain_loop(std::string path);
+};
@@ -0,0 +1,76 @@
+#include "call_profiler.hpp"
+
+#include <cstdio>
+
+CallProfiler::CallProfiler()
+{
+    reset();
+}
+
+void CallProfiler::on_call(uint16_t bank, uint16_t address, uint16_t return_sp)
+{
+    // A frame at or below the new return address was abandoned, e.g. by reloading SP
+    while (!stack.empty() && stack.back().return_sp <= return_sp)
+        stack.pop_back();
+
+    if (stack.size() == MAX_DEPTH) return;
+
+    uint32_t parent = current_node();
+    uint32_t key = (static_cast<uint32_t>(bank) << 16) | address;
+
+    auto [it, inserted] = children.try_emplace((static_cast<uint64_t>(parent) << 32) | key, static_cast<uint32_t>(nodes.size()));
+    if (inserted)
+        nodes.push_back(Node{ parent, key, 0 });
+
+    stack.push_back(Frame{ it->second, return_sp });
+}
+
+void CallProfiler::on_interrupt(uint16_t bank, uint16_t address, uint16_t return_sp)
+{
+    on_call(bank, address, return_sp);
+
+    charged_node = current_node();
+}
+
+void CallProfiler::on_return(uint16_t sp)
+{
+    while (!stack.empty() && stack.back().return_sp <= sp)
+        stack.pop_back();
+}
+
+std::string CallProfiler::frame_name(uint32_t key) const
+{
+    char name[16];
+
+    uint16_t bank = key >> 16;
+    if (bank == NO_BANK)
+        std::snprintf(name, sizeof(name), "%04X", key & 0xFFFF);
+    else
+        std::snprintf(name, sizeof(name), "%02X:%04X", bank, key & 0xFFFF);
+
+    return name;
+}
+
+void CallProfiler::write_folded(std::ostream& out) const
+{
+    std::vector<std::string> names(nodes.size());
+    names[0] = "root";
+
+    // Parents are always created before their children
+    for (size_t i = 1; i < nodes.size(); ++i)
+        names[i] = names[nodes[i].parent] + ';' + frame_name(nodes[i].key);
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].cycles != 0)
+            out << names[i] << ' ' << nodes[i].cycles << '\n';
+    }
+}
+
+void CallProfiler::reset()
+{
+    nodes.assign(1, Node{});
+    children.clear();
+    stack.clear();
+    charged_node = 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Build with -DGB_PROFILE_CALLS=1 to attribute emulated T-cycles to emulated
+// call stacks. Disabled builds contain none of it.
+#ifndef GB_PROFILE_CALLS
+#define GB_PROFILE_CALLS 0
+#endif
+
+/// @brief Shadow call stack of the emulated program, charging every instruction's
+/// T-cycles to the (ROM bank, address) frames it ran under.
+class CallProfiler
+{
+public:
+    static constexpr uint16_t NO_BANK = 0xFFFF; // Frame outside of the ROM area
+    static constexpr size_t MAX_DEPTH = 256; // Deeper calls are charged to the deepest frame
+
+    CallProfiler();
+
+    /// @brief Marks the start of an instruction, whose cycles go to the current frame.
+    void begin_instruction() { charged_node = current_node(); }
+    void end_instruction(uint32_t cycles) { nodes[charged_node].cycles += cycles; }
+
+    /// @brief Enters the function at `bank:address`.
+    /// @param return_sp SP before the return address is pushed, which RET/RETI restore.
+    void on_call(uint16_t bank, uint16_t address, uint16_t return_sp);
+
+    /// @brief Same as on_call, but the dispatch happens before the instruction, which
+    /// is then charged to the handler.
+    void on_interrupt(uint16_t bank, uint16_t address, uint16_t return_sp);
+
+    /// @brief Leaves every frame that SP has been popped past, so returning through
+    /// an extra POP or abandoning a stack never leaves stale frames.
+    void on_return(uint16_t sp);
+
+    /// @brief Writes one line per stack, "frame;frame;... cycles", as read by flamegraph.pl
+    /// and similar tools. Frames are "bank:address" in hex, "address" outside of ROM.
+    void write_folded(std::ostream& out) const;
+
+    void reset();
+
+private:
+    struct Node
+    {
+        uint32_t parent = 0;
+        uint32_t key = 0; // (bank << 16 | address)
+        uint64_t cycles = 0;
+    };
+
+    struct Frame
+    {
+        uint32_t node = 0;
+        uint16_t return_sp = 0;
+    };
+
+    std::vector<Node> nodes; // nodes[0] is the root, code that was never called
+    std::unordered_map<uint64_t, uint32_t> children; // (parent << 32 | key) -> node
+    std::vector<Frame> stack;
+    uint32_t charged_node = 0;
+
+    uint32_t current_node() const { return stack.empty() ? 0 : stack.back().node; }
+    std::string frame_name(uint32_t key) const;
+};
@@ -10,6 +10,12 @@ Cartridge::Cartridge(std::vector<uint8_t>& rom_data, std::vector<uint8_t>& ram_d
     ram(std::move(ram_data))
 {
     print();
+
+    if (!ram.empty())
+        ram_mask = static_cast<uint16_t>(std::min<size_t>(ram.size(), 0x2000) - 1);
+
+    select_mapper();
+    update_banks();
 }
 
 void Cartridge::print() 
@@ -121,7 +127,7 @@ size_t Cartridge::get_ram_size(uint8_t ram_size)
     }
 }
 
-void Cartridge::memory_write(uint8_t byte, uint16_t address)
+void Cartridge::select_mapper()
 {
     uint8_t cartridge_type = rom.at(CARTRIDGE_TYPE);
     switch (cartridge_type)
@@ -130,14 +136,17 @@ void Cartridge::memory_write(uint8_t byte, uint16_t address)
         case Type::RomOnly:
         case Type::RomRam:
         case Type::RomRamBattery:
-            if (ram.size() > 0 && address > 0x9FFF && address < 0xC000)
-                ram.at(address) = byte;
+            mapper = Mapper::RomOnly;
+            read_handler = &Cartridge::rom_only_read;
+            write_handler = &Cartridge::rom_only_write;
             break;
 
         case Type::MBC1:
         case Type::MBC1Ram:
         case Type::MBC1RamBattery:
-            mbc1_write(byte, address);
+            mapper = Mapper::MBC1;
+            read_handler = &Cartridge::mbc1_read;
+            write_handler = &Cartridge::mbc1_write;
             break;
 
         case Type::MBC3:
@@ -145,56 +154,187 @@ void Cartridge::memory_write(uint8_t byte, uint16_t address)
         case Type::MBC3TimerRamBattery:
         case Type::MBC3Ram:
         case Type::MBC3RamBattery:
-            mbc3_write(byte, address);
+            mapper = Mapper::MBC3;
+            read_handler = &Cartridge::mbc3_read;
+            write_handler = &Cartridge::mbc3_write;
             break;
         
         case Type::MBC5:
         case Type::MBC5Ram:
         case Type::MBC5RamBattery:
-            mbc5_write(byte, address);
+            mapper = Mapper::MBC5;
+            read_handler = &Cartridge::mbc5_read;
+            write_handler = &Cartridge::mbc5_write;
             break;
         
         default:
-            std::cout << "Uknown Cartridge Type: " << +cartridge_type << '\n';
+            mapper = Mapper::Unknown;
+            read_handler = &Cartridge::unknown_read;
+            write_handler = &Cartridge::unknown_write;
             break;
     } 
 }
 
-uint8_t Cartridge::memory_read(uint16_t address)
+void Cartridge::update_banks()
 {
-    uint8_t cartridge_type = rom.at(CARTRIDGE_TYPE);
-    switch (cartridge_type)
+    size_t total_rom_banks = rom.size() / 0x4000;
+
+    for (uint16_t slot = 0; slot < 2; ++slot)
     {
-        // Some ROM-only test files have cartridge type set to MBC1?
-        case Type::RomOnly:
-        case Type::RomRam:
-        case Type::RomRamBattery:
-            if (ram.size() > 0 && address > 0x9FFF && address < 0xC000)
-                return ram.at(address);
+        uint16_t bank = select_rom_bank(slot * 0x4000);
+        mapped_rom_banks[slot] = bank;
 
-            return rom.at(address);
-        
-        case Type::MBC1:
-        case Type::MBC1Ram:
-        case Type::MBC1RamBattery:
-            return mbc1_read(address);
+        // Bank bits beyond the size of the ROM are not connected
+        size_t index = bank % total_rom_banks;
+        const std::vector<std::vector<uint8_t>>& patched = patched_rom_banks[slot];
 
-        case Type::MBC3:
-        case Type::MBC3TimerBattery:
-        case Type::MBC3TimerRamBattery:
-        case Type::MBC3Ram:
-        case Type::MBC3RamBattery:
-            return mbc3_read(address);
+        if (mapper == Mapper::Unknown)
+            rom_banks[slot] = nullptr;
+        else if (!patched.empty() && !patched[index].empty())
+            rom_banks[slot] = patched[index].data();
+        else
+            rom_banks[slot] = rom.data() + index * 0x4000;
+    }
 
-        case Type::MBC5:
-        case Type::MBC5Ram:
-        case Type::MBC5RamBattery:
-            return mbc5_read(address);
+    ram_bank = select_ram_bank();
+}
 
-        default:
-            std::cout << "Unknown Cartridge Type: " << +cartridge_type << '\n';
-            return 0x00;
-    } 
+void Cartridge::set_rom_patches(const std::vector<RomPatch>& patches)
+{
+    size_t total_rom_banks = rom.size() / 0x4000;
+
+    for (auto& banks : patched_rom_banks)
+        banks.clear();
+
+    for (const RomPatch& patch : patches)
+    {
+        if (patch.address >= 0x8000) continue;
+
+        size_t slot = patch.address >= 0x4000;
+        size_t offset = patch.address & 0x3FFF;
+        std::vector<std::vector<uint8_t>>& banks = patched_rom_banks[slot];
+
+        for (size_t bank = 0; bank < total_rom_banks; ++bank)
+        {
+            // Only bank 0, or a multiple of 0x20 on MBC1 multi-carts, ever shows up at 0x0000
+            if (slot == 0 && bank % 0x20 != 0) continue;
+
+            // Compared with the plain ROM, so patches of the same byte do not see each other
+            const uint8_t* original = rom.data() + bank * 0x4000;
+            if (patch.compare >= 0 && original[offset] != patch.compare) continue;
+
+            if (banks.empty()) banks.resize(total_rom_banks);
+            if (banks[bank].empty()) banks[bank].assign(original, original + 0x4000);
+
+            banks[bank][offset] = patch.value;
+        }
+    }
+
+    update_banks();
+}
+
+void Cartridge::poke_ram(uint8_t bank, uint16_t address, uint8_t byte)
+{
+    if (ram.empty()) return;
+
+    size_t offset = static_cast<size_t>(bank) * 0x2000 + ((address - 0xA000) & ram_mask);
+    if (offset >= ram.size()) return;
+
+    ram[offset] = byte;
+    written_ram_pages.set(offset / RAM_PAGE_SIZE);
+}
+
+void Cartridge::switch_banks()
+{
+    std::array<uint16_t, 2> previous_rom_banks = mapped_rom_banks;
+    const uint8_t* previous_ram_bank = ram_bank;
+
+    update_banks();
+
+    ++bank_switch_stats.register_writes;
+    if (mapped_rom_banks != previous_rom_banks) ++bank_switch_stats.rom_switches;
+    if (ram_bank != previous_ram_bank) ++bank_switch_stats.ram_switches;
+}
+
+uint8_t* Cartridge::select_ram_bank()
+{
+    if (ram.empty()) return nullptr;
+
+    size_t offset = 0;
+
+    switch (mapper)
+    {
+    case Mapper::RomOnly:
+        return ram.data();
+
+    case Mapper::MBC1:
+        if (!external_ram_enable) return nullptr;
+
+        if (ram.size() == (32 * ONE_KB))
+            offset = banking_mode ? 0x2000 * ram_bank_number : 0;
+        else if (ram.size() != (2 * ONE_KB) && ram.size() != (8 * ONE_KB))
+            return nullptr;
+        break;
+
+    case Mapper::MBC3:
+        if (!external_ram_enable || is_rtc_mapped_to_ram) return nullptr;
+
+        offset = 0x2000 * ram_bank_number;
+        break;
+
+    case Mapper::MBC5:
+        if (!external_ram_enable) return nullptr;
+
+        offset = 0x2000 * ram_bank_number;
+        break;
+
+    default:
+        return nullptr;
+    }
+
+    return (offset + ram_mask < ram.size()) ? ram.data() + offset : nullptr;
+}
+
+inline uint8_t Cartridge::read_banked(uint16_t address)
+{
+    if (address < 0x4000) return rom_banks[0][address];
+    if (address < 0x8000) return rom_banks[1][address - 0x4000];
+
+    // External RAM
+    if (address >= 0xA000 && address < 0xC000)
+        return ram_bank ? ram_bank[(address - 0xA000) & ram_mask] : 0xFF;
+
+    return 0x00;
+}
+
+inline void Cartridge::write_banked_ram(uint8_t byte, uint16_t address)
+{
+    size_t offset = static_cast<size_t>(ram_bank - ram.data()) + ((address - 0xA000) & ram_mask);
+
+    ram[offset] = byte;
+    written_ram_pages.set(offset / RAM_PAGE_SIZE);
+}
+
+void Cartridge::rom_only_write(uint8_t byte, uint16_t address)
+{
+    if (ram_bank && address >= 0xA000 && address < 0xC000)
+        write_banked_ram(byte, address);
+}
+
+uint8_t Cartridge::rom_only_read(uint16_t address)
+{
+    return read_banked(address);
+}
+
+void Cartridge::unknown_write([[maybe_unused]] uint8_t byte, [[maybe_unused]] uint16_t address)
+{
+    std::cout << "Uknown Cartridge Type: " << +rom.at(CARTRIDGE_TYPE) << '\n';
+}
+
+uint8_t Cartridge::unknown_read([[maybe_unused]] uint16_t address)
+{
+    std::cout << "Unknown Cartridge Type: " << +rom.at(CARTRIDGE_TYPE) << '\n';
+    return 0x00;
 }
 
 void Cartridge::mbc1_write(uint8_t byte, uint16_t address)
@@ -213,7 +353,7 @@ void Cartridge::mbc1_write(uint8_t byte, uint16_t address)
     case 0x2000:
     case 0x3000:
         {
-            if (byte == 0) { rom_bank_number = 1; return; }
+            if (byte == 0) { rom_bank_number = 1; break; }
 
             uint8_t bitmask = std::min(0x1F, get_num_rom_banks() - 1);
             rom_bank_number = (byte & bitmask);
@@ -235,90 +375,17 @@ void Cartridge::mbc1_write(uint8_t byte, uint16_t address)
     case 0xA000:
     case 0xB000:
         // Writing to External RAM
-        if (external_ram_enable)
-        {   
-            if (ram.size() == (2 * ONE_KB) || ram.size() == (8 * ONE_KB))
-            {
-                ram.at((address - 0xA000) % ram.size()) = byte;
-            }
-            else if (ram.size() == (32 * ONE_KB))
-            {
-                if (banking_mode)
-                    ram.at(0x2000 * ram_bank_number + (address - 0xA000)) = byte;
-                else
-                    ram.at(address - 0xA000) = byte;
-            }
-        }
-        break;
+        if (ram_bank)
+            write_banked_ram(byte, address);
+        return;
     }
+
+    switch_banks();
 }
 
 uint8_t Cartridge::mbc1_read(uint16_t address)
 {
-    switch (address & 0xF000)
-    {
-    case 0x0000:
-    case 0x1000:
-    case 0x2000:
-    case 0x3000:
-        if (!banking_mode)
-            return rom.at(address);
-        else
-        {
-            uint8_t total_rom_banks = get_num_rom_banks();
-            uint16_t zero_bank_number = 0;
-
-            if (total_rom_banks == 64) // Multi-Cart ROMS work differently (<< 4 instead)
-                zero_bank_number = ((ram_bank_number & 1) << 5);
-            else if (total_rom_banks == 128)
-                zero_bank_number = ((ram_bank_number & 3) << 5);
-
-            return rom.at(address + (0x4000 * zero_bank_number));
-        }
-
-    case 0x4000:
-    case 0x5000:
-    case 0x6000:
-    case 0x7000:
-        {
-            uint8_t total_rom_banks = get_num_rom_banks();
-            //  ROM Bank number ANDed with the bitmap of the corresponding ROM size
-            uint8_t rom_size = total_rom_banks - 1;
-            uint8_t high_bank_number = rom_bank_number & rom_size;
-
-            if (total_rom_banks == 64) // Multi-Cart ROMS work differently
-            {
-                high_bank_number &= ~(1 << 5);
-                high_bank_number |= ((ram_bank_number & 1) << 5);
-            }
-            else if (total_rom_banks == 128)
-            {
-                high_bank_number &= ~(3 << 5);
-                high_bank_number |= ((ram_bank_number & 3) << 5);
-            }
-
-            return rom.at((0x4000 * high_bank_number) + (address - 0x4000));
-        }
-    
-    case 0xA000:
-    case 0xB000:
-        // Writing to External RAM
-        if (external_ram_enable)
-        {   
-            if (ram.size() == (2 * ONE_KB) || ram.size() == (8 * ONE_KB))
-                return ram.at((address - 0xA000) % ram.size());
-            else if (ram.size() == (32 * ONE_KB))
-            {
-                if (banking_mode)
-                    return ram.at(0x2000 * ram_bank_number + (address - 0xA000));
-                else
-                    return ram.at(address - 0xA000);
-            }
-        }
-        return 0xFF;
-    }
-
-    return 0x00;
+    return read_banked(address);
 }
 
 void Cartridge::mbc3_write(uint8_t byte, uint16_t address)
@@ -366,46 +433,76 @@ void Cartridge::mbc3_write(uint8_t byte, uint16_t address)
     case 0xB000:
         // Writing to External RAM
         if (!is_rtc_mapped_to_ram && external_ram_enable)
-            ram.at(0x2000 * ram_bank_number + (address - 0xA000)) = byte;
+        {
+            if (ram_bank)
+                write_banked_ram(byte, address);
+        }
         else
             write_to_rtc_register(byte);
-        break;
+        return;
     }
+
+    switch_banks();
 }
 
-uint8_t Cartridge::mbc3_read(uint16_t address)
+uint16_t Cartridge::select_rom_bank(uint16_t address)
 {
-    switch (address & 0xF000)
+    bool is_bank_zero = address < 0x4000;
+
+    switch (mapper)
     {
-    case 0x0000:
-    case 0x1000:
-    case 0x2000:
-    case 0x3000:
-        return rom.at(address);
-        break;
+    case Mapper::MBC1:
+        {
+            uint8_t total_rom_banks = get_num_rom_banks();
 
-    case 0x4000:
-    case 0x5000:
-    case 0x6000:
-    case 0x7000:
-        return rom.at(0x4000 * rom_bank_number + (address - 0x4000));
-        break;
+            if (is_bank_zero)
+            {
+                uint16_t zero_bank_number = 0;
+                if (!banking_mode) 
+                    return zero_bank_number;
 
-    case 0xA000:
-    case 0xB000:
-        // Writing to External RAM
-        if (is_rtc_mapped_to_ram)
-            return read_to_rtc_register();
-        else
-        {   
-            if (external_ram_enable)
-                return ram.at(0x2000 * ram_bank_number + (address - 0xA000));
-            else
-                return 0xFF;
+                if (total_rom_banks == 64) // Multi-Cart ROMS work differently (<< 4 instead)
+                    zero_bank_number = ((ram_bank_number & 1) << 5);
+                else if (total_rom_banks == 128)
+                    zero_bank_number = ((ram_bank_number & 3) << 5);
+
+                return zero_bank_number;
+            }
+
+            //  ROM Bank number ANDed with the bitmap of the corresponding ROM size
+            uint8_t rom_size = total_rom_banks - 1;
+            uint8_t high_bank_number = rom_bank_number & rom_size;
+
+            if (total_rom_banks == 64) // Multi-Cart ROMS work differently
+            {
+                high_bank_number &= ~(1 << 5);
+                high_bank_number |= ((ram_bank_number & 1) << 5);
+            }
+            else if (total_rom_banks == 128)
+            {
+                high_bank_number &= ~(3 << 5);
+                high_bank_number |= ((ram_bank_number & 3) << 5);
+            }
+
+            return high_bank_number;
         }
+
+    case Mapper::MBC3:
+    case Mapper::MBC5:
+        return is_bank_zero ? 0 : rom_bank_number;
+
+    default:
+        return is_bank_zero ? 0 : 1;
     }
+}
 
-    return 0;
+
+uint8_t Cartridge::mbc3_read(uint16_t address)
+{
+    if (is_rtc_mapped_to_ram && address >= 0xA000 && address < 0xC000)
+        return read_to_rtc_register();
+
+    return read_banked(address);
 }
 
 uint8_t Cartridge::read_to_rtc_register()
@@ -483,36 +580,15 @@ switch (address & 0xF000)
     case 0xA000:
     case 0xB000:
         // Writing to External RAM
-        if (external_ram_enable)
-            ram.at(0x2000 * ram_bank_number + (address - 0xA000)) = byte;
-
-        break;
+        if (ram_bank)
+            write_banked_ram(byte, address);
+        return;
     }
+
+    switch_banks();
 }
 
 uint8_t Cartridge::mbc5_read(uint16_t address)
 {
-    switch (address & 0xF000)
-    {
-    case 0x0000:
-    case 0x1000:
-    case 0x2000:
-    case 0x3000:
-        return rom.at(address);
-
-    case 0x4000:
-    case 0x5000:
-    case 0x6000:
-    case 0x7000:
-        return rom.at(0x4000 * rom_bank_number + (address - 0x4000));
-
-    case 0xA000:
-    case 0xB000:
-        if (external_ram_enable)
-            return ram.at(0x2000 * ram_bank_number + (address - 0xA000));
-        else
-            return 0xFF;
-    }
-
-    return 0x00;
+    return read_banked(address);
 }
\ No newline at end of file
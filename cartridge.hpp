@@ -5,6 +5,7 @@
 #include <iostream>
 #include <memory>
 #include <array>
+#include <bitset>
 
 // TODO: Add namespaces
 
@@ -55,6 +56,22 @@ constexpr static std::array<uint8_t, NINTENDO_LOGO_LEN> nintendo_logo = {
 
 constexpr int ONE_KB = 1024;
 
+/// @brief A ROM byte replaced on reads, e.g. by a Game Genie code.
+struct RomPatch
+{
+    uint16_t address = 0; // 0x0000-0x7FFF, in whichever bank is mapped there
+    uint8_t value = 0;
+    int compare = -1; // Only banks holding this byte at the address are patched, -1 for every bank
+};
+
+/// @brief MBC register writes and the bank switches they caused.
+struct BankSwitchStats
+{
+    uint64_t register_writes = 0; // Writes to 0x0000-0x7FFF
+    uint64_t rom_switches = 0; // Register writes that changed a mapped ROM bank
+    uint64_t ram_switches = 0; // Register writes that changed the mapped RAM bank, enabling/disabling it included
+};
+
 /// @brief Represents Game Boy cartridge with ROM data and optional RAM.
 /// Also supports MBC1.
 class Cartridge
@@ -62,6 +79,10 @@ class Cartridge
 public:
     Cartridge(std::vector<uint8_t>& rom_data, std::vector<uint8_t>& ram_data);
 
+    // The cached bank pointers point into this object
+    Cartridge(const Cartridge&) = delete;
+    Cartridge& operator=(const Cartridge&) = delete;
+
     enum Type : uint8_t
     {
         RomOnly = 0x00,
@@ -96,8 +117,11 @@ public:
 
     static std::unique_ptr<Cartridge> load_rom(const std::string path);
 
-    uint8_t memory_read(uint16_t address);
-    void memory_write(uint8_t byte, uint16_t address);
+    uint8_t memory_read(uint16_t address) { return (this->*read_handler)(address); }
+    void memory_write(uint8_t byte, uint16_t address) { (this->*write_handler)(byte, address); }
+
+    void rom_only_write(uint8_t byte, uint16_t address);
+    uint8_t rom_only_read(uint16_t address);
 
     void mbc1_write(uint8_t byte, uint16_t address);
     uint8_t mbc1_read(uint16_t address);
@@ -108,6 +132,45 @@ public:
     void mbc5_write(uint8_t byte, uint16_t address);
     uint8_t mbc5_read(uint16_t address);
 
+    void unknown_write(uint8_t byte, uint16_t address);
+    uint8_t unknown_read(uint16_t address);
+
+    /// @returns ROM bank currently mapped at address (0x0000-0x7FFF).
+    uint16_t get_rom_bank(uint16_t address) const { return mapped_rom_banks[address >= 0x4000]; }
+
+    /// @returns Start of the 16 KiB ROM bank mapped at address (0x0000-0x7FFF),
+    /// or nullptr if the mapper is unknown.
+    const uint8_t* get_rom_bank_data(uint16_t address) const { return rom_banks[address >= 0x4000]; }
+
+    /// @returns External RAM bank mapped at 0xA000-0xBFFF, 0 if none is.
+    uint16_t get_ram_bank() const { return ram_bank ? static_cast<uint16_t>((ram_bank - ram.data()) / (ONE_KB * 8)) : 0; }
+
+    /// @brief Recomputes the mapped banks from the bank registers. Called on every
+    /// MBC register write, and needed after setting the registers directly.
+    void update_banks();
+
+    const BankSwitchStats& get_bank_switch_stats() const { return bank_switch_stats; }
+
+    /* Cheats */
+    /// @brief Serves ROM reads from patched copies of the banks `patches` apply to, leaving the
+    /// others and `rom` itself untouched. No patches maps the plain ROM again.
+    void set_rom_patches(const std::vector<RomPatch>& patches);
+
+    /// @brief Writes to a cartridge RAM bank (address 0xA000-0xBFFF), whether it is mapped or not.
+    void poke_ram(uint8_t bank, uint16_t address, uint8_t byte);
+
+    /* Written RAM Pages */
+    static constexpr size_t RAM_PAGE_SIZE = 0x100;
+    static constexpr size_t RAM_PAGE_COUNT = (128 * ONE_KB) / RAM_PAGE_SIZE; // Enough for the largest RAM
+
+    /// @returns Pages of `ram` written since the last call, which clears them.
+    std::bitset<RAM_PAGE_COUNT> take_written_ram_pages()
+    {
+        auto pages = written_ram_pages;
+        written_ram_pages.reset();
+        return pages;
+    }
+
     /* Debugging */
     void print();    
     
@@ -146,9 +209,43 @@ private:
     const uint8_t RTC_DH_BITMASK = 0b11000001;
 
 
-    // Use function pointers depending on MBC Type?
-    // int (*memory_read)(int);
-    // int (*memory_write)(int, int);
+    /* Mapper */
+    enum class Mapper : uint8_t { RomOnly, MBC1, MBC3, MBC5, Unknown };
+
+    // Resolved from the cartridge type once, on construction
+    Mapper mapper = Mapper::Unknown;
+    uint8_t (Cartridge::*read_handler)(uint16_t) = &Cartridge::unknown_read;
+    void (Cartridge::*write_handler)(uint8_t, uint16_t) = &Cartridge::unknown_write;
+
+    void select_mapper();
+
+    /* Mapped Banks */
+    std::array<const uint8_t*, 2> rom_banks{}; // 0x0000-0x3FFF and 0x4000-0x7FFF
+    std::array<uint16_t, 2> mapped_rom_banks{ 0, 1 };
+
+    uint8_t* ram_bank = nullptr; // 0xA000-0xBFFF, nullptr if disabled, absent or showing an RTC register
+    uint16_t ram_mask = 0; // Carts with 2 KiB of RAM mirror it across the 8 KiB window
+
+    // Patched copies of ROM banks, by slot (0x0000-0x3FFF, 0x4000-0x7FFF) and bank.
+    // Empty unless there are ROM patches, and empty for banks none applies to.
+    std::array<std::vector<std::vector<uint8_t>>, 2> patched_rom_banks;
+
+    /// @returns ROM bank the mapper's registers select for address (0x0000-0x7FFF).
+    uint16_t select_rom_bank(uint16_t address);
+    uint8_t* select_ram_bank();
+
+    BankSwitchStats bank_switch_stats;
+
+    /// @brief update_banks() after an MBC register write, counting the write and any bank it switched.
+    void switch_banks();
+
+    /// @brief Reads ROM and external RAM through the mapped banks.
+    inline uint8_t read_banked(uint16_t address);
+
+    /// @brief Writes to the external RAM bank mapped (must not be nullptr), noting the page written.
+    inline void write_banked_ram(uint8_t byte, uint16_t address);
+
+    std::bitset<RAM_PAGE_COUNT> written_ram_pages{};
 
     /* Helper Methods */
     static size_t get_ram_size(uint8_t ram_size);
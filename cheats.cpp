@@ -0,0 +1,169 @@
+#include "cheats.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+namespace
+{
+    int hex_digit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+    uint32_t parse_hex(const std::string& digits, size_t start, size_t count)
+    {
+        uint32_t value = 0;
+        for (size_t i = start; i < start + count; ++i)
+            value = (value << 4) | static_cast<uint32_t>(hex_digit(digits[i]));
+
+        return value;
+    }
+}
+
+CheatEngine::CheatEngine(Mmu& _mmu, Cartridge* _cartridge) :
+    mmu(_mmu),
+    cartridge(_cartridge)
+{}
+
+uint32_t CheatEngine::add_code(const std::string& code)
+{
+    // Game Genie codes are usually written with dashes
+    std::string digits;
+    bool is_hex = true;
+
+    for (char c : code)
+    {
+        if (c == '-' || std::isspace(static_cast<unsigned char>(c))) continue;
+
+        is_hex = is_hex && hex_digit(c) >= 0;
+        digits.push_back(c);
+    }
+
+    Cheat cheat;
+    cheat.code = code;
+
+    bool valid = is_hex && ((digits.size() == 8) ? decode_game_shark(digits, cheat) : decode_game_genie(digits, cheat));
+
+    if (!valid)
+    {
+        std::cerr << "Invalid cheat code: " << code << '\n';
+        return 0;
+    }
+
+    cheat.id = next_id++;
+    cheats.push_back(cheat);
+    update(cheat.type == CheatType::GameGenie);
+
+    return cheat.id;
+}
+
+bool CheatEngine::remove_cheat(uint32_t id)
+{
+    auto it = std::find_if(cheats.begin(), cheats.end(), [id](const Cheat& cheat) { return cheat.id == id; });
+    if (it == cheats.end()) return false;
+
+    bool rom_changed = (it->type == CheatType::GameGenie);
+    cheats.erase(it);
+    update(rom_changed);
+
+    return true;
+}
+
+bool CheatEngine::set_enabled(uint32_t id, bool enabled)
+{
+    auto it = std::find_if(cheats.begin(), cheats.end(), [id](const Cheat& cheat) { return cheat.id == id; });
+    if (it == cheats.end()) return false;
+
+    if (it->enabled != enabled)
+    {
+        it->enabled = enabled;
+        update(it->type == CheatType::GameGenie);
+    }
+
+    return true;
+}
+
+void CheatEngine::clear()
+{
+    cheats.clear();
+    update(has_rom_patches);
+}
+
+void CheatEngine::apply_ram_cheats()
+{
+    if (!has_ram_cheats) return;
+
+    for (const Cheat& cheat : cheats)
+    {
+        if (cheat.type != CheatType::GameShark || !cheat.enabled) continue;
+
+        bool banked = (cheat.code_type & 0xF0) == 0x80 && cheat.address >= CARTRIDGE_RAM_START && cheat.address <= CARTRIDGE_RAM_END;
+
+        if (banked && cartridge)
+            cartridge->poke_ram(cheat.code_type & 0x0F, cheat.address, cheat.value);
+        else
+            mmu.write_byte(cheat.value, cheat.address);
+    }
+}
+
+void CheatEngine::update(bool rom_changed)
+{
+    has_ram_cheats = std::any_of(cheats.begin(), cheats.end(),
+        [](const Cheat& cheat) { return cheat.type == CheatType::GameShark && cheat.enabled; });
+
+    if (!rom_changed || !cartridge) return;
+
+    std::vector<RomPatch> patches;
+    for (const Cheat& cheat : cheats)
+    {
+        if (cheat.type != CheatType::GameGenie || !cheat.enabled) continue;
+
+        RomPatch patch;
+        patch.address = cheat.address;
+        patch.value = cheat.value;
+        patch.compare = cheat.compare;
+        patches.push_back(patch);
+    }
+
+    has_rom_patches = !patches.empty();
+
+    cartridge->set_rom_patches(patches);
+    mmu.remap_rom();
+
+    if (rom_patch_callback) rom_patch_callback();
+}
+
+bool CheatEngine::decode_game_shark(const std::string& digits, Cheat& cheat)
+{
+    // ttvvaaaa, with the address little-endian
+    cheat.type = CheatType::GameShark;
+    cheat.code_type = static_cast<uint8_t>(parse_hex(digits, 0, 2));
+    cheat.value = static_cast<uint8_t>(parse_hex(digits, 2, 2));
+    cheat.address = static_cast<uint16_t>(parse_hex(digits, 4, 2) | (parse_hex(digits, 6, 2) << 8));
+
+    // Writes below 0x8000 would be MBC register writes
+    return cheat.address >= VRAM_START;
+}
+
+bool CheatEngine::decode_game_genie(const std::string& digits, Cheat& cheat)
+{
+    if (digits.size() != 6 && digits.size() != 9) return false;
+
+    // ABC-DEF-GHI: AB is the value, FCDE the address with F inverted, GI the compare
+    // byte rotated and scrambled. H is not used.
+    cheat.type = CheatType::GameGenie;
+    cheat.value = static_cast<uint8_t>(parse_hex(digits, 0, 2));
+    cheat.address = static_cast<uint16_t>(parse_hex(digits, 2, 3) | ((parse_hex(digits, 5, 1) ^ 0xF) << 12));
+
+    if (digits.size() == 9)
+    {
+        uint8_t scrambled = static_cast<uint8_t>((parse_hex(digits, 6, 1) << 4) | parse_hex(digits, 8, 1));
+        cheat.compare = static_cast<uint8_t>((scrambled >> 2) | (scrambled << 6)) ^ 0xBA;
+    }
+
+    return cheat.address <= BANK_N_END;
+}
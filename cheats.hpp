@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "memory.hpp"
+
+enum class CheatType : uint8_t
+{
+    GameShark, // RAM write, repeated every frame
+    GameGenie // ROM patch
+};
+
+/// @brief One decoded cheat code.
+struct Cheat
+{
+    uint32_t id = 0;
+    CheatType type = CheatType::GameShark;
+    std::string code; // As entered
+    bool enabled = true;
+
+    uint16_t address = 0;
+    uint8_t value = 0;
+    int compare = -1; // Game Genie: byte the ROM has to hold for the patch to apply, -1 for any
+    uint8_t code_type = 0x01; // GameShark: 0x80-0x8F write that cartridge RAM bank, anything else what is mapped
+};
+
+/// @brief GameShark and Game Genie cheats.
+///
+/// GameShark codes are written to RAM once per frame, at VBlank. Game Genie codes patch
+/// copies of the ROM banks they apply to, which the cartridge maps instead of the plain
+/// ones, so ROM reads never check for cheats. Without cheats, nothing changes.
+class CheatEngine
+{
+public:
+    CheatEngine(Mmu& mmu, Cartridge* cartridge);
+
+    /// @brief Adds a GameShark ("ttvvaaaa", e.g. "01FF34C1") or Game Genie ("ABC-DEF" or
+    /// "ABC-DEF-GHI") code, enabled.
+    /// @returns Id of the cheat, 0 if the code is not valid.
+    uint32_t add_code(const std::string& code);
+
+    /// @returns false if there is no cheat with that id.
+    bool remove_cheat(uint32_t id);
+    bool set_enabled(uint32_t id, bool enabled);
+
+    void clear();
+
+    const std::vector<Cheat>& get_cheats() const { return cheats; }
+
+    /// @brief Writes the enabled GameShark codes. Called once per frame, at VBlank.
+    void apply_ram_cheats();
+
+    /// @brief Sets the function called after the ROM patches change, e.g. to drop code
+    /// cached from the unpatched ROM.
+    void set_rom_patch_callback(std::function<void()> callback) { rom_patch_callback = std::move(callback); }
+
+private:
+    Mmu& mmu;
+    Cartridge* cartridge = nullptr;
+
+    std::vector<Cheat> cheats;
+    uint32_t next_id = 1;
+
+    bool has_ram_cheats = false; // Any enabled GameShark code
+    bool has_rom_patches = false; // Any Game Genie code applied to the cartridge
+
+    std::function<void()> rom_patch_callback;
+
+    /// @brief Recomputes has_ram_cheats and, if Game Genie codes changed, the cartridge's ROM patches.
+    void update(bool rom_changed);
+
+    static bool decode_game_shark(const std::string& digits, Cheat& cheat);
+    static bool decode_game_genie(const std::string& digits, Cheat& cheat);
+};
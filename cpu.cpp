@@ -1,10 +1,13 @@
 #include "cpu.hpp"
+#include "jit.hpp"
+#include "opcodes.hpp"
 
 #include <iostream>
+#include <fstream>
 #include <cassert>
 #include <cstring>
-#include <stdexcept> // Should get rid of these soon
 #include <array>
+#include <algorithm>
 
 constexpr uint8_t CB_U3_BITMASK = 0b111000;
 constexpr uint8_t CB_OP_BITMASK = 0b111;
@@ -12,8 +15,6 @@ constexpr uint8_t CB_OP_BITMASK = 0b111;
 constexpr uint8_t LD_SRC_BITMASK = 0b111;
 constexpr uint8_t LD_DST_BITMASK = 0b111000;
 
-constexpr uint8_t ARITHMETIC_OP_BITMASK = 0x07;
-
 constexpr uint8_t MSB_BITMASK = 0x80;
 constexpr uint8_t LSB_BITMASK = 0x01;
 
@@ -22,7 +23,21 @@ constexpr uint8_t HIGH_NIBBLE_MASK = 0xF0;
 
 Cpu::Cpu(Mmu& _mem) :
     mem(_mem)
-{}
+{
+    mem.set_code_write_callback([this](uint16_t address) { on_code_write(address); });
+}
+
+Cpu::~Cpu() = default;
+
+void Cpu::set_state(const CpuState& state)
+{
+    static_cast<CpuState&>(*this) = state;
+
+    // Nothing derived from the old registers may outlive them
+    lazy_flags = LazyFlags{};
+    current_block = nullptr;
+    loop_snapshot = LoopSnapshot{};
+}
 
 void print_reg(uint8_t reg) { std::cout << "0x" << std::hex << +reg << ", "; }
 void print_reg(uint16_t reg) { std::cout << "0x" << std::hex << +reg << ", "; }
@@ -49,28 +64,28 @@ void Cpu::test()
 void Cpu::print_registers() const
 {
     std::cout << "A: ";
-    print_reg(AF.high);
+    print_reg(r8[A]);
   
     std::cout << "F: ";
-    print_reg(AF.low);
+    print_reg(evaluate_flags());
 
     std::cout << "B: ";
-    print_reg(BC.high);
+    print_reg(r8[B]);
 
     std::cout << "C: ";
-    print_reg(BC.low);
+    print_reg(r8[C]);
 
     std::cout << "D: ";
-    print_reg(DE.high);
+    print_reg(r8[D]);
 
     std::cout << "E: ";
-    print_reg(DE.low);
+    print_reg(r8[E]);
 
     std::cout << "H: ";
-    print_reg(HL.high);
+    print_reg(r8[H]);
 
     std::cout << "L: ";
-    print_reg(HL.low);
+    print_reg(r8[L]);
 
     std::cout << "PC: ";
     print_reg(PC);
@@ -84,12 +99,67 @@ void Cpu::print_registers() const
 /* Flag Functions */
 inline void Cpu::set_flag(Flags f, bool cond)
 {
-    F = (cond) ? (F | static_cast<uint8_t>(f)) : (F & ~static_cast<uint8_t>(f));
+    materialize_flags();
+
+    r8[F] = (cond) ? (r8[F] | static_cast<uint8_t>(f)) : (r8[F] & ~static_cast<uint8_t>(f));
 }
 
 bool Cpu::check_flag(Flags f) const
 {
-    return (F & static_cast<uint8_t>(f)) != 0;
+    return (evaluate_flags() & static_cast<uint8_t>(f)) != 0;
+}
+
+void Cpu::print_opcode_profile() const
+{
+#if GB_PROFILE_OPCODES
+    profiler.print_report(std::cout);
+#else
+    std::cout << "Opcode profiling is disabled, build with GB_PROFILE_OPCODES=1\n";
+#endif
+}
+
+std::array<uint16_t, Cpu::PC_HISTORY_SIZE> Cpu::get_pc_history() const
+{
+    std::array<uint16_t, PC_HISTORY_SIZE> history;
+
+    for (size_t i = 0; i < PC_HISTORY_SIZE; ++i)
+        history[i] = pc_history[(pc_history_index + i) % PC_HISTORY_SIZE];
+
+    return history;
+}
+
+void Cpu::write_call_profile([[maybe_unused]] const std::string& path) const
+{
+#if GB_PROFILE_CALLS
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cerr << "Could not open " << path << " for writing\n";
+        return;
+    }
+
+    call_profiler.write_folded(file);
+    std::cout << "Call profile written to " << path << '\n';
+#else
+    std::cout << "Call profiling is disabled, build with GB_PROFILE_CALLS=1\n";
+#endif
+}
+
+void Cpu::start_bus_trace([[maybe_unused]] const std::string& path)
+{
+#if GB_TRACE_BUS
+    if (bus_trace.start(path))
+        std::cout << "Tracing bus accesses to " << path << '\n';
+#else
+    std::cout << "Bus tracing is disabled, build with GB_TRACE_BUS=1\n";
+#endif
+}
+
+void Cpu::stop_bus_trace()
+{
+#if GB_TRACE_BUS
+    bus_trace.stop();
+#endif
 }
 
 void Cpu::print_flags() const
@@ -99,8 +169,9 @@ void Cpu::print_flags() const
     std::cout << "H: " << static_cast<int>(check_flag(Flags::HalfCarry)) << ", ";
     std::cout << "C: " << static_cast<int>(check_flag(Flags::Carry)) << ", ";
 
+    uint8_t flags = evaluate_flags();
     for (uint8_t i = 0; i < 8; i++)
-        std::cout << (((0x80 >> i) & F) != 0);
+        std::cout << (((0x80 >> i) & flags) != 0);
     
     std::cout << '\n';
 }
@@ -168,1461 +239,1701 @@ inline bool check_half_borrow(uint8_t n1, uint8_t n2)
     return (n2 & LOW_NIBBLE_MASK) > (n1 & LOW_NIBBLE_MASK);
 }
 
+/* Lazy Flags */
+// ALU helpers only record their operands; flags are computed when something reads them.
+inline void Cpu::record_flags(FlagOp op, uint8_t lhs, uint8_t rhs, uint8_t result, uint8_t carry)
+{
+    lazy_flags.op = op;
+    lazy_flags.lhs = lhs;
+    lazy_flags.rhs = rhs;
+    lazy_flags.carry = carry;
+    lazy_flags.result = result;
+}
+
+uint8_t Cpu::evaluate_flags() const
+{
+    const LazyFlags& pending = lazy_flags;
+
+    bool subtraction = false;
+    bool half_carry = false;
+    bool carry = false;
+
+    switch (pending.op)
+    {
+    case FlagOp::None:
+        return r8[F];
+    case FlagOp::Add:
+        half_carry = check_half_carry(pending.lhs, pending.rhs);
+        carry = check_carry(pending.lhs, pending.rhs);
+        break;
+    case FlagOp::Adc:
+        half_carry = check_half_carry(pending.lhs, pending.rhs, pending.carry);
+        carry = check_carry(pending.lhs, pending.rhs, pending.carry);
+        break;
+    case FlagOp::Sub:
+        subtraction = true;
+        half_carry = check_half_borrow(pending.lhs, pending.rhs);
+        carry = check_borrow(pending.lhs, pending.rhs);
+        break;
+    case FlagOp::Sbc:
+        subtraction = true;
+        half_carry = check_half_borrow(pending.lhs, pending.rhs, pending.carry);
+        carry = check_borrow(pending.lhs, pending.rhs, pending.carry);
+        break;
+    case FlagOp::And:
+        half_carry = true;
+        break;
+    case FlagOp::Logic:
+        break;
+    case FlagOp::Inc:
+        half_carry = check_half_carry(pending.lhs, pending.rhs);
+        carry = pending.carry;
+        break;
+    case FlagOp::Dec:
+        subtraction = true;
+        half_carry = check_half_borrow(pending.lhs, pending.rhs);
+        carry = pending.carry;
+        break;
+    case FlagOp::Bit:
+        half_carry = true;
+        carry = pending.carry;
+        break;
+    case FlagOp::ShiftLeft:
+        carry = (pending.lhs & MSB_BITMASK) != 0;
+        break;
+    case FlagOp::ShiftRight:
+        carry = (pending.lhs & LSB_BITMASK) != 0;
+        break;
+    }
+
+    uint8_t flags = r8[F] & LOW_NIBBLE_MASK;
+    if (pending.result == 0) flags |= static_cast<uint8_t>(Flags::Zero);
+    if (subtraction) flags |= static_cast<uint8_t>(Flags::Subtraction);
+    if (half_carry) flags |= static_cast<uint8_t>(Flags::HalfCarry);
+    if (carry) flags |= static_cast<uint8_t>(Flags::Carry);
+
+    return flags;
+}
+
+// Z is derived from the result alone, which makes conditional branches after CP/DEC cheap
+inline bool Cpu::zero_flag() const
+{
+    if (lazy_flags.op == FlagOp::None)
+        return (r8[F] & static_cast<uint8_t>(Flags::Zero)) != 0;
+
+    return lazy_flags.result == 0;
+}
+
+inline bool Cpu::carry_flag() const
+{
+    return (evaluate_flags() & static_cast<uint8_t>(Flags::Carry)) != 0;
+}
+
+void Cpu::materialize_flags()
+{
+    if (lazy_flags.op == FlagOp::None) return;
+
+    r8[F] = evaluate_flags();
+    lazy_flags.op = FlagOp::None;
+}
+
+template<typename Timing>
 inline uint16_t Cpu::read_next16()
 {
-    uint8_t low = mem.read_byte(PC++);
-    uint8_t high = mem.read_byte(PC++);
+    uint8_t low = read_next8<Timing>();
+    uint8_t high = read_next8<Timing>();
 
     return (high << 8) | low;
 }
 
-bool Cpu::check_condition_code(int cond) 
-{ 
-    switch(cond)
+/* Register Access */
+// Register indices follow the SM83 opcode encoding: B, C, D, E, H, L, [HL], A
+template<int INDEX>
+inline uint8_t& Cpu::reg8()
+{
+    static_assert(INDEX >= 0 && INDEX <= 7 && INDEX != 6, "Index 6 encodes [HL], not a register");
+
+    return r8[r8_slot(INDEX)];
+}
+
+// 16-bit register indices: BC, DE, HL, SP
+template<int INDEX>
+inline uint16_t& Cpu::reg16()
+{
+    static_assert(INDEX >= 0 && INDEX <= 3, "Invalid 16-bit register index");
+
+    if constexpr (INDEX == 3) return SP;
+    else return r16[INDEX];
+}
+
+// Condition codes: NZ, Z, NC, C
+template<int CC>
+inline bool Cpu::condition() const
+{
+    static_assert(CC >= 0 && CC <= 3, "Invalid condition code");
+
+    if constexpr (CC == 0) return !zero_flag();
+    else if constexpr (CC == 1) return zero_flag();
+    else if constexpr (CC == 2) return !carry_flag();
+    else return carry_flag();
+}
+
+// 0b10yyyxxx - yyy selects the operation
+template<int OPERATION>
+inline void Cpu::alu_a(uint8_t byte)
+{
+    if constexpr (OPERATION == 0) add_a(byte);
+    else if constexpr (OPERATION == 1) adc_a(byte);
+    else if constexpr (OPERATION == 2) sub_a(byte);
+    else if constexpr (OPERATION == 3) sbc_a(byte);
+    else if constexpr (OPERATION == 4) and_a(byte);
+    else if constexpr (OPERATION == 5) xor_a(byte);
+    else if constexpr (OPERATION == 6) or_a(byte);
+    else cp_a(byte);
+}
+
+// CB-Prefix + 0b00yyyxxx - yyy selects the operation
+template<int OPERATION>
+inline void Cpu::shift_r8(uint8_t& reg8)
+{
+    if constexpr (OPERATION == 0) rlc_r8(reg8);
+    else if constexpr (OPERATION == 1) rrc_r8(reg8);
+    else if constexpr (OPERATION == 2) rl_r8(reg8);
+    else if constexpr (OPERATION == 3) rr_r8(reg8);
+    else if constexpr (OPERATION == 4) sla_r8(reg8);
+    else if constexpr (OPERATION == 5) sra_r8(reg8);
+    else if constexpr (OPERATION == 6) swap_r8(reg8);
+    else srl_r8(reg8);
+}
+
+/* Memory Access */
+// The opcode fetch takes the first M-cycle of an instruction, every later
+// access (and internal delay) its own one. With FastTiming, timer/PPU events
+// in between are only seen once the whole instruction has run.
+template<typename Timing>
+inline void Cpu::next_m_cycle()
+{
+    if constexpr (Timing::PER_ACCESS)
     {
-    case 0:
-        return !check_flag(Flags::Zero);
+        synced_cycles += 4;
+        sync_callback(4);
+    }
 
-    case 1:
-        return check_flag(Flags::Zero);
+#if GB_TRACE_BUS
+    bus_trace_offset += 4;
+#endif
+}
 
-    case 2:
-        return !check_flag(Flags::Carry);
+template<typename Timing>
+inline uint8_t Cpu::read8(uint16_t address)
+{
+    next_m_cycle<Timing>();
 
-    case 3:
-        return check_flag(Flags::Carry);
-    
-    default:
-        std::cerr << "Invalid CC Code: " << std::hex << cond;
-        break;
+    uint8_t byte = mem.read_byte(address);
+    trace_bus(BusAccess::Read, address, byte);
+
+    return byte;
+}
+
+template<typename Timing>
+inline void Cpu::write8(uint8_t byte, uint16_t address)
+{
+    next_m_cycle<Timing>();
+
+    mem.write_byte(byte, address);
+    trace_bus(BusAccess::Write, address, byte);
+}
+
+template<typename Timing>
+inline uint8_t Cpu::read_next8()
+{
+    next_m_cycle<Timing>();
+
+    uint8_t byte = mem.read_byte(PC);
+    trace_bus(BusAccess::Fetch, PC, byte);
+    ++PC;
+
+    return byte;
+}
+
+inline void Cpu::fetch_opcode()
+{
+    IR = mem.read_byte(PC);
+    trace_bus(BusAccess::Fetch, PC, IR);
+    ++PC;
+}
+
+inline void Cpu::trace_bus([[maybe_unused]] BusAccess access, [[maybe_unused]] uint16_t address, [[maybe_unused]] uint8_t value)
+{
+#if GB_TRACE_BUS
+    BusEvent event;
+    event.cycle = bus_trace_cycle + bus_trace_offset;
+    event.address = address;
+    event.pc = bus_trace_pc;
+    event.bank = mem.get_bank(address);
+    event.value = value;
+    event.access = access;
+
+    bus_trace.record(event);
+#endif
+}
+
+/* Operand Fetching */
+// Predecoded instructions carry their operands with them, so PC has already
+// been advanced past the instruction when the handler runs.
+template<bool PREDECODED, typename Timing>
+inline uint8_t Cpu::fetch8()
+{
+    if constexpr (PREDECODED) return static_cast<uint8_t>(operand);
+    else return read_next8<Timing>();
+}
+
+template<bool PREDECODED, typename Timing>
+inline uint16_t Cpu::fetch16()
+{
+    if constexpr (PREDECODED) return operand;
+    else return read_next16<Timing>();
+}
+
+/* Opcode Dispatch Tables */
+template<uint8_t OPCODE, bool PREDECODED, typename Timing>
+void Cpu::dispatch_opcode(Cpu& cpu)
+{
+#if GB_PROFILE_OPCODES
+    // CB-prefixed instructions are timed by their own handler
+    if (cpu.profiler.count(OPCODE) && OPCODE != 0xCB)
+    {
+        auto start = OpcodeProfiler::Clock::now();
+        cpu.execute_opcode<OPCODE, PREDECODED, Timing>();
+        cpu.profiler.add_sample(OPCODE, OpcodeProfiler::Clock::now() - start);
+        return;
     }
+#endif
 
-    return false;
+    cpu.execute_opcode<OPCODE, PREDECODED, Timing>();
 }
 
-// TODO: Get rid of ALL Exception handling
-uint8_t Cpu::get_reg(int index)
+template<uint8_t OPCODE, typename Timing>
+void Cpu::dispatch_cb_opcode(Cpu& cpu)
 {
-    switch (index)
+#if GB_PROFILE_OPCODES
+    if (cpu.profiler.count_cb(OPCODE))
     {
-    case 0:
-        return BC.high;
-    case 1:
-        return BC.low;
-    case 2:
-        return DE.high;
-    case 3:
-        return DE.low;
-    case 4:
-        return HL.high;
-    case 5:
-        return HL.low;  
-    case 7:
-        return AF.high;
-    default:
-        throw std::invalid_argument("Invalid index: " + index);
-        break;
+        auto start = OpcodeProfiler::Clock::now();
+        cpu.execute_cb_opcode<OPCODE, Timing>();
+        cpu.profiler.add_cb_sample(OPCODE, OpcodeProfiler::Clock::now() - start);
+        return;
     }
+#endif
+
+    cpu.execute_cb_opcode<OPCODE, Timing>();
+}
+
+template<bool PREDECODED, typename Timing, size_t... OPCODES>
+constexpr std::array<Cpu::OpcodeHandler, 256> Cpu::make_opcode_table(std::index_sequence<OPCODES...>)
+{
+    return {{ &Cpu::dispatch_opcode<static_cast<uint8_t>(OPCODES), PREDECODED, Timing>... }};
+}
+
+template<typename Timing, size_t... OPCODES>
+constexpr std::array<Cpu::OpcodeHandler, 256> Cpu::make_cb_opcode_table(std::index_sequence<OPCODES...>)
+{
+    return {{ &Cpu::dispatch_cb_opcode<static_cast<uint8_t>(OPCODES), Timing>... }};
+}
+
+template<typename Timing>
+uint32_t Cpu::execute_instruction()
+{
+    return pc_history_enabled ? run_instruction<Timing, true>() : run_instruction<Timing, false>();
 }
 
-uint8_t& Cpu::get_reg_ref(int index)
+template<typename Timing, bool RECORD_PC>
+uint32_t Cpu::run_instruction()
 {
-    switch (index)
+    if constexpr (RECORD_PC)
+        pc_history[pc_history_index++ % PC_HISTORY_SIZE] = PC;
+
+#if GB_TRACE_BUS
+    bus_trace_pc = PC;
+    bus_trace_offset = 0;
+#endif
+
+#if GB_PROFILE_CALLS
+    call_profiler.begin_instruction();
+    uint32_t cycles = step_instruction<Timing>();
+    call_profiler.end_instruction(cycles);
+#else
+    uint32_t cycles = step_instruction<Timing>();
+#endif
+
+#if GB_TRACE_BUS
+    bus_trace_cycle += cycles;
+#endif
+
+    return cycles;
+}
+
+template<typename Timing>
+uint32_t Cpu::step_instruction()
+{
+    if constexpr (Timing::PER_ACCESS)
+        return execute_accurate_instruction();
+
+    check_interrupts();
+
+    // Nothing happens until an interrupt wakes the CPU, so skip ahead to the next one that can
+    if (is_halted) return std::max<uint32_t>(cycle_budget, 1);
+
+    if (block_cache_enabled) 
+        return execute_cached_instruction();
+
+    fetch_opcode();
+
+    opcode_table[IR](*this);
+
+    return ticks;
+}
+
+uint32_t Cpu::execute_accurate_instruction()
+{
+    check_interrupts();
+
+    synced_cycles = 0;
+
+    // Predecoded blocks never fetch their opcodes, so there is nothing to time them by
+    if (is_halted)
+        ticks = std::max<uint32_t>(cycle_budget, 1);
+    else
     {
-    case 0:
-        return BC.high;
-    case 1:
-        return BC.low;
-    case 2:
-        return DE.high;
-    case 3:
-        return DE.low;
-    case 4:
-        return HL.high;
-    case 5:
-        return HL.low;   
-    case 7:
-        return AF.high;
-    default:
-        throw std::invalid_argument("Invalid index: " + index);
-        break;
+        fetch_opcode();
+        accurate_opcode_table[IR](*this);
     }
+
+    // Internal cycles after the last memory access
+    sync_callback(ticks - synced_cycles);
+
+    return ticks;
+}
+
+template<typename Timing>
+uint32_t Cpu::execute_cycles(uint32_t budget)
+{
+    // Chosen once per batch, so batches without the watchdog don't record anything
+    return pc_history_enabled ? run_cycles<Timing, true>(budget) : run_cycles<Timing, false>(budget);
 }
 
-uint16_t Cpu::get_reg16(int index)
+template<typename Timing, bool RECORD_PC>
+uint32_t Cpu::run_cycles(uint32_t budget)
 {
-    switch (index)
+    uint32_t cycles = 0;
+    exit_requested = false;
+
+    do
     {
-    case 0:
-        return BC.r16;
-    case 1:
-        return DE.r16;
-    case 2:
-        return HL.r16;
-    case 3:
-        return SP;
-    default:
-        throw std::invalid_argument("Invalid index: " + index);
-        break;
+        cycle_budget = budget - cycles;
+        cycles += run_instruction<Timing, RECORD_PC>();
+    } while (cycles < budget && !exit_requested);
+
+    return cycles;
+}
+
+template<typename Timing>
+uint32_t Cpu::execute_cycles_checked(uint32_t budget, const std::function<bool()>& should_stop)
+{
+    uint32_t cycles = 0;
+    exit_requested = false;
+
+    while (cycles < budget && !exit_requested && !should_stop())
+    {
+        // Dispatching is a step of its own, so `should_stop` sees the vector before its
+        // first instruction runs. It takes no cycles, as when both run in one instruction.
+        if (dispatch_interrupt()) continue;
+
+        // With no cycles to spare, nothing runs more than the one instruction.
+        // A halted CPU still skips ahead, there is no instruction to stop at.
+        cycle_budget = is_halted ? budget - cycles : 0;
+        cycles += execute_instruction<Timing>();
     }
+
+    return cycles;
 }
 
-uint16_t& Cpu::get_reg16_ref(int index)
+uint32_t Cpu::execute_cached_instruction()
 {
-    switch (index)
+    if (!current_block || 
+        block_index >= current_block->instructions.size() || 
+        current_block->instructions[block_index].address != PC)
     {
-    case 0:
-        return BC.r16;
-    case 1:
-        return DE.r16;
-    case 2:
-        return HL.r16;
-    case 3:
-        return SP;
-    default:
-        throw std::invalid_argument("Invalid index: " + index);
-        break;
+        current_block = find_block(PC);
+        block_index = 0;
+    }
+
+    // Code outside of ROM/WRAM/HRAM (or cut off by a region boundary) is interpreted
+    if (!current_block || current_block->instructions.empty())
+    {
+        fetch_opcode();
+        opcode_table[IR](*this);
+        return ticks;
     }
+
+    if (block_index == 0 && current_block->bulk.op != BulkOp::None)
+    {
+        if (uint32_t cycles = execute_bulk_loop(*current_block))
+            return cycles;
+    }
+
+    if (jit_enabled && block_index == 0)
+    {
+        // Only enter compiled code if no timer/PPU event can happen before it finishes
+        if (current_block->native && current_block->max_cycles <= cycle_budget)
+            return execute_native_block(*current_block);
+
+        if (!current_block->native && ++current_block->execution_count == JIT_THRESHOLD)
+            compile_block(*current_block);
+    }
+
+    // The handler may invalidate the block it is running from, so nothing
+    // in the block is touched once it has been called.
+    const DecodedInstruction& instruction = current_block->instructions[block_index++];
+
+    IR = instruction.opcode;
+    operand = instruction.operand;
+    PC = instruction.next_address;
+
+    instruction.handler(*this);
+
+    return ticks;
 }
 
-uint32_t Cpu::execute_instruction()
-{    
-    check_interrupts();
+template<bool PREDECODED, typename Timing>
+void Cpu::cb_execute()
+{
+    IR = fetch8<PREDECODED, Timing>();
 
-    if (is_halted) return 1;
+    if constexpr (Timing::PER_ACCESS)
+        accurate_cb_opcode_table[IR](*this);
+    else
+        cb_opcode_table[IR](*this);
+}
 
-    IR = mem.read_byte(PC++);
+/// @note Every branch is resolved at compile time, so each of the 256 instantiations
+/// only contains the code for its own opcode.
+template<uint8_t OPCODE, bool PREDECODED, typename Timing>
+void Cpu::execute_opcode()
+{
+    constexpr int r8_dst = (OPCODE & LD_DST_BITMASK) >> 3;
+    constexpr int r8_src = OPCODE & LD_SRC_BITMASK;
+    constexpr int r16_index = (OPCODE >> 4) & 0x03;
+    constexpr int cc = (OPCODE >> 3) & 0x03;
 
-    ticks = 4;
+    // Branches taken and CB-prefixed opcodes update this
+    ticks = BASE_OPCODES[OPCODE].cycles;
 
-    switch (IR)
-    {
     // NOP
     // 4 T-cycles, 1 byte
-    case 0x00: 
-        break;
+    if constexpr (OPCODE == 0x00) 
+    {}
 
     // LD r16, n16
     // 0b00xx0001 + LSB(nn) + MSB(nn)
     // 12 T-cycles, 3 bytes
-    case 0x01:
-    case 0x11:
-    case 0x21:
-    case 0x31: 
-    {
-        int i = IR >> 4;
-        ld_r16_n16(get_reg16_ref(i));
-
-        ticks = 12;
-        break;
-    }
+    else if constexpr ((OPCODE & 0xCF) == 0x01)
+        reg16<r16_index>() = fetch16<PREDECODED, Timing>();
 
     // LD [r16], A
     // 0b00xx0010
     // 8 T-cycles
-    case 0x02:
-    case 0x12: 
-    {
-        int i = IR >> 4;
-        mem.write_byte(A, get_reg16(i));
+    else if constexpr (OPCODE == 0x02 || OPCODE == 0x12)
+        write8<Timing>(r8[A], reg16<r16_index>());
 
-        ticks = 8;
-        break;
-    } 
-    
     // INC r16
     // 0b00xx0011
     // 8 T-cycles
-    case 0x03:
-    case 0x13:
-    case 0x23:
-    case 0x33:
-    {
-        int i = IR >> 4;
-        uint16_t& reg = get_reg16_ref(i);
-        ++reg;
+    else if constexpr ((OPCODE & 0xCF) == 0x03)
+        ++reg16<r16_index>();
 
-        ticks = 8;
-        break;
+    // INC [HL]
+    // 12 T-cycles
+    else if constexpr (OPCODE == 0x34)
+    {
+        uint8_t byte = read8<Timing>(r16[HL]);
+        inc_r8(byte);
+        write8<Timing>(byte, r16[HL]);
     }
 
     // INC r8
     // 0b00xxx100
     // 4 T-cycles
-    case 0x04:
-    case 0x0C:
-    case 0x14:
-    case 0x1C:
-    case 0x24:
-    case 0x2C:
-    case 0x3C:
-    {
-        int i = IR >> 3;
-        inc_r8(get_reg_ref(i));
-        break;
+    else if constexpr ((OPCODE & 0xC7) == 0x04)
+        inc_r8(reg8<r8_dst>());
+
+    // DEC [HL]
+    // 12 T-cycles
+    else if constexpr (OPCODE == 0x35)
+    {
+        uint8_t byte = read8<Timing>(r16[HL]);
+        dec_r8(byte);
+        write8<Timing>(byte, r16[HL]);
     }
 
     // DEC r8
     // 0b00xxx101
     // 4 T-cycles
-    case 0x05:
-    case 0x0D:
-    case 0x15:
-    case 0x1D:
-    case 0x25:
-    case 0x2D:
-    case 0x3D:
-    {
-        int i = IR >> 3;
-        dec_r8(get_reg_ref(i));
-        break;
+    else if constexpr ((OPCODE & 0xC7) == 0x05)
+        dec_r8(reg8<r8_dst>());
+
+    // LD [HL], n8
+    // 12 T-cycles
+    else if constexpr (OPCODE == 0x36)
+    {
+        uint8_t n8 = fetch8<PREDECODED, Timing>();
+        write8<Timing>(n8, r16[HL]);
     }
 
     // LD r8, n8
     // 0b00xxx110 + nn
     // 8 T-cycles
-    case 0x06:
-    case 0x0E:
-    case 0x16:
-    case 0x1E:
-    case 0x26:
-    case 0x2E:
-    case 0x3E:
-    {
-        int i = IR >> 3;
-        uint8_t& r8 = get_reg_ref(i);
-        r8 = mem.read_byte(PC++);
-
-        ticks = 8;
-        break;
-    }
-    
+    else if constexpr ((OPCODE & 0xC7) == 0x06)
+        reg8<r8_dst>() = fetch8<PREDECODED, Timing>();
+
     // RLCA
     // 0x07
     // 4 T-cycles
-    case 0x07:
-        rlc_r8(A);
+    else if constexpr (OPCODE == 0x07)
+    {
+        rlc_r8(r8[A]);
         set_flag(Flags::Zero, false);
-        break;
+    }
 
     // LD [a16], SP
     // Copy SP & $FF at address n16 and SP >> 8 at address n16 + 1.
     // 0x08 + LSB(nn) + MSB(nn)
     // 20 T-cycles
-    case 0x08:
+    else if constexpr (OPCODE == 0x08)
     {
-        uint16_t n16 = read_next16();
+        uint16_t n16 = fetch16<PREDECODED, Timing>();
 
-        mem.write_byte(SP & 0xFF, n16);
-        mem.write_byte(SP >> 8, n16 + 1);
-
-        ticks = 20;
-        break;
+        write8<Timing>(SP & 0xFF, n16);
+        write8<Timing>(SP >> 8, n16 + 1);
     }
 
     // ADD HL, r16
     // 0b00xx1001
     // 8 T-cycles
-    case 0x09:
-    case 0x19:
-    case 0x29:
-    case 0x39:
-    {
-        int i = IR >> 4;
-        add_hl_r16(get_reg16_ref(i));
-
-        ticks = 8;
-        break;
-    }
+    else if constexpr ((OPCODE & 0xCF) == 0x09)
+        add_hl_r16(reg16<r16_index>());
 
     // LD A, [r16]
     // 0b00xx1010
     // 8 T-cycles
-    case 0x0A:
-    case 0x1A:
-    {
-        int i = IR >> 4;
-        A = mem.read_byte(get_reg16(i));
-
-        ticks = 8;
-        break;
-    }
+    else if constexpr (OPCODE == 0x0A || OPCODE == 0x1A)
+        r8[A] = read8<Timing>(reg16<r16_index>());
 
     // DEC r16
     // 0b00xx1011
     // 8 T-cycles
-    case 0x0B:
-    case 0x1B:
-    case 0x2B:
-    case 0x3B:
-    {
-        int i = IR >> 4;
-        uint16_t& reg = get_reg16_ref(i);
-        --reg;
-
-        ticks = 8;
-        break;
-    }
+    else if constexpr ((OPCODE & 0xCF) == 0x0B)
+        --reg16<r16_index>();
 
     // RRCA
     // 4 T-cycles
-    case 0x0F:
-        rrc_r8(A);
+    else if constexpr (OPCODE == 0x0F)
+    {
+        rrc_r8(r8[A]);
         set_flag(Flags::Zero, false);
-        break;
+    }
     
     // STOP n8
     // 0x10 + n8
     // 4 T-cycles
-    case 0x10:
+    else if constexpr (OPCODE == 0x10)
+    {
         // is_halted = true;
-        break;
+    }
 
-    
     // RLA
     // 4 T-cycles
-    case 0x17:
-        rl_r8(A);
+    else if constexpr (OPCODE == 0x17)
+    {
+        rl_r8(r8[A]);
         set_flag(Flags::Zero, false);
-        break;
+    }
 
     // JR e8
     // 12 T-cycles
-    case 0x18:
+    else if constexpr (OPCODE == 0x18)
     {
-        uint8_t byte = mem.read_byte(PC++);
-        PC += static_cast<int8_t>(byte);
+        int8_t offset = static_cast<int8_t>(fetch8<PREDECODED, Timing>());
+        PC += offset;
 
-        ticks = 12;
-        break;
+        if (offset < 0)
+            ticks += skip_idle_loop(PC - offset - 2);
     }
 
     // RRA
     // 4 T-cycles
-    case 0x1F:
-        rr_r8(A);
+    else if constexpr (OPCODE == 0x1F)
+    {
+        rr_r8(r8[A]);
         set_flag(Flags::Zero, false);
-        break;
+    }
     
     // JR cc, e8
     // 0b001xx000
     // True/false -> 12/8 T-cycles
-    case 0x20:
-    case 0x30:
-    case 0x28:
-    case 0x38:
+    else if constexpr ((OPCODE & 0xE7) == 0x20)
     {
-        ticks = 8;
-
-        uint8_t cc = (IR >> 3) & 0x03;
-        uint8_t byte = mem.read_byte(PC++);
-        if (check_condition_code(cc))
+        int8_t offset = static_cast<int8_t>(fetch8<PREDECODED, Timing>());
+        if (condition<cc>())
         {
-            PC += static_cast<int8_t>(byte);
-            ticks += 4;
+            PC += offset;
+            ticks = BASE_OPCODES[OPCODE].cycles_taken;
+
+            if (offset < 0)
+                ticks += skip_idle_loop(PC - offset - 2);
         }
-        break;
+        else if (offset < 0)
+            loop_snapshot.key = UINT32_MAX; // Left the loop
     }
 
     // LD [HL+], A
     // 8 T-cycles
-    case 0x22:
-        mem.write_byte(A, HL.r16);
-        ++HL.r16;
-
-        ticks = 8;
-        break;
+    else if constexpr (OPCODE == 0x22)
+    {
+        write8<Timing>(r8[A], r16[HL]);
+        ++r16[HL];
+    }
 
     // DAA
     // 4 T-cycles
-    case 0x27:
+    else if constexpr (OPCODE == 0x27)
         daa();
-        break;
 
     // LD A, [HL+]
     // 8 T-cycles
-    case 0x2A:
-        A = mem.read_byte(HL.r16);
-        ++HL.r16;
-
-        ticks = 8;
-        break;
+    else if constexpr (OPCODE == 0x2A)
+    {
+        r8[A] = read8<Timing>(r16[HL]);
+        ++r16[HL];
+    }
     
     // CPL
     // 4 T-cycles
-    case 0x2F:
-        A = ~A;
+    else if constexpr (OPCODE == 0x2F)
+    {
+        r8[A] = ~r8[A];
 
         set_flag(Flags::Subtraction, true);
         set_flag(Flags::HalfCarry, true);
-        break;
+    }
     
     // LD [HL-], A
     // 8 T-cycles
-    case 0x32:
-        mem.write_byte(A, HL.r16);
-        --HL.r16;
-
-        ticks = 8;
-        break;
-    
-    // INC [HL]
-    // 12 T-cycles
-    case 0x34:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            inc_r8(byte);
-            mem.write_byte(byte, HL.r16);
-
-            ticks = 12;
-        }
-        break;
-    
-    // DEC [HL]
-    // 12 T-cycles
-    case 0x35:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            dec_r8(byte);
-            mem.write_byte(byte, HL.r16);
-
-            ticks = 12;
-        }
-        break;
-
-    // LD [HL], n8
-    // 12 T-cycles
-    case 0x36:
+    else if constexpr (OPCODE == 0x32)
     {
-        uint8_t n8 = mem.read_byte(PC++);
-        mem.write_byte(n8, HL.r16);
-
-        ticks = 12;
-        break;
+        write8<Timing>(r8[A], r16[HL]);
+        --r16[HL];
     }
 
     // SCF
     // 4 T-cycles
-    case 0x37:
+    else if constexpr (OPCODE == 0x37)
+    {
         set_flag(Flags::HalfCarry, false);
         set_flag(Flags::Subtraction, false);
         set_flag(Flags::Carry, true);
-        break;
-    
+    }
     
     // LD A, [HL-]
     // 8 T-cycles
-    case 0x3A:
-        A = mem.read_byte(HL.r16);
-        --HL.r16;
-
-        ticks = 8;
-        break;
+    else if constexpr (OPCODE == 0x3A)
+    {
+        r8[A] = read8<Timing>(r16[HL]);
+        --r16[HL];
+    }
     
     // CCF
     // 4 T-cycles
-    case 0x3F:
+    else if constexpr (OPCODE == 0x3F)
+    {
         set_flag(Flags::Subtraction, false);
         set_flag(Flags::HalfCarry, false);
         set_flag(Flags::Carry, !check_flag(Flags::Carry)); 
-        break;
-    
-    // LD B, r8
-    // 0b01xxxyyy - xxx = src, yyy = dst
-    // 4 T-cycles
-    case 0x40:
-    case 0x41:
-    case 0x42:
-    case 0x43:
-    case 0x44:
-    case 0x45:
-    case 0x47:
-        BC.high = get_reg(IR & LD_SRC_BITMASK);
-        break;
+    }
 
-    // LD C, r8
+    // HALT
     // 4 T-cycles
-    case 0x48:    
-    case 0x49:
-    case 0x4A:
-    case 0x4B:
-    case 0x4C:
-    case 0x4D:
-    case 0x4F:
-        BC.low = get_reg(IR & LD_SRC_BITMASK);
-        break;
+    else if constexpr (OPCODE == 0x76)
+        is_halted = true;
 
-    // LD D, r8
-    // 4 T-cycles
-    case 0x50:
-    case 0x51:
-    case 0x52:
-    case 0x53:
-    case 0x54:
-    case 0x55:
-    case 0x57:
-        DE.high = get_reg(IR & LD_SRC_BITMASK);
-        break;
-    
-    // LD E, r8
-    // 4 T-cycles
-    case 0x58:
-    case 0x59:
-    case 0x5A:
-    case 0x5B:
-    case 0x5C:
-    case 0x5D:
-    case 0x5F:
-        DE.low = get_reg(IR & LD_SRC_BITMASK);
-        break;
+    // LD r8, [HL]
+    // 0b01xxx110
+    // 8 T-cycles
+    else if constexpr ((OPCODE & 0xC7) == 0x46)
+        reg8<r8_dst>() = read8<Timing>(r16[HL]);
 
-    // LD H, r8
-    // 4 T-cycles
-    case 0x60:
-    case 0x61:
-    case 0x62:
-    case 0x63:
-    case 0x64:
-    case 0x65:
-    case 0x67:
-        HL.high = get_reg(IR & LD_SRC_BITMASK);
-        break;
+    // LD [HL], r8
+    // 0b01110xxx
+    // 8 T-cycles
+    else if constexpr ((OPCODE & 0xF8) == 0x70)
+        write8<Timing>(reg8<r8_src>(), r16[HL]);
 
-    // LD L, r8
+    // LD r8, r8
+    // 0b01xxxyyy - xxx = dst, yyy = src
     // 4 T-cycles
-    case 0x68:
-    case 0x69:
-    case 0x6A:
-    case 0x6B:
-    case 0x6C:
-    case 0x6D:
-    case 0x6F:
-        HL.low = get_reg(IR & LD_SRC_BITMASK);
-        break;
+    else if constexpr ((OPCODE & 0xC0) == 0x40)
+        reg8<r8_dst>() = reg8<r8_src>();
 
-    // LD [HL], r8
-    // 8 T-cycles
-    case 0x70:
-    case 0x71:
-    case 0x72:
-    case 0x73:
-    case 0x74:
-    case 0x75:
-    case 0x77:
-        mem.write_byte(get_reg(IR & LD_SRC_BITMASK), HL.r16);
-
-        ticks = 8;
-        break;
-    
-    // LD r8, [HL]
-    // 0b01xxx110
+    // ADC A, [HL]
     // 8 T-cycles
-    case 0x46:
-    case 0x4E:
-    case 0x56:
-    case 0x5E:
-    case 0x66:
-    case 0x6E:
-    case 0x7E:
-    {
-        int i = (IR & LD_DST_BITMASK) >> 3;
-        uint8_t& reg = get_reg_ref(i);
-        reg = mem.read_byte(HL.r16);
-
-        ticks = 8;
-        break;
+    else if constexpr (OPCODE == 0x8E)
+    {
+        uint8_t byte = read8<Timing>(r16[HL]);
+        adc_a(byte);
+        write8<Timing>(byte, r16[HL]);
     }
-    
-    // HALT
-    // 4 T-cycles
-    case 0x76:
-        is_halted = true;
-        break;
 
-    // LD A, r8
-    // 4 T-cycles
-    case 0x78:
-    case 0x79:
-    case 0x7A:
-    case 0x7B:
-    case 0x7C:
-    case 0x7D:
-    case 0x7F:
-        AF.high = get_reg(IR & LD_SRC_BITMASK);
-        break;
+    // ADD/SUB/SBC/AND/XOR/OR/CP A, [HL]
+    // 0b10xxx110
+    // 8 T-cycles
+    else if constexpr ((OPCODE & 0xC7) == 0x86)
+        alu_a<r8_dst>(read8<Timing>(r16[HL]));
 
-    // ADD A, r8
-    // 0b10000xxx
+    // ADD/ADC/SUB/SBC/AND/XOR/OR/CP A, r8
+    // 0b10xxxyyy - xxx = operation, yyy = register
     // 4 T-cycles
-    case 0x80:
-    case 0x81:
-    case 0x82:
-    case 0x83:
-    case 0x84:
-    case 0x85:
-    case 0x87:
-    {
-        int i = IR & ARITHMETIC_OP_BITMASK;
-        add_a(get_reg(i));
-        break;
+    else if constexpr ((OPCODE & 0xC0) == 0x80)
+        alu_a<r8_dst>(reg8<r8_src>());
+
+    // RET CC
+    // 0b110xx000
+    // 1 byte
+    // True/False -> 20/8 T-cycles
+    else if constexpr ((OPCODE & 0xE7) == 0xC0)
+    {
+        next_m_cycle<Timing>(); // Condition check
+
+        if (condition<cc>())
+        {
+            pop_r16<Timing>(PC);
+            profile_return();
+            ticks = BASE_OPCODES[OPCODE].cycles_taken;
+        }
     }
 
-    // ADD A, [HL]
-    // 8 T-cycles  
-    case 0x86:
-        add_a(mem.read_byte(HL.r16));
+    // POP AF
+    // 12 T-cycles
+    else if constexpr (OPCODE == 0xF1)
+    {
+        materialize_flags();
+        pop_r16<Timing>(r16[AF]);
+        r8[F] &= HIGH_NIBBLE_MASK;
+    }
 
-        ticks = 8;
-        break;
+    // POP r16
+    // 12 T-cycles
+    // 0b11xx0001
+    else if constexpr ((OPCODE & 0xCF) == 0xC1)
+        pop_r16<Timing>(reg16<r16_index>());
 
-    // ADC A, r8
-    // 0b10001xxx
-    // 4 T-cycles
-    case 0x88:
-    case 0x89:
-    case 0x8A:
-    case 0x8B:
-    case 0x8C:
-    case 0x8D:
-    case 0x8F:
-    {
-        int i = IR & ARITHMETIC_OP_BITMASK;
-        adc_a(get_reg(i));
-        break;
+    // JP CC a16
+    // 0b110xx010
+    // True/False -> 16/12 T-Cycles
+    else if constexpr ((OPCODE & 0xE7) == 0xC2)
+    {
+        uint16_t addr = fetch16<PREDECODED, Timing>();
+        uint16_t branch_address = PC - 3;
+        if (condition<cc>())
+        {
+            PC = addr;
+            ticks = BASE_OPCODES[OPCODE].cycles_taken;
+
+            if (addr <= branch_address)
+                ticks += skip_idle_loop(branch_address);
+        }
+        else if (addr <= branch_address)
+            loop_snapshot.key = UINT32_MAX; // Left the loop
     }
+    
+    // JP a16
+    // 16 T-cycles
+    else if constexpr (OPCODE == 0xC3)
+    {
+        uint16_t addr = fetch16<PREDECODED, Timing>();
+        uint16_t branch_address = PC - 3;
+        PC = addr;
 
-    // ADC A, HL
-    // 8 T-cycles
-    case 0x8E:
+        if (addr <= branch_address)
+            ticks += skip_idle_loop(branch_address);
+    }
+
+    // CALL CC a16
+    // True/False -> 24/12 T-Cycles
+    // 3 bytes
+    // 0b110xx100 + LSB + MSB
+    else if constexpr ((OPCODE & 0xE7) == 0xC4)
+    {
+        uint16_t imm16 = fetch16<PREDECODED, Timing>();
+        if (condition<cc>())
         {
-            uint8_t byte = mem.read_byte(HL.r16);
-            adc_a(byte);
-            mem.write_byte(byte, HL.r16);
+            profile_call(imm16);
+            call_n16<Timing>(imm16);
 
-            ticks = 8;
+            ticks = BASE_OPCODES[OPCODE].cycles_taken;
         }
-        break;
+    }
 
-    // SUB A, r8
-    // 0b10010xxx
-    // 4 T-cycles
-    case 0x90:
-    case 0x91:
-    case 0x92:
-    case 0x93:
-    case 0x94:
-    case 0x95:
-    case 0x97:
-    {
-        int i = IR & ARITHMETIC_OP_BITMASK;
-        sub_a(get_reg(i));
-        break;
+    // PUSH AF
+    // 16 T-Cycles
+    else if constexpr (OPCODE == 0xF5)
+    {
+        materialize_flags();
+        push_r16<Timing>(r16[AF]);
     }
 
-    // SUB A, HL
+    // PUSH r16
+    // 16 T-Cycles
+    // 1 byte
+    // 0b11xx0101
+    else if constexpr ((OPCODE & 0xCF) == 0xC5)
+        push_r16<Timing>(reg16<r16_index>());
+
+    // ADD/ADC/SUB/SBC/AND/XOR/OR/CP A, n8
+    // 0b11xxx110 + n8
     // 8 T-cycles
-    case 0x96:
-        sub_a(mem.read_byte(HL.r16));
+    // 2 bytes
+    else if constexpr ((OPCODE & 0xC7) == 0xC6)
+        alu_a<r8_dst>(fetch8<PREDECODED, Timing>());
 
-        ticks = 8;
-        break;
+    // RST vec
+    // 16 T-cycles
+    // 1 byte
+    else if constexpr ((OPCODE & 0xC7) == 0xC7)
+    {
+        profile_call(static_cast<uint16_t>(OPCODE - 0xC7));
+        call_n16<Timing>(static_cast<uint16_t>(OPCODE - 0xC7));
+    }
 
-    // SBC A, r8
-    // 0b10011xxx
-    // 4 T-cycles
-    case 0x98:
-    case 0x99:
-    case 0x9A:
-    case 0x9B:
-    case 0x9C:
-    case 0x9D:
-    case 0x9F:
-    {
-        int i = IR & ARITHMETIC_OP_BITMASK;
-        sbc_a(get_reg(i));
-        break;
+    // RET
+    // 16 T-cycles
+    else if constexpr (OPCODE == 0xC9)
+    {
+        pop_r16<Timing>(PC);
+        profile_return();
+    }
+    
+    // CB-Prefixed Opocodes
+    else if constexpr (OPCODE == 0xCB)
+        cb_execute<PREDECODED, Timing>();
+
+    // CALL a16
+    // 24 T-Cycles
+    // 3 bytes
+    else if constexpr (OPCODE == 0xCD)
+    {
+        uint16_t imm16 = fetch16<PREDECODED, Timing>();
+        profile_call(imm16);
+        call_n16<Timing>(imm16);
+    }
+
+    // RETI
+    // 16 T-Cycles
+    // 1 byte
+    else if constexpr (OPCODE == 0xD9)
+    {
+        pop_r16<Timing>(PC);
+        profile_return();
+        IME = true;
+    }
+
+    // LDH [a8], A
+    // 12 T-cycles
+    // 2 bytes
+    else if constexpr (OPCODE == 0xE0)
+    {
+        uint8_t imm8 = fetch8<PREDECODED, Timing>();
+        write8<Timing>(r8[A], IO_REGISTERS_START + imm8);
     }
 
-    // SBC A, HL
+    // LDH [C], A
     // 8 T-cycles
-    case 0x9E:
-        sbc_a(mem.read_byte(HL.r16));
+    // 1 byte
+    else if constexpr (OPCODE == 0xE2)
+        write8<Timing>(r8[A], IO_REGISTERS_START + r8[C]);
 
-        ticks = 8;
-        break;
+    // ADD SP, e8
+    // 16 T-cycles
+    // 2 bytes
+    else if constexpr (OPCODE == 0xE8)
+    {
+        int8_t imm8 = static_cast<int8_t>(fetch8<PREDECODED, Timing>());
+        
+        set_flag(Flags::Carry, check_carry(SP, imm8));
+        set_flag(Flags::HalfCarry, check_half_carry(SP, imm8));
+
+        SP += imm8;
+
+        set_flag(Flags::Zero, false);
+        set_flag(Flags::Subtraction, false);
+    }
 
-    // AND A, r8
-    // 0b10100xxx
+    // JP HL
     // 4 T-cycles
-    case 0xA0:
-    case 0xA1:
-    case 0xA2:
-    case 0xA3:
-    case 0xA4:
-    case 0xA5:
-    case 0xA7:
-    {
-        int i = IR & ARITHMETIC_OP_BITMASK;
-        and_a(get_reg(i));
-        break;
+    else if constexpr (OPCODE == 0xE9)
+        PC = r16[HL];
+
+    // LD [a16], A
+    // 16 T-cycles
+    // 3 bytes
+    else if constexpr (OPCODE == 0xEA)
+    {
+        uint16_t imm16 = fetch16<PREDECODED, Timing>();
+        write8<Timing>(r8[A], imm16);
     }
 
-    // AND A, HL
-    // 8 T-cycles
-    case 0xA6:
-        and_a(mem.read_byte(HL.r16));
+    // LDH A, [a8]
+    // 12 T-cycles
+    // 2 bytes
+    else if constexpr (OPCODE == 0xF0)
+    {
+        uint8_t imm8 = fetch8<PREDECODED, Timing>();
+        r8[A] = read8<Timing>(IO_REGISTERS_START + imm8);
+    }
 
-        ticks = 8;
-        break;
+    // LDH A, [C]
+    // 8 T-cycles
+    // 1 byte
+    else if constexpr (OPCODE == 0xF2)
+        r8[A] = read8<Timing>(IO_REGISTERS_START + r8[C]);
 
-    // XOR A, r8
-    // 0b10101xxx
+    // DI
     // 4 T-cycles
-    case 0xA8:
-    case 0xA9:
-    case 0xAA:
-    case 0xAB:
-    case 0xAC:
-    case 0xAD:
-    case 0xAF:
-    {
-        int i = IR & ARITHMETIC_OP_BITMASK;
-        xor_a(get_reg(i));
-        break;
+    else if constexpr (OPCODE == 0xF3)
+        IME = false;
+
+    // LD HL, SP + e8
+    // 12 T-cycles
+    // 2 bytes
+    else if constexpr (OPCODE == 0xF8)
+    {
+        int8_t imm8 = static_cast<int8_t>(fetch8<PREDECODED, Timing>());
+
+        set_flag(Flags::Carry, check_carry(SP, imm8)); 
+        set_flag(Flags::HalfCarry, check_half_carry(SP, imm8)); 
+
+        r16[HL] = SP + imm8;
+
+        set_flag(Flags::Zero, false);
+        set_flag(Flags::Subtraction, false);
     }
 
-    // XOR A, HL
+    // LD SP, HL
     // 8 T-cycles
-    case 0xAE:
-        xor_a(mem.read_byte(HL.r16));
+    // 1 bytes
+    else if constexpr (OPCODE == 0xF9)
+        SP = r16[HL];
 
-        ticks = 8;
-        break;
+    // LD A, [a16]
+    // 16 T-cycles
+    // 3 bytes
+    else if constexpr (OPCODE == 0xFA)
+    {
+        uint16_t imm16 = fetch16<PREDECODED, Timing>();
+        r8[A] = read8<Timing>(imm16);
+    }
 
-    // OR A, r8
-    // 0b10110xxx
+    // EI
+    // Note: The effect of ei is delayed by one instruction. 
+    // This means that ei followed immediately by di does not 
+    // allow any interrupts between them.
+    // TODO: Implement the above
     // 4 T-cycles
-    case 0xB0:
-    case 0xB1:
-    case 0xB2:
-    case 0xB3:
-    case 0xB4:
-    case 0xB5:
-    case 0xB7:
-    {
-        int i = IR & ARITHMETIC_OP_BITMASK;
-        or_a(get_reg(i));
-        break;
+    else if constexpr (OPCODE == 0xFB)
+        IME = true;
+
+    // 0xD3, 0xDB, 0xDD, 0xE3, 0xE4, 0xEB, 0xEC, 0xED, 0xF4, 0xFC, 0xFD
+    else
+        invalid_opcode();
+}
+
+template<uint8_t OPCODE, typename Timing>
+void Cpu::execute_cb_opcode()
+{
+    constexpr uint8_t u3 = (OPCODE & CB_U3_BITMASK) >> 3;
+    constexpr int op = OPCODE & CB_OP_BITMASK;
+    constexpr int group = OPCODE >> 6;
+
+    // Includes the prefix
+    ticks = CB_OPCODES[OPCODE].cycles;
+
+    // RLC/RRC/RL/RR/SLA/SRA/SWAP/SRL [HL]
+    // 0b00yyy110
+    // 16 T-cycles
+    if constexpr (group == 0 && op == 6)
+    {
+        uint8_t byte = read8<Timing>(r16[HL]);
+        shift_r8<u3>(byte);
+        write8<Timing>(byte, r16[HL]);
     }
 
-    // OR A, HL
+    // RLC/RRC/RL/RR/SLA/SRA/SWAP/SRL r8
+    // 0b00yyyxxx
     // 8 T-cycles
-    case 0xB6:
-        or_a(mem.read_byte(HL.r16));
+    else if constexpr (group == 0)
+        shift_r8<u3>(reg8<op>());
 
-        ticks = 8;
-        break;
+    // BIT u3, [HL]
+    // 12 T-cycles
+    else if constexpr (group == 1 && op == 6)
+    {
+        uint8_t byte = read8<Timing>(r16[HL]);
+        bit_u3_r8(byte, u3);
+        write8<Timing>(byte, r16[HL]);
+    }
 
-    // CP A, r8
-    // 0b10111xxx
-    // 4 T-cycles
-    case 0xB8:
-    case 0xB9:
-    case 0xBA:
-    case 0xBB:
-    case 0xBC:
-    case 0xBD:
-    case 0xBF:
-    {
-        int i = IR & ARITHMETIC_OP_BITMASK;
-        cp_a(get_reg(i));
-        break;
+    // BIT u3, r8
+    // 01yyyxxx
+    // 8 T-cycles
+    else if constexpr (group == 1)
+        bit_u3_r8(reg8<op>(), u3);
+
+    // RES u3, [HL]
+    // 16 T-cycles
+    else if constexpr (group == 2 && op == 6)
+    {
+        uint8_t byte = read8<Timing>(r16[HL]);
+        res_u3_r8(byte, u3); 
+        write8<Timing>(byte, r16[HL]);
     }
 
-    // CP A, HL
+    // RES u3, r8
+    // 10yyyxxx
     // 8 T-cycles
-    case 0xBE:
-        cp_a(mem.read_byte(HL.r16));
+    else if constexpr (group == 2)
+        res_u3_r8(reg8<op>(), u3);
 
-        ticks = 8;
-        break;
+    // SET u3, [HL]
+    // 16 T-cycles
+    else if constexpr (op == 6)
+    {
+        uint8_t byte = read8<Timing>(r16[HL]);
+        set_u3_r8(byte, u3); 
+        write8<Timing>(byte, r16[HL]);
+    }
 
-    // 0b110xx000
-    // RET CC
-    // 1 byte
-    // True/False -> 20/8 T-cycles
-    case 0xC0:
-    case 0xC8:
-    case 0xD0:
-    case 0xD8:
-    {  
-        ticks = 8;
-
-        uint8_t cc = (IR >> 3) & 0x03;
-        if (check_condition_code(cc))
-        {
-            pop_r16(PC);
-            ticks += 12;
-        }
-        break;
+    // SET u3, r8
+    // 11yyyxxx
+    // 8 T-cycles
+    else
+        set_u3_r8(reg8<op>(), u3);
+}
+
+const std::array<Cpu::OpcodeHandler, 256> Cpu::opcode_table = 
+    Cpu::make_opcode_table<false, FastTiming>(std::make_index_sequence<256>{});
+
+const std::array<Cpu::OpcodeHandler, 256> Cpu::predecoded_opcode_table = 
+    Cpu::make_opcode_table<true, FastTiming>(std::make_index_sequence<256>{});
+
+const std::array<Cpu::OpcodeHandler, 256> Cpu::cb_opcode_table = 
+    Cpu::make_cb_opcode_table<FastTiming>(std::make_index_sequence<256>{});
+
+const std::array<Cpu::OpcodeHandler, 256> Cpu::accurate_opcode_table = 
+    Cpu::make_opcode_table<false, AccurateTiming>(std::make_index_sequence<256>{});
+
+const std::array<Cpu::OpcodeHandler, 256> Cpu::accurate_cb_opcode_table = 
+    Cpu::make_cb_opcode_table<AccurateTiming>(std::make_index_sequence<256>{});
+
+template uint32_t Cpu::execute_instruction<FastTiming>();
+template uint32_t Cpu::execute_instruction<AccurateTiming>();
+template uint32_t Cpu::execute_cycles<FastTiming>(uint32_t budget);
+template uint32_t Cpu::execute_cycles<AccurateTiming>(uint32_t budget);
+template uint32_t Cpu::execute_cycles_checked<FastTiming>(uint32_t budget, const std::function<bool()>& should_stop);
+template uint32_t Cpu::execute_cycles_checked<AccurateTiming>(uint32_t budget, const std::function<bool()>& should_stop);
+
+/* Block Cache */
+constexpr size_t MAX_BLOCK_INSTRUCTIONS = 32;
+
+/// @returns true if the instruction may change PC non-sequentially, halts the CPU or is invalid.
+constexpr bool ends_block(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x10: case 0x76: // STOP, HALT
+    case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+    case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xC3: case 0xE9: // JP
+    case 0xC4: case 0xCC: case 0xD4: case 0xDC: case 0xCD: // CALL
+    case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xC9: case 0xD9: // RET, RETI
+    case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+    case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+        return true;
+    default:
+        return false;
     }
+}
 
-    // POP r16
-    // 12 T-cycles
-    // 0b11xx0001
-    case 0xC1:
-    case 0xD1:
-    case 0xE1:
-        pop_r16(get_reg16_ref((IR >> 4) & 0x03));
+void Cpu::set_block_cache_enabled(bool enabled)
+{
+    block_cache_enabled = enabled;
 
-        ticks = 12;
-        break;
-    // POP AF
-    case 0xF1:
-        pop_r16(AF.r16);
-        F &= HIGH_NIBBLE_MASK;
+    if (!enabled)
+        invalidate_block_cache();
+}
 
-        ticks = 12;
-        break;
+void Cpu::invalidate_block_cache()
+{
+    // Compiled code points into the blocks being dropped
+    if (jit) jit->reset();
 
-    // JP CC a16
-    // 0b110xx010
-    // True/False -> 16/12 T-Cycles
-    case 0xC2:
-    case 0xCA:
-    case 0xD2:
-    case 0xDA:
+    rom_blocks.clear();
+
+    for (auto& [address, block] : ram_blocks)
+        unwatch_block_pages(*block);
+    ram_blocks.clear();
+
+    current_block = nullptr;
+
+    idle_loops.fill(IdleLoop{});
+    loop_snapshot = LoopSnapshot{};
+}
+
+Cpu::CodeBlock* Cpu::find_block(uint16_t address)
+{
+    // ROM blocks are keyed by (bank, address) so bank switches never need an invalidation
+    if (address <= BANK_N_END)
     {
-        ticks = 12;
+        uint32_t key = (static_cast<uint32_t>(mem.get_rom_bank(address)) << 16) | address;
 
-        uint8_t cc = (IR >> 3) & 0x03;
-        uint16_t addr = read_next16();
-        if (check_condition_code(cc))
-        {
-            PC = addr;
-            ticks += 4;
-        }
-        break;
+        auto it = rom_blocks.find(key);
+        if (it != rom_blocks.end())
+            return it->second.get();
+
+        uint16_t region_end = (address <= BANK_ZERO_END) ? BANK_ZERO_END : BANK_N_END;
+        return (rom_blocks[key] = decode_block(address, region_end)).get();
     }
-    
-    // JP a16
-    // 16 T-cycles
-    case 0xC3:
-        PC = read_next16();
-        
-        ticks = 16;
-        break;
 
-    // CALL CC a16
-    // True/False -> 24/12 T-Cycles
-    // 3 bytes
-    // 0b110xx100 + LSB + MSB
-    case 0xC4:
-    case 0xCC:
-    case 0xD4:
-    case 0xDC:
+    bool in_work_ram = (address >= WORK_RAM_START && address <= WORK_RAM_END);
+    bool in_high_ram = (address >= HIGH_RAM_START && address <= HIGH_RAM_END);
+    if (!in_work_ram && !in_high_ram)
+        return nullptr;
+
+    auto it = ram_blocks.find(address);
+    if (it != ram_blocks.end())
+        return it->second.get();
+
+    auto block = decode_block(address, in_work_ram ? WORK_RAM_END : HIGH_RAM_END);
+    if (!block->instructions.empty())
+        watch_block_pages(*block);
+
+    return (ram_blocks[address] = std::move(block)).get();
+}
+
+std::unique_ptr<Cpu::CodeBlock> Cpu::decode_block(uint16_t start, uint16_t region_end)
+{
+    auto block = std::make_unique<CodeBlock>();
+    block->start = start;
+
+    uint32_t address = start;
+    while (block->instructions.size() < MAX_BLOCK_INSTRUCTIONS)
     {
-        ticks = 12;
+        // Decoding is no CPU access: it must not be counted, trapped or blocked by OAM DMA
+        uint8_t opcode = mem.peek_byte(address);
+        int length = BASE_OPCODES[opcode].length;
 
-        uint8_t cc = (IR >> 3) & 0x03;
-        uint16_t imm16 = read_next16();
+        // Never let a block straddle two memory regions/banks
+        if (address + length - 1 > region_end) break;
 
-        if (check_condition_code(cc))
-        {
-            call_n16(imm16);
+        DecodedInstruction instruction{};
+        instruction.handler = predecoded_opcode_table[opcode];
+        instruction.address = static_cast<uint16_t>(address);
+        instruction.next_address = static_cast<uint16_t>(address + length);
+        instruction.opcode = opcode;
 
-            ticks += 12;
-        }
-        break;
+        if (length == 2)
+            instruction.operand = mem.peek_byte(address + 1);
+        else if (length == 3)
+            instruction.operand = (mem.peek_byte(address + 2) << 8) | mem.peek_byte(address + 1);
+
+        block->instructions.push_back(instruction);
+        block->max_cycles += (opcode == 0xCB) ? CB_OPCODES[instruction.operand].cycles : BASE_OPCODES[opcode].cycles_taken;
+        address += length;
+
+        if (ends_block(opcode)) break;
     }
 
-    // PUSH r16
-    // 16 T-Cycles
-    // 1 byte
-    // 0b11xx0101
-    case 0xC5:
-    case 0xD5:
-    case 0xE5:
-        push_r16(get_reg16((IR >> 4) & 0x03));
+    block->end = address;
+#if !GB_PROFILE_OPCODES
+    // A bulk loop runs all of its iterations at once, without reaching a handler to count them
+    block->bulk = detect_bulk_loop(*block);
+#endif
 
-        ticks = 16;
-        break;
-    // POP AF
-    case 0xF5:
-        push_r16(AF.r16);
+    return block;
+}
 
-        ticks = 16;
-        break;
+Cpu::BulkLoop Cpu::detect_bulk_loop(const CodeBlock& block)
+{
+    const std::vector<DecodedInstruction>& code = block.instructions;
 
-    // ADD A, n8
-    // 8 T-cycles
-    case 0xC6:
-        add_a(mem.read_byte(PC++));
+    // Has to be a short loop that ends in JR NZ back to its first instruction
+    if (code.size() < 3 || code.size() > 7) return {};
 
-        ticks = 8;
-        break;
-    // SUB A, n8
-    case 0xD6:
-        sub_a(mem.read_byte(PC++));
+    const DecodedInstruction& branch = code.back();
+    if (branch.opcode != 0x20 ||
+        static_cast<uint16_t>(branch.next_address + static_cast<int8_t>(branch.operand)) != block.start)
+        return {};
 
-        ticks = 8;
-        break;
-    // AND A, n8
-    case 0xE6:
-        and_a(mem.read_byte(PC++));
+    std::array<uint8_t, 6> ops{};
+    size_t count = code.size() - 1;
+    for (size_t i = 0; i < count; ++i)
+        ops[i] = code[i].opcode;
 
-        ticks = 8;
-        break;
-    // OR A, n8
-    case 0xF6:
-        or_a(mem.read_byte(PC++));
+    BulkLoop loop;
 
-        ticks = 8;
-        break;
+    // DEC B, DEC C or DEC BC; LD A, B; OR C (LD A, C; OR B) must end the body
+    auto match_counter = [&](size_t at)
+    {
+        if (count - at == 1 && (ops[at] == 0x05 || ops[at] == 0x0D))
+        {
+            loop.counter = (ops[at] == 0x05) ? 0 : 1;
+            return true;
+        }
 
-    // RST vec
-    // 16 T-cycles
-    // 1 byte
-    case 0xC7:
-    case 0xCF:
-    case 0xD7:
-    case 0xDF:
-    case 0xE7:
-    case 0xEF:
-    case 0xF7:
-    case 0xFF:
-        call_n16(static_cast<uint16_t>(IR - 0xC7));
-
-        ticks = 16;
-        break;
+        if (count - at == 3 && ops[at] == 0x0B &&
+            ((ops[at + 1] == 0x78 && ops[at + 2] == 0xB1) || (ops[at + 1] == 0x79 && ops[at + 2] == 0xB0)))
+        {
+            loop.counter = -1;
+            return true;
+        }
 
-    // RET
-    // 16 T-cycles
-    case 0xC9:
-        pop_r16(PC);
+        return false;
+    };
 
-        ticks = 16;
-        break;
-    
-    // CB-Prefixed Opocodes
-    case 0xCB:
-        cb_execute();
+    // LD A, [HL+]; LD [DE], A; INC DE or LD A, [DE]; LD [HL+], A; INC DE
+    if (count >= 4 && ops[2] == 0x13 && ((ops[0] == 0x2A && ops[1] == 0x12) || (ops[0] == 0x1A && ops[1] == 0x22)))
+    {
+        if (!match_counter(3)) return {};
 
-        ticks = 8;
-        break;
+        loop.op = BulkOp::Copy;
+        loop.source_is_hl = (ops[0] == 0x2A);
+        return loop;
+    }
 
-    // CALL a16
-    // 24 T-Cycles
-    // 3 bytes
-    case 0xCD:
+    // Optional LD A, n8/XOR A, then LD [HL+], A or LD [HL-], A
+    size_t store = 0;
+    if (ops[0] == 0x3E || ops[0] == 0xAF)
     {
-        uint16_t imm16 = read_next16();
-        call_n16(imm16);
-        
-        ticks = 24;
-        break;
+        loop.fill_value = (ops[0] == 0x3E) ? code[0].operand : 0;
+        loop.clears_a = (ops[0] == 0xAF);
+        store = 1;
     }
 
-    // ADC A, n8
-    // 8 T-cycles
-    // 2 bytes
-    case 0xCE:
-        adc_a(mem.read_byte(PC++));
+    if (ops[store] == 0x22 || ops[store] == 0x32)
+    {
+        if (!match_counter(store + 1)) return {};
 
-        ticks = 8;
-        break;
-    // SBC A, n8
-    case 0xDE:
-        sbc_a(mem.read_byte(PC++));
+        // LD A, B clobbers A, so the value has to be reloaded by the loop
+        if (loop.counter < 0 && loop.fill_value < 0) return {};
 
-        ticks = 8;
-        break;
-    // XOR A, n8
-    case 0xEE:
-        xor_a(mem.read_byte(PC++));
+        loop.op = BulkOp::Fill;
+        loop.hl_step = (ops[store] == 0x22) ? 1 : -1;
+        return loop;
+    }
 
-        ticks = 8;
-        break;
-    // CP A, n8
-    case 0xFE:
-        cp_a(mem.read_byte(PC++));
-        
-        ticks = 8;
-        break;
+    return {};
+}
 
-    // RETI
-    // 16 T-Cycles
-    // 1 byte
-    case 0xD9:
-        pop_r16(PC);
-        IME = true;
+/// @returns true if [start, start + length) does not wrap and stays clear of IO registers and IE,
+/// whose accesses have side effects that cannot be batched.
+static bool is_bulk_range(uint16_t start, uint32_t length)
+{
+    uint32_t last = start + length - 1;
 
-        ticks = 16;
-        break;
+    return last < INTERRUPT_ENABLE && (last < UNUSABLE_START || start > IO_REGISTERS_END);
+}
 
-    // LDH [a8], A
-    // 12 T-cycles
-    // 2 bytes
-    case 0xE0:
-    {
-        uint8_t imm8 = mem.read_byte(PC++);
-        mem.write_byte(A, IO_REGISTERS_START + imm8);
+uint32_t Cpu::execute_bulk_loop(const CodeBlock& block)
+{
+    const BulkLoop& loop = block.bulk;
 
-        ticks = 12;
-        break;
-    }
+    uint32_t counter = (loop.counter < 0) ? r16[BC] : r8[r8_slot(loop.counter)];
+    uint32_t remaining = (counter != 0) ? counter : ((loop.counter < 0) ? 0x10000 : 0x100);
 
-    // LDH [C], A
-    // 8 T-cycles
-    // 1 byte
-    case 0xE2:
-        mem.write_byte(A, IO_REGISTERS_START + BC.low);
+    // No event may happen while the loop runs, so only what fits in the budget is batched.
+    // The last iteration does not take the branch, which saves 4 T-cycles.
+    bool exits = (remaining * block.max_cycles - 4 <= cycle_budget);
+    uint32_t iterations = exits ? remaining : cycle_budget / block.max_cycles;
+    if (iterations == 0) return 0;
 
-        ticks = 8;
-        break;
+    auto clear_of_block = [&](uint16_t start)
+    {
+        return start + iterations <= block.start || start >= block.end;
+    };
 
-    // ADD SP, e8
-    // 16 T-cycles
-    // 2 bytes
-    case 0xE8:
+    if (loop.op == BulkOp::Copy)
     {
-        int8_t imm8 = static_cast<int8_t>(mem.read_byte(PC++));
-        
-        set_flag(Flags::Carry, check_carry(SP, imm8));
-        set_flag(Flags::HalfCarry, check_half_carry(SP, imm8));
+        uint16_t source = loop.source_is_hl ? r16[HL] : r16[DE];
+        uint16_t destination = loop.source_is_hl ? r16[DE] : r16[HL];
 
-        SP += imm8;
+        if (!is_bulk_range(source, iterations) || !is_bulk_range(destination, iterations) ||
+            destination < VRAM_START || !clear_of_block(destination))
+            return 0;
 
-        set_flag(Flags::Zero, false);
-        set_flag(Flags::Subtraction, false);
+        mem.copy_block(destination, source, iterations);
 
-        ticks = 16;
-        break;
+        r16[HL] += iterations;
+        r16[DE] += iterations;
     }
+    else
+    {
+        uint16_t first = (loop.hl_step > 0) ? r16[HL] : r16[HL] - (iterations - 1);
 
-    // JP HL
-    // 4 T-cycles
-    case 0xE9:
-        PC = HL.r16;
-        break;
+        if (!is_bulk_range(first, iterations) || first < VRAM_START || !clear_of_block(first))
+            return 0;
 
-    // LD [a16], A
-    // 16 T-cycles
-    // 3 bytes
-    case 0xEA:
-    {
-        uint16_t imm16 = read_next16();
-        mem.write_byte(A, imm16);
+        uint8_t value = (loop.fill_value < 0) ? r8[A] : static_cast<uint8_t>(loop.fill_value);
+        mem.fill_block(first, value, iterations);
 
-        ticks = 16;
-        break;
+        r16[HL] += loop.hl_step * static_cast<int32_t>(iterations);
     }
 
-    // LDH A, [a8]
-    // 12 T-cycles
-    // 2 bytes
-    case 0xF0:
+    // A and the flags are left as the last iteration's instructions set them
+    if (loop.counter < 0)
     {
-        uint8_t imm8 = mem.read_byte(PC++);
-        A = mem.read_byte(IO_REGISTERS_START + imm8);
+        r16[BC] -= iterations;
 
-        ticks = 12;
-        break;
+        r8[A] = r8[B];
+        or_a(r8[C]);
+    }
+    else
+    {
+        if (loop.op == BulkOp::Copy)
+            r8[A] = mem.read_byte((loop.source_is_hl ? r16[HL] : r16[DE]) - 1);
+        else if (loop.clears_a)
+            xor_a(r8[A]);
+        else if (loop.fill_value >= 0)
+            r8[A] = static_cast<uint8_t>(loop.fill_value);
+
+        uint8_t& counter_reg = r8[r8_slot(loop.counter)];
+        counter_reg -= iterations - 1;
+        dec_r8(counter_reg);
     }
 
-    // LDH A, [C]
-    // 8 T-cycles
-    // 1 byte
-    case 0xF2:
-        A = mem.read_byte(IO_REGISTERS_START + BC.low);
+    IR = 0x20; // JR NZ, e8
 
-        ticks = 8;
-        break;
+    if (exits)
+    {
+        PC = static_cast<uint16_t>(block.end);
+        current_block = nullptr;
+    }
 
-    // DI
-    // 4 T-cycles
-    case 0xF3:
-        IME = false;
-        break;
+    return iterations * block.max_cycles - (exits ? 4 : 0);
+}
 
-    // LD HL, SP + e8
-    // 12 T-cycles
-    // 2 bytes
-    case 0xF8:
+void Cpu::watch_block_pages(const CodeBlock& block)
+{
+    for (uint32_t page = block.start >> 8; page <= ((block.end - 1) >> 8); ++page)
     {
-        int8_t imm8 = static_cast<int8_t>(mem.read_byte(PC++));
+        if (code_page_refs[page]++ == 0)
+            mem.watch_code_page(static_cast<uint8_t>(page), true);
+    }
+}
 
-        set_flag(Flags::Carry, check_carry(SP, imm8)); 
-        set_flag(Flags::HalfCarry, check_half_carry(SP, imm8)); 
+void Cpu::unwatch_block_pages(const CodeBlock& block)
+{
+    if (block.instructions.empty()) return;
 
-        HL.r16 = SP + imm8;
+    for (uint32_t page = block.start >> 8; page <= ((block.end - 1) >> 8); ++page)
+    {
+        if (--code_page_refs[page] == 0)
+            mem.watch_code_page(static_cast<uint8_t>(page), false);
+    }
+}
 
-        set_flag(Flags::Zero, false);
-        set_flag(Flags::Subtraction, false);
+void Cpu::on_code_write(uint16_t address)
+{
+    // Writes to the ROM area are MBC register writes, which may remap the running block
+    if (address <= BANK_N_END)
+    {
+        current_block = nullptr;
+        exit_requested = true;
+        return;
+    }
 
-        ticks = 12;
-        break;
+    if ((address >= IO_REGISTERS_START && address <= IO_REGISTERS_END) || address == INTERRUPT_ENABLE)
+    {
+        exit_requested = true;
+        return;
     }
 
-    // LD SP, HL
-    // 8 T-cycles
-    // 1 bytes
-    case 0xF9:
-        SP = HL.r16;
+    for (auto it = ram_blocks.begin(); it != ram_blocks.end(); )
+    {
+        CodeBlock* block = it->second.get();
+        if (address >= block->start && address < block->end)
+        {
+            if (block == current_block)
+                current_block = nullptr;
 
-        ticks = 8;
-        break;
+            unwatch_block_pages(*block);
+            it = ram_blocks.erase(it);
+        }
+        else ++it;
+    }
+}
 
-    // LD A, [a16]
-    // 16 T-cycles
-    // 3 bytes
-    case 0xFA:
+/* JIT */
+void Cpu::set_jit_enabled(bool enabled)
+{
+#if GB_PROFILE_OPCODES
+    // Natively translated instructions never reach a handler, so they could not be counted
+    enabled = false;
+#endif
+
+    if (enabled && !jit)
     {
-        uint16_t imm16 = read_next16();
-        A = mem.read_byte(imm16);
+        jit = std::make_unique<JitCompiler>();
 
-        ticks = 16;
-        break;
+        if (!jit->is_available())
+        {
+            std::cerr << "JIT is not available on this host, using the interpreter\n";
+            jit.reset();
+            enabled = false;
+        }
     }
+    
+    jit_enabled = enabled;
 
-    // EI
-    // Note: The effect of ei is delayed by one instruction. 
-    // This means that ei followed immediately by di does not 
-    // allow any interrupts between them.
-    // TODO: Implement the above
-    // 4 T-cycles
-    case 0xFB:
-        IME = true;
-        break;
-
-    default:
-        std::cout << "Invalid Opcode: " << std::hex << +IR << '\n';
-        ticks = 0;
-        break;
+    if (!enabled && jit)
+    {
+        drop_native_blocks();
+        jit.reset();
     }
+}
 
-    return ticks;
+void Cpu::set_idle_loop_skip_enabled(bool enabled)
+{
+#if GB_PROFILE_OPCODES
+    // The skipped iterations never reach a handler, so they could not be counted
+    enabled = false;
+#endif
+
+    idle_loop_skip_enabled = enabled;
 }
 
-void Cpu::cb_execute()
+uint32_t Cpu::execute_native_block(CodeBlock& block)
 {
-    IR = mem.read_byte(PC++);
+    exit_requested = false;
 
-    uint8_t u3 = (IR & CB_U3_BITMASK) >> 3;
-    uint8_t op = IR & CB_OP_BITMASK;
-    
-    switch(IR)
-    {
-    // RLC r8
-    // 0b00000xxx
-    // 8 T-cycles
-    case 0x00:
-    case 0x01:
-    case 0x02:
-    case 0x03:
-    case 0x04:
-    case 0x05:
-    case 0x07: // Potential Issue
-        rlc_r8(get_reg_ref(op));
-        break;
+    // The block was only entered because all of it fits in the budget, a skipped
+    // idle loop inside it could not
+    uint32_t budget = cycle_budget;
+    cycle_budget = 0;
 
-    // RLC [HL]
-    // 16 T-cycles
-    case 0x06:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            rlc_r8(byte);
-            mem.write_byte(byte, HL.r16);
+    uint32_t cycles = block.native(this);
 
-            ticks = 16;
-        }
-        break;
+    cycle_budget = budget;
 
-    // RRC r8
-    // 0b00001xxx
-    // 8 T-cycles
-    case 0x08:
-    case 0x09:
-    case 0x0A:
-    case 0x0B:
-    case 0x0C:
-    case 0x0D:
-    case 0x0F: 
-        rrc_r8(get_reg_ref(op));
-        break;
+    // Compiled code may exit mid-block, so the next instruction is looked up again
+    current_block = nullptr;
 
-    // RRC [HL]
-    // 16 T-cycles
-    case 0x0E:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            rrc_r8(byte);
-            mem.write_byte(byte, HL.r16);
+    return cycles;
+}
 
-            ticks = 16;
-        }
-        break;
+void Cpu::compile_block(CodeBlock& block)
+{
+    // RAM blocks can be rewritten while they run, so only ROM is compiled
+    if (block.start > BANK_N_END) return;
 
-    // RL r8
-    // 0b00010xxx
-    // 8 T-cycles
-    case 0x10:
-    case 0x11:
-    case 0x12:
-    case 0x13:
-    case 0x14:
-    case 0x15:
-    case 0x17:
-        rl_r8(get_reg_ref(op));
-        break;
+    block.native = jit->compile(*this, block);
 
-    // RL [HL]
-    // 16 T-cycles
-    case 0x16:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            rl_r8(byte);
-            mem.write_byte(byte, HL.r16);
+    if (!block.native && jit->is_full())
+    {
+        drop_native_blocks();
+        block.native = jit->compile(*this, block);
+    }
+}
 
-            ticks = 16;
-        }
-        break;
+void Cpu::drop_native_blocks()
+{
+    for (auto& [key, block] : rom_blocks)
+    {
+        block->native = nullptr;
+        block->execution_count = 0;
+    }
 
-    // RR r8
-    // 0b00011xxx
-    // 8 T-cycles
-    case 0x18:
-    case 0x19:
-    case 0x1A:
-    case 0x1B:
-    case 0x1C:
-    case 0x1D:
-    case 0x1F: 
-        rr_r8(get_reg_ref(op));
-        break;
+    jit->reset();
+}
 
-    // RR [HL]
-    // 16 T-cycles
-    case 0x1E:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            rr_r8(byte);
-            mem.write_byte(byte, HL.r16);
+uint32_t Cpu::jit_step(Cpu* cpu, const DecodedInstruction* instruction)
+{
+    cpu->IR = instruction->opcode;
+    cpu->operand = instruction->operand;
+    cpu->PC = instruction->next_address;
 
-            ticks = 16;
-        }
-        break;
+    instruction->handler(*cpu);
 
-    // SLA r8
-    // 0b00100xxx
-    // 8 T-cycles
-    case 0x20:
-    case 0x21:
-    case 0x22:
-    case 0x23:
-    case 0x24:
-    case 0x25:
-    case 0x27: 
-        sla_r8(get_reg_ref(op));
-        break;
+    return cpu->ticks;
+}
 
-    // SLA [HL]
-    // 16 T-cycles
-    case 0x26:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            sla_r8(byte);
-            mem.write_byte(byte, HL.r16);
+/* Idle Loop Skipping */
+constexpr int MAX_IDLE_LOOP_INSTRUCTIONS = 16;
 
-            ticks = 16;
-        }
-        break;
+/// @returns true if an instruction is allowed inside an idle loop, false if it can
+/// write memory, branch, change IME/SP or otherwise have a side effect.
+/// @note CB-prefixed instructions are checked separately.
+constexpr bool is_idle_loop_opcode(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x00: // NOP
+    case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // LD r8, n8
+    case 0x0A: case 0x1A: case 0xF2: // LD A, [BC]/[DE]/[$FF00 + C]
+    case 0xC6: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // ALU A, n8 (ADC excluded)
+    case 0xF0: // LDH A, [a8]
+    case 0xFA: // LD A, [a16]
+        return true;
+
+    case 0x8E: // ADC A, [HL] writes its result back to [HL]
+    case 0xCE: // ADC A, n8
+        return false;
 
-    // SRA r8
-    // 0b00101xxx
-    // 8 T-cycles
-    case 0x28:
-    case 0x29:
-    case 0x2A:
-    case 0x2B:
-    case 0x2C:
-    case 0x2D:
-    case 0x2F: 
-        sra_r8(get_reg_ref(op));
+    default:
         break;
+    }
 
-    // SRA [HL]
-    // 16 T-cycles
-    case 0x2E:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            sra_r8(byte);
-            mem.write_byte(byte, HL.r16);
+    // LD r8, r8/[HL], stores and HALT excluded
+    if ((opcode & 0xC0) == 0x40 && (opcode & 0xF8) != 0x70)
+        return true;
 
-            ticks = 16;
-        }
-        break;
+    // ADD/ADC/SUB/SBC/AND/XOR/OR/CP A, r8/[HL]
+    return (opcode & 0xC0) == 0x80;
+}
 
-    // SWAP r8
-    // 0b00110xxx
-    // 8 T-cycles
-    case 0x30:
-    case 0x31:
-    case 0x32:
-    case 0x33:
-    case 0x34:
-    case 0x35:
-    case 0x37:
-        swap_r8(get_reg_ref(op));
-        break;
+Cpu::IdleLoop Cpu::analyse_loop(uint16_t start, uint16_t branch_address) const
+{
+    // Registers (B, C, D, E, H, L, A) written by the loop, indexed like reg8()
+    uint8_t written = 0;
+    uint8_t address_registers = 0;
+    uint32_t cycles = 0;
 
-    // SWAP [HL]
-    // 16 T-cycles
-    case 0x36:
+    IdleLoop loop;
+    uint16_t address = start;
+
+    for (int count = 0; count < MAX_IDLE_LOOP_INSTRUCTIONS && address < branch_address; ++count)
+    {
+        uint8_t opcode = mem.peek_byte(address);
+        int instruction_cycles = BASE_OPCODES[opcode].cycles;
+
+        if (opcode == 0xCB)
         {
-            uint8_t byte = mem.read_byte(HL.r16);
-            swap_r8(byte);
-            mem.write_byte(byte, HL.r16);
+            // Only BIT u3, r8 (BIT u3, [HL] writes the byte back)
+            uint8_t cb_opcode = mem.peek_byte(address + 1);
+            if ((cb_opcode & 0xC0) != 0x40 || (cb_opcode & 0x07) == 6) return loop;
 
-            ticks = 16;
+            instruction_cycles = CB_OPCODES[cb_opcode].cycles;
         }
-        break;
+        else if (!is_idle_loop_opcode(opcode))
+            return loop;
+
+        // Reading JOYP has to see input changes, so polling it never counts as idle
+        if ((opcode == 0xF0 && mem.peek_byte(address + 1) == 0x00) ||
+            (opcode == 0xFA && (mem.peek_byte(address + 1) | (mem.peek_byte(address + 2) << 8)) == JOYPAD_INPUT))
+            return loop;
+
+        // Registers used as a read address
+        if (opcode == 0x0A) address_registers |= IDLE_READ_BC;
+        else if (opcode == 0x1A) address_registers |= IDLE_READ_DE;
+        else if (opcode == 0xF2) address_registers |= IDLE_READ_C;
+        else if ((opcode & 0xC7) == 0x46 || (opcode & 0xC7) == 0x86)
+            address_registers |= IDLE_READ_HL;
+
+        // Destination register
+        if ((opcode & 0xC7) == 0x06 || (opcode & 0xC0) == 0x40)
+            written |= 1 << ((opcode >> 3) & 0x07);
+        else if (opcode != 0x00 && opcode != 0xCB && (opcode & 0xF8) != 0xB8 && opcode != 0xFE) // CP only sets flags
+            written |= 1 << 7;
+
+        cycles += instruction_cycles;
+        address += BASE_OPCODES[opcode].length;
+    }
 
-    // SRL r8
-    // 0b00111xxx
-    // 8 T-cycles
-    case 0x38:
-    case 0x39:
-    case 0x3A:
-    case 0x3B:
-    case 0x3C:
-    case 0x3D:
-    case 0x3F: 
-        srl_r8(get_reg_ref(op));
-        break;
+    if (address != branch_address) return loop;
 
-    // SRL [HL]
-    // 16 T-cycles
-    case 0x3E:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            srl_r8(byte);
-            mem.write_byte(byte, HL.r16);
+    // An address register changing mid-iteration could move a read onto JOYP
+    if (((address_registers & IDLE_READ_BC) && (written & 0x03)) ||
+        ((address_registers & IDLE_READ_DE) && (written & 0x0C)) ||
+        ((address_registers & IDLE_READ_HL) && (written & 0x30)) ||
+        ((address_registers & IDLE_READ_C) && (written & 0x02)))
+        return loop;
 
-            ticks = 16;
-        }
-        break;
-    
-    // Bit u3, r8
-    // 01yyyxxx
-    // 8 T-cycles
-    case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x47: 
-    case 0x48: case 0x49: case 0x4A: case 0x4B: case 0x4C: case 0x4D: case 0x4F: 
-    case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x57: 
-    case 0x58: case 0x59: case 0x5A: case 0x5B: case 0x5C: case 0x5D: case 0x5F: 
-    case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x67: 
-    case 0x68: case 0x69: case 0x6A: case 0x6B: case 0x6C: case 0x6D: case 0x6F: 
-    case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x77: 
-    case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7F: 
-        bit_u3_r8(get_reg_ref(op), u3);
+    uint8_t branch = mem.peek_byte(branch_address);
+    switch (branch)
+    {
+    case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR (cc), e8
+    case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xC3: // JP (cc), a16
+        cycles += BASE_OPCODES[branch].cycles_taken;
         break;
+    default:
+        return loop;
+    }
 
-    // Bit u3, r8
-    // 12 T-cycles
-    case 0x46:
-    case 0x4E:
-    case 0x56:
-    case 0x5E:
-    case 0x66:
-    case 0x6E:
-    case 0x76:
-    case 0x7E:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            bit_u3_r8(byte, u3);
-            mem.write_byte(byte, HL.r16);
+    loop.is_idle = true;
+    loop.address_registers = address_registers;
+    loop.cycles = static_cast<uint16_t>(cycles);
 
-            ticks = 12;
-        }
-        break;
+    return loop;
+}
 
-    // RES u3, r8
-    // 10yyyxxx
-    // 8 T-cycles
-    case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x87: 
-    case 0x88: case 0x89: case 0x8A: case 0x8B: case 0x8C: case 0x8D: case 0x8F: 
-    case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x97: 
-    case 0x98: case 0x99: case 0x9A: case 0x9B: case 0x9C: case 0x9D: case 0x9F: 
-    case 0xA0: case 0xA1: case 0xA2: case 0xA3: case 0xA4: case 0xA5: case 0xA7: 
-    case 0xA8: case 0xA9: case 0xAA: case 0xAB: case 0xAC: case 0xAD: case 0xAF: 
-    case 0xB0: case 0xB1: case 0xB2: case 0xB3: case 0xB4: case 0xB5: case 0xB7: 
-    case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBF:
-        res_u3_r8(get_reg_ref(op), u3);
-        break;
+/// @note A loop is only skipped once a whole iteration, run without a timer/PPU event in
+/// between, was seen to leave every register unchanged. It cannot write memory, so every
+/// further iteration until the next event (which ends the budget) would repeat it exactly.
+uint32_t Cpu::skip_idle_loop(uint16_t branch_address)
+{
+    // Only ROM code is guaranteed not to change under the loop
+    if (!idle_loop_skip_enabled || cycle_budget <= ticks || branch_address > BANK_N_END)
+        return 0;
 
-    // RES u3, [HL]
-    // 16 T-cycles
-    case 0x86:
-    case 0x8E:
-    case 0x96:
-    case 0x9E:
-    case 0xA6:
-    case 0xAE:
-    case 0xB6:
-    case 0xBE:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            res_u3_r8(byte, u3); 
-            mem.write_byte(byte, HL.r16);
+    uint32_t key = (static_cast<uint32_t>(mem.get_rom_bank(branch_address)) << 16) | branch_address;
 
-            ticks = 16;
-        }
-        break;
-    
-    // SET u3, r8
-    // 8 T-cycles
-    case 0xC0: case 0xC1: case 0xC2: case 0xC3: case 0xC4: case 0xC5: case 0xC7: 
-    case 0xC8: case 0xC9: case 0xCA: case 0xCB: case 0xCC: case 0xCD: case 0xCF: 
-    case 0xD0: case 0xD1: case 0xD2: case 0xD3: case 0xD4: case 0xD5: case 0xD7: 
-    case 0xD8: case 0xD9: case 0xDA: case 0xDB: case 0xDC: case 0xDD: case 0xDF: 
-    case 0xE0: case 0xE1: case 0xE2: case 0xE3: case 0xE4: case 0xE5: case 0xE7: 
-    case 0xE8: case 0xE9: case 0xEA: case 0xEB: case 0xEC: case 0xED: case 0xEF: 
-    case 0xF0: case 0xF1: case 0xF2: case 0xF3: case 0xF4: case 0xF5: case 0xF7: 
-    case 0xF8: case 0xF9: case 0xFA: case 0xFB: case 0xFC: case 0xFD: case 0xFF: 
-        set_u3_r8(get_reg_ref(op), u3);
-        break;
+    IdleLoop& loop = idle_loops[(branch_address ^ (branch_address >> 6)) % idle_loops.size()];
+    if (loop.key != key)
+    {
+        loop = analyse_loop(PC, branch_address);
+        loop.key = key;
+    }
 
-    // SET u3, [HL]
-    // 16 T-cycles
-    case 0xC6:
-    case 0xCE:
-    case 0xD6:
-    case 0xDE:
-    case 0xE6:
-    case 0xEE:
-    case 0xF6:
-    case 0xFE:
-        {
-            uint8_t byte = mem.read_byte(HL.r16);
-            set_u3_r8(byte, u3); 
-            mem.write_byte(byte, HL.r16);
+    if (!loop.is_idle) return 0;
 
-            ticks = 16;
-        }
-        break;
+    materialize_flags();
 
-    default:
-        break;
+    // The budget only shrinks by the cycles run since the snapshot unless an event
+    // happened, which could have changed what the loop reads
+    if (loop_snapshot.key != key || loop_snapshot.budget != cycle_budget + loop.cycles ||
+        loop_snapshot.af != r16[AF] || loop_snapshot.bc != r16[BC] ||
+        loop_snapshot.de != r16[DE] || loop_snapshot.hl != r16[HL])
+    {
+        loop_snapshot = { key, cycle_budget, r16[AF], r16[BC], r16[DE], r16[HL] };
+        return 0;
     }
-}
 
+    if (((loop.address_registers & IDLE_READ_BC) && r16[BC] == JOYPAD_INPUT) ||
+        ((loop.address_registers & IDLE_READ_DE) && r16[DE] == JOYPAD_INPUT) ||
+        ((loop.address_registers & IDLE_READ_HL) && r16[HL] == JOYPAD_INPUT) ||
+        ((loop.address_registers & IDLE_READ_C) && r8[C] == 0x00))
+        return 0;
 
+    uint32_t iterations = (cycle_budget - ticks) / loop.cycles;
+
+    return iterations * loop.cycles;
+}
 
 /* CPU Instructions */
 
-void Cpu::invalid_opcode() const
+void Cpu::invalid_opcode()
 {
     std::cout << "Invalid Opcode: " << std::hex << +IR << '\n';
+
+    // PC is already past the opcode, whether it was fetched or predecoded
+    invalid_opcode_address = static_cast<uint16_t>(PC - 1);
+    exit_requested = true;
 }
 
 
@@ -1630,120 +1941,95 @@ void Cpu::invalid_opcode() const
 // Good
 void Cpu::adc_a(uint8_t reg8)
 {
-    uint8_t carry = static_cast<uint8_t>(check_flag(Flags::Carry));
-
-    set_flag(Flags::Carry, check_carry(A, reg8, carry));
-    set_flag(Flags::HalfCarry, check_half_carry(A, reg8, carry));
+    uint8_t carry = static_cast<uint8_t>(carry_flag());
+    uint8_t lhs = r8[A];
 
-    A += reg8 + carry;
+    r8[A] += reg8 + carry;
 
-    set_flag(Flags::Zero, A == 0);
-    set_flag(Flags::Subtraction, false);
+    record_flags(FlagOp::Adc, lhs, reg8, r8[A], carry);
 }
 
 // Good
 void Cpu::add_a(uint8_t reg8)
 {
-    set_flag(Flags::Carry, check_carry(reg8, A));
-    set_flag(Flags::HalfCarry, check_half_carry(reg8, A));
+    uint8_t lhs = r8[A];
 
-    A += reg8;
+    r8[A] += reg8;
 
-    set_flag(Flags::Zero, A == 0);
-    set_flag(Flags::Subtraction, false);
+    record_flags(FlagOp::Add, lhs, reg8, r8[A]);
 }
 
 
 void Cpu::sub_a(uint8_t reg8)
 {
-    set_flag(Flags::Carry, check_borrow(A, reg8));
-    set_flag(Flags::HalfCarry, check_half_borrow(A, reg8));
+    uint8_t lhs = r8[A];
 
-    A -= reg8;
+    r8[A] -= reg8;
 
-    set_flag(Flags::Zero, A == 0);
-    set_flag(Flags::Subtraction, true);
+    record_flags(FlagOp::Sub, lhs, reg8, r8[A]);
 }
 
 
 void Cpu::sbc_a(uint8_t reg8)
 {
-    uint8_t carry = static_cast<uint8_t>(check_flag(Flags::Carry));
+    uint8_t carry = static_cast<uint8_t>(carry_flag());
+    uint8_t lhs = r8[A];
 
-    set_flag(Flags::Carry, check_borrow(A, reg8, carry));
-    set_flag(Flags::HalfCarry, check_half_borrow(A, reg8, carry));
+    r8[A] -= carry;
+    r8[A] -= reg8;
 
-    A -= carry;
-    A -= reg8;
-
-    set_flag(Flags::Zero, A == 0);
-    set_flag(Flags::Subtraction, true);
+    record_flags(FlagOp::Sbc, lhs, reg8, r8[A], carry);
 }
 
 void Cpu::cp_a(uint8_t reg8) 
 {
-    set_flag(Flags::Carry, check_borrow(A, reg8));
-    set_flag(Flags::HalfCarry, check_half_borrow(A, reg8));
-
-    uint8_t res = A - reg8;
+    uint8_t res = r8[A] - reg8;
 
-    set_flag(Flags::Zero, res == 0);
-    set_flag(Flags::Subtraction, true);
+    record_flags(FlagOp::Sub, r8[A], reg8, res);
 }
 
 
 //  0b00xxx100 ~ 
 void Cpu::inc_r8(uint8_t& reg8)
 {
-    set_flag(Flags::HalfCarry, check_half_carry(reg8, 1));
+    uint8_t lhs = reg8;
 
     ++reg8;
 
-    set_flag(Flags::Zero, reg8 == 0);
-    set_flag(Flags::Subtraction, false);
+    record_flags(FlagOp::Inc, lhs, 1, reg8, carry_flag());
 }
 
 // 0b00xxx101
 void Cpu::dec_r8(uint8_t& reg8) 
 {
-    set_flag(Flags::HalfCarry, check_half_borrow(reg8, 1));
+    uint8_t lhs = reg8;
 
     --reg8;
 
-    set_flag(Flags::Zero, reg8 == 0);
-    set_flag(Flags::Subtraction, true);
+    record_flags(FlagOp::Dec, lhs, 1, reg8, carry_flag());
 }
 
 
 void Cpu::and_a(uint8_t reg8)
 {
-    A &= reg8;
+    r8[A] &= reg8;
 
-    set_flag(Flags::Zero, A == 0);
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, true);
-    set_flag(Flags::Carry, false);
+    record_flags(FlagOp::And, r8[A], reg8, r8[A]);
 }
 
 
 void Cpu::or_a(uint8_t reg8)
 {
-    A |= reg8;
+    r8[A] |= reg8;
 
-    set_flag(Flags::Zero, A == 0);
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-    set_flag(Flags::Carry, false);
+    record_flags(FlagOp::Logic, r8[A], reg8, r8[A]);
 }
 
 void Cpu::xor_a(uint8_t reg8)
 {
-    A ^= reg8;
+    r8[A] ^= reg8;
 
-    set_flag(Flags::Zero, A == 0);
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-    set_flag(Flags::Carry, false);
+    record_flags(FlagOp::Logic, r8[A], reg8, r8[A]);
 }
 
 
@@ -1752,17 +2038,18 @@ void Cpu::xor_a(uint8_t reg8)
 // 0b00xx1001, xx = register
 // 2 cycles
 // 1 byte
-void Cpu::add_hl_r16(uint16_t& r16)
+void Cpu::add_hl_r16(uint16_t& reg16)
 {
-    set_flag(Flags::HalfCarry, check_half_carry(HL.r16, r16));
-    set_flag(Flags::Carry, check_carry(HL.r16, r16));
+    set_flag(Flags::HalfCarry, check_half_carry(r16[HL], reg16));
+    set_flag(Flags::Carry, check_carry(r16[HL], reg16));
 
-    HL.r16 += r16;
+    r16[HL] += reg16;
 
     set_flag(Flags::Subtraction, false);
 }
 
 /* Stack Operations */
+template<typename Timing>
 void Cpu::push_r16(uint16_t reg)
 {
     // DEC SP
@@ -1770,30 +2057,53 @@ void Cpu::push_r16(uint16_t reg)
     // DEC SP
     // LD [SP], LOW(r16)   ; C, E or L
 
-    mem.write_byte(reg >> 8, --SP);
-    mem.write_byte(reg & 0xFF, --SP);
+    next_m_cycle<Timing>(); // SP is decremented before the first write
+
+    write8<Timing>(reg >> 8, --SP);
+    write8<Timing>(reg & 0xFF, --SP);
 }
 
+template<typename Timing>
 void Cpu::pop_r16(uint16_t& reg)
 {
     // LD LOW(r16), [SP]   ; C, E or L
     // INC SP
     // LD HIGH(r16), [SP]  ; B, D or H
     // INC SP
-    uint8_t low = mem.read_byte(SP++);
-    uint8_t high = mem.read_byte(SP++);
+    uint8_t low = read8<Timing>(SP++);
+    uint8_t high = read8<Timing>(SP++);
 
     reg = (high << 8) | low;
 }
 
 
+template<typename Timing>
 inline void Cpu::call_n16(uint16_t addr) 
 {
-    push_r16(PC);
+    push_r16<Timing>(PC);
 
     PC = addr;
 }
 
+inline void Cpu::profile_call([[maybe_unused]] uint16_t address, [[maybe_unused]] bool interrupt)
+{
+#if GB_PROFILE_CALLS
+    uint16_t bank = (address <= BANK_N_END) ? mem.get_rom_bank(address) : CallProfiler::NO_BANK;
+
+    if (interrupt)
+        call_profiler.on_interrupt(bank, address, SP);
+    else
+        call_profiler.on_call(bank, address, SP);
+#endif
+}
+
+inline void Cpu::profile_return()
+{
+#if GB_PROFILE_CALLS
+    call_profiler.on_return(SP);
+#endif
+}
+
 /* Bit operations */
 // CB Prefix + 0b00110xxx
 void Cpu::swap_r8(uint8_t& reg8)
@@ -1805,10 +2115,7 @@ void Cpu::swap_r8(uint8_t& reg8)
 
     reg8 = (low_nibble << 4) | hi_nibble;
 
-    set_flag(Flags::Zero, reg8 == 0);
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-    set_flag(Flags::Carry, false);
+    record_flags(FlagOp::Logic, reg8, 0, reg8);
 }
 
 // CB-Prefix + 0b01yyyxxx - xxx = operand, yyy = bit index
@@ -1816,9 +2123,7 @@ void Cpu::bit_u3_r8(uint8_t& reg8, uint8_t bit_index)
 {
     uint8_t bit_to_check = reg8 & (0x1 << bit_index);
 
-    set_flag(Flags::Zero, bit_to_check == 0);
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, true);
+    record_flags(FlagOp::Bit, reg8, bit_index, bit_to_check, carry_flag());
 }
 
 // CB-Prefix + 0b10yyyxxx - xxx = operand, yyy = bit index
@@ -1834,29 +2139,19 @@ void Cpu::set_u3_r8(uint8_t& reg8, uint8_t bit_index)
 }
 
 
-void Cpu::ld_r16_n16(uint16_t& reg16)
-{
-    uint16_t byte = read_next16();
-
-    reg16 = byte;
-}
-
 // CB Prefix + 0b00101xxx - xxx = register
 // -> 2 bytes + n
 // -> 2 cycles
 // Good
 void Cpu::sra_r8(uint8_t& reg8)
 {
+    uint8_t lhs = reg8;
     uint8_t msb = reg8 & MSB_BITMASK;
-    uint8_t lsb = reg8 & LSB_BITMASK;
 
     reg8 >>= 1;
     reg8 |= msb;
 
-    set_flag(Flags::Carry, lsb == LSB_BITMASK);
-    set_flag(Flags::Zero, reg8 == 0);
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
+    record_flags(FlagOp::ShiftRight, lhs, 0, reg8);
 }
 
 // CB Prefix + 0b00111xxx/various
@@ -1864,15 +2159,11 @@ void Cpu::sra_r8(uint8_t& reg8)
 // 2 bytes
 void Cpu::srl_r8(uint8_t& reg8)
 {
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-
-    uint8_t lsb = reg8 & LSB_BITMASK;
+    uint8_t lhs = reg8;
 
     reg8 >>= 1;
 
-    set_flag(Flags::Carry, lsb == LSB_BITMASK);
-    set_flag(Flags::Zero, reg8 == 0);
+    record_flags(FlagOp::ShiftRight, lhs, 0, reg8);
 } // Good
 
 // CB Prefix + 0b00100xxx - xxx = register
@@ -1881,15 +2172,11 @@ void Cpu::srl_r8(uint8_t& reg8)
 // Good
 void Cpu::sla_r8(uint8_t& reg8)
 {
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-
-    uint8_t msb = reg8 & MSB_BITMASK;
+    uint8_t lhs = reg8;
 
     reg8 <<= 1;
 
-    set_flag(Flags::Carry, msb == MSB_BITMASK);
-    set_flag(Flags::Zero, reg8 == 0);
+    record_flags(FlagOp::ShiftLeft, lhs, 0, reg8);
 }
 
 // CB Prefix + 0b00011xxx
@@ -1898,18 +2185,14 @@ void Cpu::sla_r8(uint8_t& reg8)
 // 2 cycles
 void Cpu::rr_r8(uint8_t& reg8)
 {
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-
     int i = IR & CB_OP_BITMASK;
 
-    uint8_t lsb = reg8 & LSB_BITMASK;
+    uint8_t lhs = reg8;
 
     reg8 >>= 1;
-    reg8 |= (static_cast<uint8_t>(check_flag(Flags::Carry)) << 7);
+    reg8 |= (static_cast<uint8_t>(carry_flag()) << 7);
 
-    set_flag(Flags::Carry, lsb == LSB_BITMASK);
-    set_flag(Flags::Zero, reg8 == 0);
+    record_flags(FlagOp::ShiftRight, lhs, 0, reg8);
 }
 
 // CB Prefix + 0b00010xxx
@@ -1918,18 +2201,14 @@ void Cpu::rr_r8(uint8_t& reg8)
 // 2 machine cycles
 void Cpu::rl_r8(uint8_t& reg8)
 {
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-
     int i = IR & CB_OP_BITMASK;
 
-    uint8_t msb = reg8 & MSB_BITMASK;
+    uint8_t lhs = reg8;
 
     reg8 <<= 1;
-    reg8 |= static_cast<uint8_t>(check_flag(Flags::Carry));
+    reg8 |= static_cast<uint8_t>(carry_flag());
 
-    set_flag(Flags::Carry, msb == MSB_BITMASK);
-    set_flag(Flags::Zero, reg8 == 0);
+    record_flags(FlagOp::ShiftLeft, lhs, 0, reg8);
 }
 
 // CB Prefix + 0b00000xxx
@@ -1939,17 +2218,13 @@ void Cpu::rl_r8(uint8_t& reg8)
 // 2 cycles
 void Cpu::rlc_r8(uint8_t& reg8)
 {
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-
-
+    uint8_t lhs = reg8;
     uint8_t msb = reg8 & MSB_BITMASK;
     reg8 <<= 1;
 
     reg8 |= (msb >> 7);
 
-    set_flag(Flags::Carry, msb == MSB_BITMASK);
-    set_flag(Flags::Zero, reg8 == 0);
+    record_flags(FlagOp::ShiftLeft, lhs, 0, reg8);
 } 
 
 // CB Prefix + 0b00000xxx
@@ -1958,18 +2233,15 @@ void Cpu::rlc_r8(uint8_t& reg8)
 // 2 cycles
 void Cpu::rrc_r8(uint8_t& reg8)
 {
-    set_flag(Flags::Subtraction, false);
-    set_flag(Flags::HalfCarry, false);
-
     int i = IR & CB_OP_BITMASK;
 
+    uint8_t lhs = reg8;
     uint8_t lsb = reg8 & LSB_BITMASK;
     reg8 >>= 1;
 
     reg8 |= (lsb << 7);
 
-    set_flag(Flags::Carry, lsb == LSB_BITMASK);
-    set_flag(Flags::Zero, reg8 == 0);
+    record_flags(FlagOp::ShiftRight, lhs, 0, reg8);
 }
 
 // 0b00100111/0x27
@@ -1980,19 +2252,19 @@ inline void Cpu::daa()
     uint8_t offset = 0;
     bool is_subtraction = check_flag(Flags::Subtraction);
 
-    if ((!is_subtraction && ((A & LOW_NIBBLE_MASK) > 0x09)) || check_flag(Flags::HalfCarry))
+    if ((!is_subtraction && ((r8[A] & LOW_NIBBLE_MASK) > 0x09)) || check_flag(Flags::HalfCarry))
         offset |= 0x06;
 
-    if ((!is_subtraction && A > 0x99) || check_flag(Flags::Carry))
+    if ((!is_subtraction && r8[A] > 0x99) || check_flag(Flags::Carry))
     {
         offset |= 0x60;
         set_flag(Flags::Carry, true); 
     }
     else set_flag(Flags::Carry, false);
 
-    A = (is_subtraction) ? A - offset : A + offset;
+    r8[A] = (is_subtraction) ? r8[A] - offset : r8[A] + offset;
 
-    set_flag(Flags::Zero, A == 0);
+    set_flag(Flags::Zero, r8[A] == 0);
     set_flag(Flags::HalfCarry, false);
 }
 
@@ -2013,6 +2285,17 @@ void Cpu::check_interrupts()
     }
 }
 
+bool Cpu::dispatch_interrupt()
+{
+    if (!IME || (mem.get_interrupt_enable() & mem.get_interrupt_flag() & 0x1F) == 0)
+        return false;
+
+    is_halted = false;
+    handle_interrupt();
+
+    return true;
+}
+
 // 20 T-cycles
 // 8 T-cycles = 2 NOPs
 // 8 T-cycles = push PC onto stack
@@ -2022,6 +2305,9 @@ void Cpu::handle_interrupt()
     //std::cout << "Interrupt Handler Triggered!" << std::endl;
     IME = false;
 
+    // The handler may change what a polling loop reads
+    loop_snapshot.key = UINT32_MAX;
+
     static constexpr std::array<std::pair<uint16_t, Interrupts>, 5> interrupt_sources = {{
         {VBLANK_INTERRUPT_START, Interrupts::VBlank},
         {STAT_INTERRUPT_START, Interrupts::LCD},
@@ -2035,7 +2321,8 @@ void Cpu::handle_interrupt()
         if (GBInterrupts::is_interrupt_queued(mem, interrupt))
         {
             //std::cout << "Executing sequenece @ 0x" << std::hex << address << '\n';
-            call_n16(address);
+            profile_call(address, true);
+            call_n16<FastTiming>(address);
             GBInterrupts::unset_interrupt(mem, interrupt);
 
             break;
@@ -2,8 +2,19 @@
 
 #include "memory.hpp"
 #include "interrupts.hpp"
+#include "opcode_profiler.hpp"
+#include "call_profiler.hpp"
+#include "bus_trace.hpp"
 
 #include <cstdint>
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 constexpr uint16_t DMG_AF_INIT = 0x01B0;
 constexpr uint16_t DMG_BC_INIT = 0x0013;
@@ -12,6 +23,8 @@ constexpr uint16_t DMG_HL_INIT = 0x014D;
 constexpr uint16_t DMG_SP_INIT = HIGH_RAM_END;
 constexpr uint16_t PROGRAM_START = 0x100;
 
+class JitCompiler;
+
 /// @brief Represents a 16-bit register that can also be treated as two 8-bit values.
 /// @note Implementation assumes your system is little-endian. 
 struct RegPair
@@ -23,22 +36,111 @@ struct RegPair
     };
 
     /* Constructors */
-    RegPair() {}
+    RegPair() = default;
     RegPair(uint16_t _r16) : r16(_r16) {}
     RegPair(uint8_t _high, uint8_t _low) : low(_low), high(_high) {}
 };
 
+/// @brief Architectural state of the SM83. Trivially copyable, so it can be snapshotted with a memcpy.
+struct CpuState
+{
+    // Byte slots of the 8-bit registers in `r8`
+    enum : int { C, B, E, D, L, H, F, A };
+
+    // Register pair slots in `r16`
+    enum : int { BC, DE, HL, AF };
+
+    /// @returns Slot in `r8` of the register encoded by a 3-bit opcode index (B, C, D, E, H, L, [HL], A).
+    /// Pairs are stored low byte first, so B-L are swapped within their pair. Index 6 selects F.
+    static constexpr int r8_slot(int index) { return (index < 6) ? (index ^ 1) : index; }
+
+    /* Register File */
+    union
+    {
+        std::array<uint16_t, 4> r16{ DMG_BC_INIT, DMG_DE_INIT, DMG_HL_INIT, DMG_AF_INIT };
+        std::array<uint8_t, 8> r8;
+        std::array<RegPair, 4> pairs;
+    };
+
+    // 16-bit Registers
+    uint16_t PC = PROGRAM_START; // Program Counter
+    uint16_t SP = DMG_SP_INIT; // Stack Pointer
+
+    /* Interrupt handling Register/variables */
+    uint8_t IR = 0; // 8-bit Instruction Register
+    bool IME = false; // Interrupt Master Enable
+    bool is_halted = false;
+};
+
+static_assert(std::is_trivially_copyable_v<CpuState>, "CpuState must stay memcpy-able");
+
+/* Timing Policies */
+/// @brief Instruction-granular timing: the timer/PPU catch up after each instruction or batch.
+struct FastTiming
+{
+    static constexpr bool PER_ACCESS = false;
+};
+
+/// @brief M-cycle timing: the timer/PPU are caught up before every memory access inside an
+/// instruction, so mid-instruction STAT/timer edges are seen where hardware sees them.
+struct AccurateTiming
+{
+    static constexpr bool PER_ACCESS = true;
+};
+
 /// @brief Emulates Game Boy (SM83) CPU.
 ///
 /// Implements instruction fetch/decode/execute and interrupt handling.
-class Cpu
+class Cpu : private CpuState
 {
 public:
     explicit Cpu(Mmu& mem);
+    ~Cpu();
     
     /// @brief Fetches, decodes and executes one CPU instruction at program counter.
+    /// @tparam Timing FastTiming, or AccurateTiming to pass every T-cycle to the sync
+    /// callback as it happens. The accurate core never uses the block cache or JIT.
     /// @returns Number of T-cycles taken by the executed instruction.
-    uint32_t execute_instruction();
+    template<typename Timing = FastTiming> uint32_t execute_instruction();
+
+    /// @brief Executes instructions until `budget` T-cycles have passed or one of them
+    /// wrote an IO/MBC register, so the timer/PPU only have to catch up afterwards.
+    /// At least one instruction is executed.
+    /// @returns Number of T-cycles taken.
+    template<typename Timing = FastTiming> uint32_t execute_cycles(uint32_t budget);
+
+    /// @brief Like execute_cycles, but strictly one instruction at a time (no compiled blocks,
+    /// idle or copy loop skipping) and calls `should_stop()` before each instruction,
+    /// stopping as soon as it returns true. Used while the debugger has watchpoints.
+    /// @returns Number of T-cycles taken, possibly 0.
+    template<typename Timing = FastTiming> uint32_t execute_cycles_checked(uint32_t budget, const std::function<bool()>& should_stop);
+
+    /// @brief Sets what AccurateTiming execution calls with the T-cycles passed since its
+    /// last call, before each memory access and at the end of each instruction.
+    void set_sync_callback(std::function<void(uint32_t)> callback) { sync_callback = std::move(callback); }
+
+    /// @brief Enables/disables executing from the predecoded block cache.
+    /// Disabling the cache also drops every cached block.
+    void set_block_cache_enabled(bool enabled);
+
+    /// @brief Drops every cached block, e.g. after memory was replaced without going through the MMU.
+    void invalidate_block_cache();
+
+    /// @brief Enables/disables compiling hot ROM blocks to native code.
+    /// Requires the block cache, and has no effect on hosts without a JIT backend
+    /// or in GB_PROFILE_OPCODES builds.
+    void set_jit_enabled(bool enabled);
+
+    /// @brief Sets how many T-cycles may pass before the next timer/PPU event,
+    /// or, while halted, before the next interrupt that could wake the CPU.
+    /// Compiled blocks only run if they are guaranteed to finish within it,
+    /// and a halted CPU skips straight to the end of it.
+    void set_cycle_budget(uint32_t cycles) { cycle_budget = cycles; }
+
+    /// @brief Enables/disables fast-forwarding ROM loops that only poll memory
+    /// (e.g. waiting on LY, STAT or IF) up to the end of the cycle budget.
+    /// Has no effect in GB_PROFILE_OPCODES builds.
+    void set_idle_loop_skip_enabled(bool enabled);
     
     /* Debugging Functions */
     void test(); // Useful for testing one thing at a time
@@ -46,16 +148,53 @@ public:
     void print_registers() const;
     void print_flags() const;
 
+    /// @brief Prints how often each opcode ran and where host time went. Only
+    /// builds with GB_PROFILE_OPCODES collect anything.
+    void print_opcode_profile() const;
+
+    /// @brief Writes the T-cycles spent under each emulated call stack to `path` in the
+    /// folded format flamegraph.pl reads. Only builds with GB_PROFILE_CALLS collect anything.
+    void write_call_profile(const std::string& path) const;
+
+    /// @brief Starts recording every bus access the CPU makes to `path` (see BusTrace for the
+    /// format), replacing a running trace. Only builds with GB_TRACE_BUS record anything.
+    void start_bus_trace(const std::string& path);
+
+    /// @brief Writes out what was recorded so far and closes the trace file.
+    void stop_bus_trace();
+
+    /* Lockup Detection */
+    static constexpr size_t PC_HISTORY_SIZE = 16;
+
+    /// @returns Address of the last illegal opcode executed (real hardware hangs on them),
+    /// -1 if there was none since clear_invalid_opcode().
+    int32_t get_invalid_opcode_address() const { return invalid_opcode_address; }
+    void clear_invalid_opcode() { invalid_opcode_address = -1; }
+
+    /// @brief Enables/disables recording the addresses returned by get_pc_history(),
+    /// which costs a store per instruction. Off by default.
+    void set_pc_history_enabled(bool enabled) { pc_history_enabled = enabled; }
+
+    /// @returns Addresses of the last instructions started while recording was enabled,
+    /// oldest first. A compiled block only records its first instruction.
+    std::array<uint16_t, PC_HISTORY_SIZE> get_pc_history() const;
+
+    /// @brief Copies out the register file, PC/SP and interrupt state.
+    CpuState get_state() { materialize_flags(); return *this; }
+
+    /// @brief Replaces the register file, PC/SP and interrupt state, e.g. to restore a snapshot.
+    void set_state(const CpuState& state);
+
     /* Temporary Getters */
-    RegPair& get_af() { return AF; }
-    RegPair& get_bc() { return BC; }
-    RegPair& get_de() { return DE; }
-    RegPair& get_hl() { return HL; }
+    RegPair& get_af() { materialize_flags(); return pairs[AF]; }
+    RegPair& get_bc() { return pairs[BC]; }
+    RegPair& get_de() { return pairs[DE]; }
+    RegPair& get_hl() { return pairs[HL]; }
 
     uint8_t& get_ir() { return IR; }
 
-    uint8_t& get_A() { return A; }
-    uint8_t& get_F() { return F; }
+    uint8_t& get_A() { return r8[A]; }
+    uint8_t& get_F() { materialize_flags(); return r8[F]; }
 
     uint16_t& get_pc() { return PC; }
     uint16_t& get_sp() { return SP; }
@@ -75,64 +214,278 @@ private:
     };
     
 
-    /* CPU Registers */
-    // 16-bit Register pairs
-    RegPair AF{DMG_AF_INIT};
-    RegPair BC{DMG_BC_INIT};
-    RegPair DE{DMG_DE_INIT};
-    RegPair HL{DMG_HL_INIT};
+    /* Cycle counting (In T-cycles)*/
+    uint32_t ticks = 0;
 
-    // Special case Registers 
-    uint8_t& A = AF.high; // Accumulator
-    uint8_t& F = AF.low; // Flags
+    /* Lockup Detection */
+    std::array<uint16_t, PC_HISTORY_SIZE> pc_history{};
+    uint8_t pc_history_index = 0; // Next slot to write, wraps around with the array
+    bool pc_history_enabled = false;
+    int32_t invalid_opcode_address = -1;
 
-    // 16-bit Registers
-    uint16_t PC = PROGRAM_START; // Program Counter
-    uint16_t SP = DMG_SP_INIT; // Stack Pointer
+    static_assert(256 % PC_HISTORY_SIZE == 0, "pc_history_index must wrap onto slot 0");
 
-    /* Interrupt handling Register/variables */
-    uint8_t IR = 0; // 8-bit Instruction Register
-    bool IME = false; // Interrupt Master Enable
-    bool is_halted = false; 
+    /* Instruction Execution */
+    /// @brief execute_instruction() and execute_cycles(), with or without recording the PC history.
+    template<typename Timing, bool RECORD_PC> uint32_t run_instruction();
+    template<typename Timing, bool RECORD_PC> uint32_t run_cycles(uint32_t budget);
 
-    /* Cycle counting (In T-cycles)*/
-    uint32_t ticks = 0;
+    template<bool PREDECODED, typename Timing> void cb_execute();
 
-    /* Instruction Execution */
-    void cb_execute();
+    /// @brief Executes one base/CB-prefixed opcode. Operands encoded in the
+    /// opcode bits are resolved at compile time.
+    /// @tparam PREDECODED If true, immediate operands are taken from `operand`
+    /// instead of being fetched from memory.
+    /// @tparam Timing FastTiming or AccurateTiming, see execute_instruction.
+    template<uint8_t OPCODE, bool PREDECODED, typename Timing> void execute_opcode();
+    template<uint8_t OPCODE, typename Timing> void execute_cb_opcode();
+
+    template<typename Timing> uint32_t step_instruction();
+    uint32_t execute_accurate_instruction();
+
+    /* Opcode Dispatch Tables */
+    using OpcodeHandler = void (*)(Cpu&);
+
+    template<uint8_t OPCODE, bool PREDECODED, typename Timing> static void dispatch_opcode(Cpu& cpu);
+    template<uint8_t OPCODE, typename Timing> static void dispatch_cb_opcode(Cpu& cpu);
+
+    template<bool PREDECODED, typename Timing, size_t... OPCODES>
+    static constexpr std::array<OpcodeHandler, 256> make_opcode_table(std::index_sequence<OPCODES...>);
+    template<typename Timing, size_t... OPCODES>
+    static constexpr std::array<OpcodeHandler, 256> make_cb_opcode_table(std::index_sequence<OPCODES...>);
+
+    static const std::array<OpcodeHandler, 256> opcode_table;
+    static const std::array<OpcodeHandler, 256> predecoded_opcode_table;
+    static const std::array<OpcodeHandler, 256> cb_opcode_table;
+
+    static const std::array<OpcodeHandler, 256> accurate_opcode_table;
+    static const std::array<OpcodeHandler, 256> accurate_cb_opcode_table;
+
+#if GB_PROFILE_OPCODES
+    OpcodeProfiler profiler; // Fed by the dispatch functions, so interpreter and block cache both count
+#endif
+
+#if GB_PROFILE_CALLS
+    CallProfiler call_profiler; // Charged per instruction, so every execution path is attributed
+#endif
+
+#if GB_TRACE_BUS
+    BusTrace bus_trace;
+    uint64_t bus_trace_cycle = 0; // T-cycles of the instructions run so far
+    uint32_t bus_trace_offset = 0; // T-cycles into the current instruction
+    uint16_t bus_trace_pc = 0; // Start of the current instruction
+#endif
+
+    /// @brief Records a bus access in the bus trace. Compiled out unless GB_TRACE_BUS.
+    inline void trace_bus(BusAccess access, uint16_t address, uint8_t value);
+
+    /// @brief Fetches the opcode at PC into IR and advances PC past it.
+    inline void fetch_opcode();
+
+    /// @brief Tell the call profiler about a CALL/RST/interrupt to `address` (before the
+    /// return address is pushed) and a RET/RETI (after it was popped).
+    inline void profile_call(uint16_t address, bool interrupt = false);
+    inline void profile_return();
+
+    /* Accurate Timing */
+    std::function<void(uint32_t)> sync_callback = [](uint32_t) {};
+    uint32_t synced_cycles = 0; // T-cycles of the current instruction already passed to sync_callback
+
+    /// @brief Ends the current M-cycle. With AccurateTiming the timer/PPU are caught up to it.
+    template<typename Timing> void next_m_cycle();
+
+    /// @brief Memory access in its own M-cycle, after the one before it has ended.
+    template<typename Timing> uint8_t read8(uint16_t address);
+    template<typename Timing> void write8(uint8_t byte, uint16_t address);
+
+    /* Block Cache */
+    /// @brief One instruction with its operands already fetched.
+    struct DecodedInstruction
+    {
+        OpcodeHandler handler = nullptr;
+        uint16_t address = 0;
+        uint16_t next_address = 0;
+        uint16_t operand = 0;
+        uint8_t opcode = 0;
+    };
+
+    /// @brief Compiled block; returns the T-cycles taken by the instructions it ran.
+    using NativeBlock = uint32_t (*)(Cpu* cpu);
+
+    enum class BulkOp : uint8_t { None, Copy, Fill };
+
+    /// @brief Memory copy/fill idiom recognised in a block that loops back to itself.
+    struct BulkLoop
+    {
+        BulkOp op = BulkOp::None;
+        bool source_is_hl = false; // Copy: LD A, [HL+] + LD [DE], A, otherwise LD A, [DE] + LD [HL+], A
+        int8_t hl_step = 1; // Fill: LD [HL+], A or LD [HL-], A
+        int8_t counter = 0; // Opcode index of the B/C counter, -1 for BC
+        int16_t fill_value = -1; // Fill: LD A, n8/XOR A value, -1 if A is written as is
+        bool clears_a = false; // Fill: XOR A, which also resets the flags
+    };
+
+    /// @brief A straight-line run of instructions ending at the first branch.
+    struct CodeBlock
+    {
+        uint16_t start = 0;
+        uint32_t end = 0; // Exclusive
+        std::vector<DecodedInstruction> instructions;
+
+        uint32_t max_cycles = 0; // T-cycles if every branch is taken
+        uint32_t execution_count = 0;
+        NativeBlock native = nullptr;
+        BulkLoop bulk;
+    };
+
+    bool block_cache_enabled = false;
+
+    // ROM blocks keyed by (bank << 16 | address), WRAM/HRAM blocks by address
+    std::unordered_map<uint32_t, std::unique_ptr<CodeBlock>> rom_blocks;
+    std::unordered_map<uint16_t, std::unique_ptr<CodeBlock>> ram_blocks;
+    std::array<uint16_t, 256> code_page_refs{}; // Cached RAM blocks overlapping each 256-byte page
+
+    CodeBlock* current_block = nullptr;
+    size_t block_index = 0;
+
+    uint16_t operand = 0; // Immediate operand of the predecoded instruction being executed
+
+    uint32_t execute_cached_instruction();
+
+    CodeBlock* find_block(uint16_t address);
+    std::unique_ptr<CodeBlock> decode_block(uint16_t start, uint16_t region_end);
+
+    static BulkLoop detect_bulk_loop(const CodeBlock& block);
+
+    /// @brief Runs as many iterations of a copy/fill loop as fit in the cycle budget as
+    /// one host operation, leaving registers and flags exactly as the loop would.
+    /// @returns T-cycles taken, 0 if the loop has to run normally.
+    uint32_t execute_bulk_loop(const CodeBlock& block);
+
+    void watch_block_pages(const CodeBlock& block);
+    void unwatch_block_pages(const CodeBlock& block);
+
+    /// @brief Called by the MMU on writes to the ROM area, IO registers or a watched code page.
+    void on_code_write(uint16_t address);
+
+    /* JIT */
+    static constexpr uint32_t JIT_THRESHOLD = 64; // Executions before a ROM block is compiled
+
+    std::unique_ptr<JitCompiler> jit;
+    bool jit_enabled = false;
+    bool exit_requested = false; // Set by IO/MBC writes, ends a compiled block or batch
+    uint32_t cycle_budget = 0;
+
+    uint32_t execute_native_block(CodeBlock& block);
+    void compile_block(CodeBlock& block);
+    void drop_native_blocks();
+
+    /// @brief Runs one predecoded instruction on behalf of compiled code.
+    /// @returns Number of T-cycles taken.
+    static uint32_t jit_step(Cpu* cpu, const DecodedInstruction* instruction);
+
+    /* Idle Loop Skipping */
+    /// @brief Result of analysing a backward branch and the code it jumps back over.
+    struct IdleLoop
+    {
+        uint32_t key = UINT32_MAX; // (bank << 16 | branch address)
+        bool is_idle = false; // Straight-line code that only reads memory and registers
+        uint8_t address_registers = 0; // IDLE_READ_* sources of reads that must not hit JOYP
+        uint16_t cycles = 0; // T-cycles of one iteration, branch included
+    };
+
+    /// @brief Registers seen the last time an idle loop's branch was taken.
+    struct LoopSnapshot
+    {
+        uint32_t key = UINT32_MAX;
+        uint32_t budget = 0; // Cycle budget at the time, to tell if an event happened since
+        uint16_t af = 0, bc = 0, de = 0, hl = 0;
+    };
+
+    static constexpr uint8_t IDLE_READ_BC = 0x01;
+    static constexpr uint8_t IDLE_READ_DE = 0x02;
+    static constexpr uint8_t IDLE_READ_HL = 0x04;
+    static constexpr uint8_t IDLE_READ_C = 0x08; // LD A, [$FF00 + C]
+
+    bool idle_loop_skip_enabled = false;
+    std::array<IdleLoop, 64> idle_loops{}; // Direct-mapped by branch address
+    LoopSnapshot loop_snapshot;
+
+    /// @brief Called after a backward branch at branch_address was taken.
+    /// @returns T-cycles skipped, always a whole number of loop iterations.
+    uint32_t skip_idle_loop(uint16_t branch_address);
+    IdleLoop analyse_loop(uint16_t start, uint16_t branch_address) const;
 
     /* Flag methods */
     inline void set_flag(Flags f, bool cond);
     bool check_flag(Flags f) const;
 
+    /* Lazy Flags */
+    /// @brief Operation whose flags have not been written to F yet.
+    enum class FlagOp : uint8_t
+    {
+        None, // F is up to date
+        Add,
+        Adc,
+        Sub, // SUB, CP
+        Sbc,
+        And,
+        Logic, // OR, XOR, SWAP
+        Inc, // Carry is unaffected
+        Dec, // Carry is unaffected
+        Bit, // Carry is unaffected
+        ShiftLeft, // Carry is bit 7 of lhs
+        ShiftRight // Carry is bit 0 of lhs
+    };
+
+    /// @brief Operands and result of the last flag-setting ALU operation.
+    struct LazyFlags
+    {
+        FlagOp op = FlagOp::None;
+        uint8_t lhs = 0;
+        uint8_t rhs = 0;
+        uint8_t carry = 0; // Carry-in for ADC/SBC, carry kept by INC/DEC/BIT
+        uint8_t result = 0;
+    };
+
+    LazyFlags lazy_flags;
+
+    inline void record_flags(FlagOp op, uint8_t lhs, uint8_t rhs, uint8_t result, uint8_t carry = 0);
+
+    /// @returns Value F would hold if the pending operation's flags were written.
+    uint8_t evaluate_flags() const;
+    inline bool zero_flag() const;
+    inline bool carry_flag() const;
+
+    /// @brief Writes the pending operation's flags to F.
+    void materialize_flags();
+
     /// @brief Checks if a certain CPU flag is set/unset.
-    /// @param cond 2-bit value repr. the condition code. 
+    /// @tparam CC 2-bit value repr. the condition code (NZ, Z, NC, C).
     /// @returns true if condition is true.
-    /// @throws `std::runtime_error` If cond is > 3.
-    bool check_condition_code(int cond);
+    template<int CC> bool condition() const;
 
     /* Register Getter Methods */
 
-    /// @brief Retrieves a 8-bit register value/reference based on index.
-    /// @param cond 3-bit value repr. the register index.
-    /// @returns 8-bit register value/reference.
-    /// @throws `std::runtime_error` If cond is > 7.
-    uint8_t get_reg(int index);
-    uint8_t& get_reg_ref(int index);
+    /// @brief Retrieves a reference to the 8-bit register encoded by an opcode.
+    /// @tparam INDEX 3-bit value repr. the register index (6 is [HL] and not allowed).
+    template<int INDEX> uint8_t& reg8();
 
-    /// @brief Retrieves a 16-bit register value/reference based on index.
-    /// @param cond 2-bit value repr. the register index.
-    /// @returns 16-bit register value/reference.
-    /// @throws `std::runtime_error` If cond is > 3.
-    uint16_t get_reg16(int index);
-    uint16_t& get_reg16_ref(int index);
+    /// @brief Retrieves a reference to the 16-bit register encoded by an opcode.
+    /// @tparam INDEX 2-bit value repr. the register index (BC, DE, HL, SP).
+    template<int INDEX> uint16_t& reg16();
 
     /// @brief Advances PC by 2 and retrieves next 2 bytes in memory.
     /// @returns 16-bit value in little-endian.
-    inline uint16_t read_next16();
+    template<typename Timing> uint8_t read_next8();
+    template<typename Timing> uint16_t read_next16();
+
+    /// @brief Retrieves the next 8/16-bit immediate operand.
+    template<bool PREDECODED, typename Timing> uint8_t fetch8();
+    template<bool PREDECODED, typename Timing> uint16_t fetch16();
 
     /* CPU Instructions */
-    void invalid_opcode() const;
+    void invalid_opcode();
 
     // 8-bit Arithmetic/Logic Operations
     void add_a(uint8_t byte); 
@@ -143,6 +496,8 @@ private:
 
     void cp_a(uint8_t reg8);
 
+    template<int OPERATION> void alu_a(uint8_t byte);
+
     void inc_r8(uint8_t& reg8);
     void dec_r8(uint8_t& reg8);
 
@@ -151,16 +506,13 @@ private:
     void xor_a(uint8_t reg8);
 
     // 16-bit Arithmetic/Logic Operations
-    void add_hl_r16(uint16_t& r16);
-
-    // 16-bit Load Instructions
-    void ld_r16_n16(uint16_t& reg16);
+    void add_hl_r16(uint16_t& reg16);
 
     // Stack Operations
-    void push_r16(uint16_t reg16);
-    void pop_r16(uint16_t& reg16);
+    template<typename Timing> void push_r16(uint16_t reg16);
+    template<typename Timing> void pop_r16(uint16_t& reg16);
 
-    inline void call_n16(uint16_t nn);
+    template<typename Timing> void call_n16(uint16_t nn);
 
     // Bit manipulation
     void swap_r8(uint8_t& reg8);
@@ -179,6 +531,8 @@ private:
     void rlc_r8(uint8_t& reg8);
     void rrc_r8(uint8_t& reg8);
 
+    template<int OPERATION> void shift_r8(uint8_t& reg8);
+
     // Miscellaneous 
     inline void daa();
 
@@ -186,5 +540,11 @@ private:
     void check_interrupts();
     void handle_interrupt();
 
+    /// @brief Jumps to the vector of a pending interrupt, if IME allows one, without running the
+    /// instruction there as check_interrupts() does.
+    /// @returns true if an interrupt was dispatched.
+    bool dispatch_interrupt();
+
     friend class Gameboy;
+    friend class JitCompiler;
 };
@@ -0,0 +1,202 @@
+#include "debugger.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+Debugger::Debugger(Mmu& _mmu) :
+    mmu(_mmu)
+{
+    mmu.set_access_trap_callback([this](uint16_t address, uint8_t value, bool write) {
+        on_access(address, value, write);
+    });
+}
+
+uint32_t Debugger::add_watchpoint(uint16_t start, uint16_t end, uint8_t access, int bank,
+    WatchCallback callback, bool pause)
+{
+    Watchpoint watchpoint;
+    watchpoint.id = next_id++;
+    watchpoint.start = std::min(start, end);
+    watchpoint.end = std::max(start, end);
+    watchpoint.access = access;
+    watchpoint.bank = bank;
+    watchpoint.pause = pause;
+    watchpoint.callback = std::move(callback);
+
+    watchpoints.push_back(std::move(watchpoint));
+    update_traps();
+
+    return watchpoints.back().id;
+}
+
+uint32_t Debugger::add_breakpoint(uint16_t address, int bank, WatchCallback callback, bool pause)
+{
+    return add_watchpoint(address, address, static_cast<uint8_t>(WatchAccess::Execute), bank, std::move(callback), pause);
+}
+
+bool Debugger::remove_watchpoint(uint32_t id)
+{
+    auto it = std::find_if(watchpoints.begin(), watchpoints.end(),
+        [id](const Watchpoint& watchpoint) { return watchpoint.id == id; });
+
+    if (it == watchpoints.end()) return false;
+
+    watchpoints.erase(it);
+    update_traps();
+
+    return true;
+}
+
+void Debugger::clear()
+{
+    watchpoints.clear();
+    update_traps();
+}
+
+/// @returns The WRAM address an echo RAM address mirrors or the other way around, -1 for other addresses.
+static int mirror_address(uint32_t address)
+{
+    constexpr uint32_t ECHO_OFFSET = ECHO_RAM_START - WORK_RAM_START;
+
+    if (address >= ECHO_RAM_START && address <= ECHO_RAM_END) return address - ECHO_OFFSET;
+    if (address >= WORK_RAM_START && address + ECHO_OFFSET <= ECHO_RAM_END) return address + ECHO_OFFSET;
+
+    return -1;
+}
+
+void Debugger::update_traps()
+{
+    std::bitset<256> read_pages{};
+    std::bitset<256> write_pages{};
+    execute_addresses.reset();
+
+    for (const Watchpoint& watchpoint : watchpoints)
+    {
+        bool read = watchpoint.access & static_cast<uint8_t>(WatchAccess::Read);
+        bool write = watchpoint.access & static_cast<uint8_t>(WatchAccess::Write);
+
+        for (uint32_t page = watchpoint.start >> 8; page <= (watchpoint.end >> 8u); ++page)
+        {
+            read_pages[page] = read_pages[page] || read;
+            write_pages[page] = write_pages[page] || write;
+
+            // Echo RAM mirrors WRAM, so the other mirror's pages have to be trapped as well
+            int mirror = mirror_address(page << 8);
+            if (mirror >= 0)
+            {
+                read_pages[mirror >> 8] = read_pages[mirror >> 8] || read;
+                write_pages[mirror >> 8] = write_pages[mirror >> 8] || write;
+            }
+        }
+
+        if (watchpoint.access & static_cast<uint8_t>(WatchAccess::Execute))
+        {
+            for (uint32_t address = watchpoint.start; address <= watchpoint.end; ++address)
+            {
+                execute_addresses.set(address);
+
+                int mirror = mirror_address(address);
+                if (mirror >= 0) execute_addresses.set(mirror);
+            }
+        }
+    }
+
+    mmu.set_page_traps(read_pages, write_pages);
+}
+
+bool Debugger::matches(const Watchpoint& watchpoint, uint16_t address, WatchAccess access) const
+{
+    if (!(watchpoint.access & static_cast<uint8_t>(access))) return false;
+
+    auto in_range = [&watchpoint](int address) { return address >= watchpoint.start && address <= watchpoint.end; };
+
+    int mirror = mirror_address(address);
+    if (!in_range(address) && !(mirror >= 0 && in_range(mirror))) return false;
+
+    return watchpoint.bank == ANY_BANK || address > BANK_N_END || mmu.get_rom_bank(address) == watchpoint.bank;
+}
+
+void Debugger::on_access(uint16_t address, uint8_t value, bool write)
+{
+    WatchAccess access = write ? WatchAccess::Write : WatchAccess::Read;
+
+    for (const Watchpoint& watchpoint : watchpoints)
+    {
+        if (!matches(watchpoint, address, access)) continue;
+
+        WatchHit hit;
+        hit.id = watchpoint.id;
+        hit.access = access;
+        hit.address = address;
+        hit.bank = mmu.get_rom_bank(address);
+        hit.value = value;
+
+        trigger(watchpoint, hit);
+    }
+}
+
+bool Debugger::before_instruction(uint16_t pc)
+{
+    if (paused) return true;
+
+    // The instruction the last pause stopped before runs once
+    bool resuming = (pc == resume_address);
+    resume_address = -1;
+
+    if (resuming || !execute_addresses[pc]) return false;
+
+    for (const Watchpoint& watchpoint : watchpoints)
+    {
+        if (!matches(watchpoint, pc, WatchAccess::Execute)) continue;
+
+        WatchHit hit;
+        hit.id = watchpoint.id;
+        hit.access = WatchAccess::Execute;
+        hit.address = pc;
+        hit.bank = mmu.get_rom_bank(pc);
+
+        trigger(watchpoint, hit);
+    }
+
+    return paused;
+}
+
+void Debugger::resume()
+{
+    if (!paused) return;
+
+    paused = false;
+    resume_address = (last_hit.access == WatchAccess::Execute) ? last_hit.address : -1;
+}
+
+void Debugger::trigger(const Watchpoint& watchpoint, const WatchHit& hit)
+{
+    if (watchpoint.callback)
+        watchpoint.callback(hit);
+    else
+    {
+        char line[64];
+
+        if (hit.address <= BANK_N_END)
+            std::snprintf(line, sizeof(line), "Watchpoint %u: %s @ %02X:%04X", hit.id, watch_access_name(hit.access), hit.bank, hit.address);
+        else
+            std::snprintf(line, sizeof(line), "Watchpoint %u: %s @ %04X", hit.id, watch_access_name(hit.access), hit.address);
+
+        std::cout << line;
+
+        if (hit.access != WatchAccess::Execute)
+        {
+            std::snprintf(line, sizeof(line), " = $%02X", hit.value);
+            std::cout << line;
+        }
+
+        std::cout << '\n';
+    }
+
+    if (watchpoint.pause)
+    {
+        paused = true;
+        last_hit = hit;
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <bitset>
+#include <functional>
+#include <vector>
+
+#include "memory.hpp"
+
+/// @brief Kinds of access a watchpoint triggers on, combined as a bit mask.
+enum class WatchAccess : uint8_t
+{
+    Read = 0x01,
+    Write = 0x02,
+    Execute = 0x04 // Before the instruction at the address runs, i.e. a breakpoint
+};
+
+constexpr uint8_t operator|(WatchAccess a, WatchAccess b) { return static_cast<uint8_t>(a) | static_cast<uint8_t>(b); }
+
+constexpr const char* watch_access_name(WatchAccess access)
+{
+    switch (access)
+    {
+    case WatchAccess::Read: return "read";
+    case WatchAccess::Write: return "write";
+    case WatchAccess::Execute: return "execute";
+    default: return "none";
+    }
+}
+
+/// @brief Watchpoint bank that matches whichever ROM bank is mapped.
+constexpr int ANY_BANK = -1;
+
+/// @brief One triggered watchpoint.
+struct WatchHit
+{
+    uint32_t id = 0; // Watchpoint that triggered
+    WatchAccess access = WatchAccess::Read;
+    uint16_t address = 0; // As accessed, i.e. echo RAM addresses are not folded onto WRAM
+    uint16_t bank = 0; // ROM bank mapped at `address`, meaningless outside of ROM
+    uint8_t value = 0; // Byte read or written, 0 for Execute
+};
+
+using WatchCallback = std::function<void(const WatchHit&)>;
+
+/// @brief An address range watched for some kinds of access.
+struct Watchpoint
+{
+    uint32_t id = 0;
+    uint16_t start = 0;
+    uint16_t end = 0; // Inclusive
+    uint8_t access = 0; // WatchAccess mask
+    int bank = ANY_BANK; // ROM bank the range has to be mapped from, for ROM addresses
+    bool pause = true; // Pause emulation once it triggers
+    WatchCallback callback; // Called when it triggers (must not add/remove watchpoints), the hit is printed if there is none
+};
+
+/// @brief Read/write/execute watchpoints on memory, without rebuilding the emulator.
+///
+/// Reads and writes are trapped through the MMU's page table, so only the pages holding a
+/// watched address leave the fast path. Execute watchpoints are checked by the Gameboy's
+/// checked run loop, which is only used while any watchpoint exists.
+class Debugger
+{
+public:
+    explicit Debugger(Mmu& mmu);
+
+    /// @brief Watches [start, end] for the accesses in `access` (a WatchAccess mask).
+    /// WRAM and echo RAM ranges also catch accesses through the other mirror.
+    /// @returns Id of the new watchpoint.
+    uint32_t add_watchpoint(uint16_t start, uint16_t end, uint8_t access, int bank = ANY_BANK,
+        WatchCallback callback = {}, bool pause = true);
+
+    /// @brief Breaks before the instruction at `address` (in `bank`, for ROM addresses) runs.
+    /// @returns Id of the new watchpoint.
+    uint32_t add_breakpoint(uint16_t address, int bank = ANY_BANK, WatchCallback callback = {}, bool pause = true);
+
+    /// @returns false if there is no watchpoint with that id.
+    bool remove_watchpoint(uint32_t id);
+
+    void clear();
+
+    bool has_watchpoints() const { return !watchpoints.empty(); }
+    const std::vector<Watchpoint>& get_watchpoints() const { return watchpoints; }
+
+    /// @brief Checks the execute watchpoints, before the instruction at `pc` runs.
+    /// @returns true if emulation has to stop before it.
+    bool before_instruction(uint16_t pc);
+
+    /// @returns true if a watchpoint paused emulation, until resume().
+    bool is_paused() const { return paused; }
+
+    /// @brief Continues after a pause. An execute watchpoint that caused it lets its
+    /// instruction run once.
+    void resume();
+
+    const WatchHit& get_last_hit() const { return last_hit; }
+
+private:
+    Mmu& mmu;
+
+    std::vector<Watchpoint> watchpoints;
+    uint32_t next_id = 1;
+
+    std::bitset<0x10000> execute_addresses{}; // Quick rejection in before_instruction()
+
+    bool paused = false;
+    WatchHit last_hit;
+    int resume_address = -1; // Execute watchpoint address to let through once after resume()
+
+    /// @brief Recomputes the MMU page traps and execute addresses from the watchpoints.
+    void update_traps();
+
+    void on_access(uint16_t address, uint8_t value, bool write);
+
+    /// @returns true if `watchpoint` covers `address` (in the bank mapped now) for `access`.
+    bool matches(const Watchpoint& watchpoint, uint16_t address, WatchAccess access) const;
+
+    void trigger(const Watchpoint& watchpoint, const WatchHit& hit);
+};
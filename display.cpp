@@ -75,6 +75,14 @@ void Display::handle_events()
         case SDL_EVENT_KEY_UP:
             if (event.key.scancode == SDL_SCANCODE_6)
                 settings.save_stage_trigger = true;
+            else if (event.key.scancode == SDL_SCANCODE_7)
+                settings.opcode_profile_trigger = true;
+            else if (event.key.scancode == SDL_SCANCODE_8)
+                settings.call_profile_trigger = true;
+            else if (event.key.scancode == SDL_SCANCODE_9)
+                settings.debugger_resume_trigger = true;
+            else if (event.key.scancode == SDL_SCANCODE_0)
+                settings.memory_stats_trigger = true;
             break;
 
         case SDL_EVENT_KEY_DOWN:
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
 
 Gameboy::Gameboy(const std::string& rom_name, std::string save_file) :
     cartridge(Cartridge::load_rom(rom_name)),
@@ -11,16 +12,49 @@ Gameboy::Gameboy(const std::string& rom_name, std::string save_file) :
     ppu(mmu),
     joypad(mmu),
     timer(mmu),
-    display(ppu, settings)
+    display(ppu, settings),
+    debugger(mmu),
+    cheats(mmu, cartridge.get()),
+    memory_scanner(mmu, cartridge.get())
 {
+#if GB_TRACE_BUS
+    // Predecoded, compiled and skipped code makes no individual bus accesses to record
+    settings.use_block_cache = false;
+    settings.use_jit = false;
+    settings.skip_idle_loops = false;
+
+    cpu.start_bus_trace(settings.bus_trace_path);
+#endif
+
+#if GB_PROFILE_MEMORY
+    // Predecoded and compiled code isn't fetched through the MMU, skipped loops make no accesses
+    settings.use_block_cache = false;
+    settings.use_jit = false;
+    settings.skip_idle_loops = false;
+#endif
+
+    cpu.set_block_cache_enabled(settings.use_block_cache);
+    cpu.set_jit_enabled(settings.use_jit);
+    cpu.set_idle_loop_skip_enabled(settings.skip_idle_loops);
+    cpu.set_pc_history_enabled(settings.watchdog);
+    cpu.set_sync_callback([this](uint32_t cycles) { tick_devices(cycles); });
+
+    // Predecoded and compiled code was read from the unpatched ROM
+    cheats.set_rom_patch_callback([this] { cpu.invalidate_block_cache(); });
+
+    for (const std::string& code : settings.cheat_codes)
+        cheats.add_code(code);
+
+    settings.cpu_speed = std::max<uint32_t>(settings.cpu_speed, 1);
+
     if (!save_file.empty())
         read_save_file(save_file);
 }
 
 void Gameboy::run()
 {
-    uint32_t cycles_elapsed = 0;
-    while (display.is_program_running())
+    uint64_t cycles_elapsed = 0;
+    while (display.is_program_running() && !locked_up)
     {
         auto start = std::chrono::steady_clock::now();
 
@@ -31,22 +65,40 @@ void Gameboy::run()
             settings.save_stage_trigger = false;
             write_save_file();
         }
-                
-        while (!ppu.trigger_redisplay)
+
+        if (settings.opcode_profile_trigger)
         {
-            const bool* state = SDL_GetKeyboardState(NULL);
-            joypad.handle_inputs(state);
-            
-            uint32_t cycles = cpu.execute_instruction();
-            timer.tick(cycles);
+            settings.opcode_profile_trigger = false;
+            cpu.print_opcode_profile();
+        }
 
-            ppu.tick(cycles);
+        if (settings.call_profile_trigger)
+        {
+            settings.call_profile_trigger = false;
+            cpu.write_call_profile(settings.call_profile_path);
+        }
 
-            cycles_elapsed += cycles;
+        if (settings.debugger_resume_trigger)
+        {
+            settings.debugger_resume_trigger = false;
+            debugger.resume();
         }
 
-        ppu.trigger_redisplay = false;
+        if (settings.memory_stats_trigger)
+        {
+            settings.memory_stats_trigger = false;
+
+            std::cout << "\n/* Memory Accesses, Last Frame */\n";
+            frame_memory_stats.print(std::cout);
+            std::cout << "\n/* Memory Accesses, Total */\n";
+            mmu.get_memory_stats().print(std::cout);
+        }
+                
+        // Input is sampled once per frame
+        const bool* state = SDL_GetKeyboardState(NULL);
+        joypad.handle_inputs(state);
 
+        cycles_elapsed += run_frame();
         cycles_elapsed %= GBTiming::CYCLES_PER_FRAME;
 
         display.update_screen();
@@ -59,6 +111,125 @@ void Gameboy::run()
         uint32_t time = (diff <= 16.67f) ? (16.67 - diff) : 0;
         SDL_Delay(time);
     }
+
+#if GB_PROFILE_OPCODES
+    cpu.print_opcode_profile();
+#endif
+
+#if GB_PROFILE_CALLS
+    cpu.write_call_profile(settings.call_profile_path);
+#endif
+
+#if GB_TRACE_BUS
+    cpu.stop_bus_trace();
+#endif
+}
+
+uint64_t Gameboy::run_cycles(uint64_t cycles)
+{
+    uint64_t elapsed = 0;
+
+    while (elapsed < cycles && !is_stopped())
+        elapsed += run_batch(static_cast<uint32_t>(std::min<uint64_t>(cycles - elapsed, UINT32_MAX)));
+
+    return elapsed;
+}
+
+uint64_t Gameboy::run_frame()
+{
+    uint64_t cycles = 0;
+
+    while (!ppu.trigger_redisplay && !is_stopped())
+        cycles += run_batch();
+
+    if (ppu.trigger_redisplay)
+    {
+        // The frame ends as VBlank starts
+        cheats.apply_ram_cheats();
+
+        MemoryStats totals = mmu.get_memory_stats();
+        frame_memory_stats = totals - frame_start_memory_stats;
+        frame_start_memory_stats = totals;
+    }
+
+    ppu.trigger_redisplay = false;
+
+    return cycles;
+}
+
+uint32_t Gameboy::run_batch(uint32_t max_cycles)
+{
+    uint32_t budget = std::min(next_cycle_budget(), max_cycles);
+
+    // An overclocked CPU gets `cpu_speed` T-cycles for every one the timer/PPU see
+    uint64_t cpu_budget = static_cast<uint64_t>(budget) * settings.cpu_speed;
+    cpu_budget = (cpu_budget > overclock_cycles) ? cpu_budget - overclock_cycles : 1;
+    cpu_budget = std::min<uint64_t>(cpu_budget, UINT32_MAX);
+
+    uint32_t cycles;
+
+    // The accurate core catches the timer/PPU up itself, through the sync callback
+    if (settings.accurate_timing)
+    {
+        uint32_t carried = overclock_cycles;
+        uint32_t cpu_cycles = execute_cpu<AccurateTiming>(static_cast<uint32_t>(cpu_budget));
+
+        cycles = static_cast<uint32_t>((static_cast<uint64_t>(carried) + cpu_cycles - overclock_cycles) / settings.cpu_speed);
+    }
+    else
+        cycles = tick_devices(execute_cpu<FastTiming>(static_cast<uint32_t>(cpu_budget)));
+
+    if (settings.watchdog && watchdog.check(cpu, mmu, cycles))
+    {
+        watchdog.print_report(std::cerr, mmu);
+        locked_up = true;
+    }
+
+    return cycles;
+}
+
+template<typename Timing>
+uint32_t Gameboy::execute_cpu(uint32_t cpu_budget)
+{
+    if (!debugger.has_watchpoints())
+        return cpu.execute_cycles<Timing>(cpu_budget);
+
+    // A halted CPU has no instruction to stop before
+    return cpu.execute_cycles_checked<Timing>(cpu_budget, [this] {
+        return cpu.is_halted ? debugger.is_paused() : debugger.before_instruction(cpu.get_pc());
+    });
+}
+
+uint32_t Gameboy::tick_devices(uint32_t cpu_cycles)
+{
+    uint64_t total = static_cast<uint64_t>(overclock_cycles) + cpu_cycles;
+
+    uint32_t cycles = static_cast<uint32_t>(total / settings.cpu_speed);
+    overclock_cycles = static_cast<uint32_t>(total % settings.cpu_speed);
+
+    timer.tick(cycles);
+    ppu.tick(cycles);
+    mmu.tick_dma(cycles);
+
+    return cycles;
+}
+
+uint32_t Gameboy::next_cycle_budget()
+{
+    uint8_t interrupt_enable = mmu.get_interrupt_enable();
+    bool interrupt_pending = (interrupt_enable & mmu.get_interrupt_flag() & 0x1F) != 0;
+
+    if (!cpu.is_halted || interrupt_pending)
+        return std::min({ timer.cycles_until_next_event(), ppu.cycles_until_next_event(), mmu.cycles_until_dma_end() });
+
+    // A halted CPU only has to be woken by an interrupt (or a finished frame). 
+    // Joypad interrupts are only noticed once the skip ends, at most a frame later.
+    uint32_t cycles = ppu.cycles_until_next_interrupt(interrupt_enable);
+
+    if (interrupt_enable & static_cast<uint8_t>(Interrupts::Timer))
+        cycles = std::min(cycles, timer.cycles_until_next_interrupt());
+
+    return cycles;
 }
 
 void Gameboy::write_save_file()
@@ -93,15 +264,16 @@ void Gameboy::write_save_file()
     save_file.write(reinterpret_cast<const char*>(mmu.io_registers.data()), mmu.io_registers.size());
     save_file.write(reinterpret_cast<const char*>(&mmu.interrupt_enable), 1);
 
-    save_file.write(reinterpret_cast<const char*>(&cpu.AF.r16), 2);
-    save_file.write(reinterpret_cast<const char*>(&cpu.BC.r16), 2);
-    save_file.write(reinterpret_cast<const char*>(&cpu.DE.r16), 2);
-    save_file.write(reinterpret_cast<const char*>(&cpu.HL.r16), 2);
-    save_file.write(reinterpret_cast<const char*>(&cpu.PC), 2);
-    save_file.write(reinterpret_cast<const char*>(&cpu.SP), 2);
-    save_file.write(reinterpret_cast<const char*>(&cpu.IR), 1);
-    save_file.write(reinterpret_cast<const char*>(&cpu.IME), 1);
-    save_file.write(reinterpret_cast<const char*>(&cpu.is_halted), 1);
+    CpuState state = cpu.get_state();
+    save_file.write(reinterpret_cast<const char*>(&state.r16[CpuState::AF]), 2);
+    save_file.write(reinterpret_cast<const char*>(&state.r16[CpuState::BC]), 2);
+    save_file.write(reinterpret_cast<const char*>(&state.r16[CpuState::DE]), 2);
+    save_file.write(reinterpret_cast<const char*>(&state.r16[CpuState::HL]), 2);
+    save_file.write(reinterpret_cast<const char*>(&state.PC), 2);
+    save_file.write(reinterpret_cast<const char*>(&state.SP), 2);
+    save_file.write(reinterpret_cast<const char*>(&state.IR), 1);
+    save_file.write(reinterpret_cast<const char*>(&state.IME), 1);
+    save_file.write(reinterpret_cast<const char*>(&state.is_halted), 1);
 
     save_file.close();
 
@@ -139,6 +311,8 @@ void Gameboy::read_save_file(std::string& file_name)
     save_file.read(reinterpret_cast<char*>(&cartridge->rtc_register_id), 1);
     save_file.read(reinterpret_cast<char*>(&cartridge->rtc_enable), 1);
     save_file.read(reinterpret_cast<char*>(&cartridge->is_rtc_mapped_to_ram), 1);
+    cartridge->update_banks();
+    mmu.map_rom_pages();
 
     save_file.read(reinterpret_cast<char*>(mmu.work_ram.data()), mmu.work_ram.size());
     save_file.read(reinterpret_cast<char*>(mmu.high_ram.data()), mmu.high_ram.size());
@@ -146,18 +320,26 @@ void Gameboy::read_save_file(std::string& file_name)
     save_file.read(reinterpret_cast<char*>(mmu.oam_data.data()), mmu.oam_data.size());
     save_file.read(reinterpret_cast<char*>(mmu.io_registers.data()), mmu.io_registers.size());
     save_file.read(reinterpret_cast<char*>(&mmu.interrupt_enable), 1);
+    timer.sync_registers();
+    ppu.sync_registers();
+    mmu.mark_all_dirty();
 
-    save_file.read(reinterpret_cast<char*>(&cpu.AF.r16), 2);
-    save_file.read(reinterpret_cast<char*>(&cpu.BC.r16), 2);
-    save_file.read(reinterpret_cast<char*>(&cpu.DE.r16), 2);
-    save_file.read(reinterpret_cast<char*>(&cpu.HL.r16), 2);
-    save_file.read(reinterpret_cast<char*>(&cpu.PC), 2);
-    save_file.read(reinterpret_cast<char*>(&cpu.SP), 2);
-    save_file.read(reinterpret_cast<char*>(&cpu.IR), 1);
-    save_file.read(reinterpret_cast<char*>(&cpu.IME), 1);
-    save_file.read(reinterpret_cast<char*>(&cpu.is_halted), 1);
+    CpuState state{};
+    save_file.read(reinterpret_cast<char*>(&state.r16[CpuState::AF]), 2);
+    save_file.read(reinterpret_cast<char*>(&state.r16[CpuState::BC]), 2);
+    save_file.read(reinterpret_cast<char*>(&state.r16[CpuState::DE]), 2);
+    save_file.read(reinterpret_cast<char*>(&state.r16[CpuState::HL]), 2);
+    save_file.read(reinterpret_cast<char*>(&state.PC), 2);
+    save_file.read(reinterpret_cast<char*>(&state.SP), 2);
+    save_file.read(reinterpret_cast<char*>(&state.IR), 1);
+    save_file.read(reinterpret_cast<char*>(&state.IME), 1);
+    save_file.read(reinterpret_cast<char*>(&state.is_halted), 1);
+    cpu.set_state(state);
 
     save_file.close();
 
+    // Memory was replaced behind the MMU's back
+    cpu.invalidate_block_cache();
+
     std::cout << "Successfully Read Save File!\n";
 }
\ No newline at end of file
@@ -8,6 +8,10 @@
 #include "display.hpp"
 #include "timer.hpp"
 #include "settings.hpp"
+#include "watchdog.hpp"
+#include "debugger.hpp"
+#include "cheats.hpp"
+#include "memory_scan.hpp"
 
 class Gameboy
 {
@@ -16,6 +20,41 @@ public:
 
     void run();
 
+    /* Core Execution */
+    /// @brief Runs for at least `cycles` T-cycles, stopping at the first instruction boundary after them.
+    /// @returns Number of T-cycles run.
+    uint64_t run_cycles(uint64_t cycles);
+
+    /// @brief Runs until the PPU finishes the current frame, then applies the GameShark codes and
+    /// snapshots the memory access counters.
+    /// @returns Number of T-cycles run.
+    uint64_t run_frame();
+
+    /// @brief Runs until `predicate()` returns true. It is checked between batches,
+    /// i.e. at timer/PPU events and after IO/MBC register writes.
+    /// @returns Number of T-cycles run.
+    template<typename Predicate> uint64_t run_until(Predicate predicate);
+
+    /// @returns true if the watchdog stopped emulation, which then never resumes.
+    bool is_locked_up() const { return locked_up; }
+    const LockupReport& get_lockup_report() const { return watchdog.get_report(); }
+
+    /// @brief Watchpoints/breakpoints. While any exist, the CPU runs one instruction at a time
+    /// and emulation stops whenever one pauses it, until Debugger::resume().
+    Debugger& get_debugger() { return debugger; }
+
+    /// @brief GameShark/Game Genie cheats. GameShark codes are applied whenever run_frame() finishes a frame.
+    CheatEngine& get_cheats() { return cheats; }
+
+    /// @brief Searches WRAM, HRAM and cartridge RAM for values, e.g. between run_frame() calls.
+    MemoryScanner& get_memory_scanner() { return memory_scanner; }
+
+    /// @returns Memory accesses, bank switches and OAM DMA transfers of the last frame run_frame() finished.
+    const MemoryStats& get_frame_memory_stats() const { return frame_memory_stats; }
+
+    /// @returns Memory accesses, bank switches and OAM DMA transfers since power on.
+    MemoryStats get_memory_stats() const { return mmu.get_memory_stats(); }
+
 private:    
     Settings settings;
 
@@ -27,7 +66,57 @@ private:
     Timer timer;
     Display display;
 
+    /// @returns Number of cycles the CPU may run before the timer/PPU need to catch up.
+    uint32_t next_cycle_budget();
+
+    /// @brief Runs the CPU up to the next event (or `max_cycles`), then catches the timer/PPU up.
+    /// With accurate timing the CPU keeps them up to date on every memory access instead.
+    /// Stops emulation if the watchdog is enabled and finds the program hung.
+    /// @returns Number of T-cycles run, as seen by the timer/PPU.
+    uint32_t run_batch(uint32_t max_cycles = UINT32_MAX);
+
+    /// @brief Runs the CPU for up to `cpu_budget` T-cycles, through the checked loop if there are watchpoints.
+    template<typename Timing> uint32_t execute_cpu(uint32_t cpu_budget);
+
+    /// @returns true if emulation may not run, because of a lockup or a debugger pause.
+    bool is_stopped() const { return locked_up || debugger.is_paused(); }
+
+    /* CPU Overclocking */
+    uint32_t overclock_cycles = 0; // CPU T-cycles not yet worth a whole timer/PPU T-cycle
+
+    /// @brief Advances the timer/PPU by the time `cpu_cycles` CPU T-cycles take at the configured CPU speed.
+    /// @returns Number of timer/PPU T-cycles advanced.
+    uint32_t tick_devices(uint32_t cpu_cycles);
+
+    /* Lockup Detection */
+    Watchdog watchdog;
+    bool locked_up = false;
+
+    /* Debugging */
+    Debugger debugger;
+
+    /* Cheats */
+    CheatEngine cheats;
+
+    /* Memory Search */
+    MemoryScanner memory_scanner;
+
+    /* Access Statistics */
+    MemoryStats frame_start_memory_stats; // Totals when the last frame finished
+    MemoryStats frame_memory_stats;
+
     /* Save File Handling */
     void write_save_file();
     void read_save_file(std::string& save_file);
-};
\ No newline at end of file
+};
+
+template<typename Predicate>
+uint64_t Gameboy::run_until(Predicate predicate)
+{
+    uint64_t cycles = 0;
+
+    while (!predicate() && !is_stopped())
+        cycles += run_batch();
+
+    return cycles;
+}
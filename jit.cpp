@@ -0,0 +1,409 @@
+#include "jit.hpp"
+#include "opcodes.hpp"
+
+#include <cstring>
+
+#if GB_JIT_X64
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+// x86-64 register numbers used in ModRM fields
+constexpr uint8_t X64_RAX = 0;
+constexpr uint8_t X64_RCX = 1;
+
+JitCompiler::JitCompiler()
+{
+#if GB_JIT_X64
+#if defined(_WIN32)
+    // Never writable and executable at once, compile() flips it to executable after writing
+    void* memory = VirtualAlloc(nullptr, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    // Never writable and executable at once, compile() flips it to executable after writing
+    void* memory = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) memory = nullptr;
+#endif
+    code_memory = static_cast<uint8_t*>(memory);
+#endif
+
+    code.reserve(4096);
+}
+
+JitCompiler::~JitCompiler()
+{
+#if GB_JIT_X64
+    if (!code_memory) return;
+
+#if defined(_WIN32)
+    VirtualFree(code_memory, 0, MEM_RELEASE);
+#else
+    munmap(code_memory, JIT_CODE_SIZE);
+#endif
+#endif
+}
+
+bool JitCompiler::set_executable([[maybe_unused]] bool executable)
+{
+#if GB_JIT_X64
+#if defined(_WIN32)
+    DWORD old_protection;
+    return VirtualProtect(code_memory, JIT_CODE_SIZE, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &old_protection) != 0;
+#else
+    return mprotect(code_memory, JIT_CODE_SIZE, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) == 0;
+#endif
+#else
+    return false;
+#endif
+}
+
+void JitCompiler::reset()
+{
+    code_used = 0;
+    full = false;
+}
+
+/// @returns true for instructions compiled code can run without the interpreter's help.
+bool JitCompiler::is_compilable(const Cpu::DecodedInstruction& instruction)
+{
+    switch (instruction.opcode)
+    {
+    case 0x10: case 0x76: // STOP, HALT
+    case 0xD9: case 0xFB: // RETI, EI
+    case 0xE0: case 0xF0: case 0xE2: case 0xF2: // LDH
+    case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+        return false;
+
+    // LD [a16], A / LD A, [a16]
+    case 0xEA: case 0xFA:
+        return instruction.operand < IO_REGISTERS_START ||
+            (instruction.operand > IO_REGISTERS_END && instruction.operand != INTERRUPT_ENABLE);
+
+    default:
+        return true;
+    }
+}
+
+Cpu::NativeBlock JitCompiler::compile(Cpu& cpu, const Cpu::CodeBlock& block)
+{
+    if (!code_memory || block.instructions.empty()) return nullptr;
+
+    for (const auto& instruction : block.instructions)
+    {
+        if (!is_compilable(instruction)) return nullptr;
+    }
+
+    code.clear();
+    exit_jumps.clear();
+    pending_cycles = 0;
+
+    emit_prologue();
+
+    for (size_t i = 0; i < block.instructions.size(); ++i)
+    {
+        const Cpu::DecodedInstruction& instruction = block.instructions[i];
+        bool last = (i + 1 == block.instructions.size());
+
+        if (emit_native(cpu, instruction, last)) continue;
+
+        emit_call(instruction);
+
+        if (!last) emit_exit_checks(cpu);
+    }
+
+    flush_cycles();
+
+    size_t epilogue = code.size();
+    emit_epilogue();
+
+    for (size_t jump : exit_jumps)
+    {
+        uint32_t rel = static_cast<uint32_t>(epilogue - (jump + 4));
+        std::memcpy(&code[jump], &rel, sizeof(rel));
+    }
+
+    if (code_used + code.size() > JIT_CODE_SIZE)
+    {
+        full = true;
+        return nullptr;
+    }
+
+    uint8_t* entry = code_memory + code_used;
+    if (!set_executable(false)) return nullptr;
+    std::memcpy(entry, code.data(), code.size());
+    if (!set_executable(true)) return nullptr;
+    code_used += (code.size() + 15) & ~size_t{15};
+
+    return reinterpret_cast<Cpu::NativeBlock>(entry);
+}
+
+/* Instruction Translation */
+// Only instructions that touch nothing but CPU registers (and never set flags) are translated.
+bool JitCompiler::emit_native(Cpu& cpu, const Cpu::DecodedInstruction& instruction, bool last)
+{
+    const uint8_t opcode = instruction.opcode;
+    const int32_t pc = offset_of(cpu, &cpu.PC);
+
+    // JP a16 / JR e8 always end a block
+    if (opcode == 0xC3 || opcode == 0x18)
+    {
+        uint16_t target = (opcode == 0xC3)
+            ? instruction.operand
+            : static_cast<uint16_t>(instruction.next_address + static_cast<int8_t>(instruction.operand));
+
+        emit_store16_imm(pc, target);
+        emit_store8_imm(offset_of(cpu, &cpu.IR), opcode);
+        pending_cycles += BASE_OPCODES[opcode].cycles;
+
+        return true;
+    }
+
+    // NOP
+    if (opcode == 0x00)
+    {}
+
+    // LD r8, r8
+    else if (opcode >= 0x40 && opcode <= 0x7F && (opcode & 0x07) != 6 && ((opcode >> 3) & 0x07) != 6)
+    {
+        int dst = (opcode >> 3) & 0x07;
+        int src = opcode & 0x07;
+
+        if (dst != src)
+        {
+            emit_load8_ecx(reg8_offset(cpu, src));
+            emit_store8_cl(reg8_offset(cpu, dst));
+        }
+    }
+
+    // LD r8, n8
+    else if ((opcode & 0xC7) == 0x06 && opcode != 0x36)
+        emit_store8_imm(reg8_offset(cpu, opcode >> 3), static_cast<uint8_t>(instruction.operand));
+
+    // LD r16, n16
+    else if ((opcode & 0xCF) == 0x01)
+        emit_store16_imm(reg16_offset(cpu, opcode >> 4), instruction.operand);
+
+    // INC r16 / DEC r16
+    else if ((opcode & 0xC7) == 0x03)
+    {
+        if (opcode & 0x08)
+            emit_dec16(reg16_offset(cpu, opcode >> 4));
+        else
+            emit_inc16(reg16_offset(cpu, opcode >> 4));
+    }
+
+    // DI
+    else if (opcode == 0xF3)
+        emit_store8_imm(offset_of(cpu, &cpu.IME), 0);
+
+    else return false;
+
+    pending_cycles += BASE_OPCODES[opcode].cycles;
+
+    // Handlers keep PC/IR up to date themselves, native code only has to at the end
+    if (last)
+    {
+        emit_store16_imm(pc, instruction.next_address);
+        emit_store8_imm(offset_of(cpu, &cpu.IR), opcode);
+    }
+
+    return true;
+}
+
+void JitCompiler::emit_call(const Cpu::DecodedInstruction& instruction)
+{
+    flush_cycles();
+
+    emit_mov_arg1_cpu();
+    emit_mov_arg2_imm64(reinterpret_cast<uintptr_t>(&instruction));
+    emit_mov_rax_imm64(reinterpret_cast<uintptr_t>(&Cpu::jit_step));
+
+    emit8(0xFF); emit8(0xD0); // call rax
+    emit8(0x01); emit8(0xC3); // add ebx, eax
+}
+
+void JitCompiler::emit_exit_checks(Cpu& cpu)
+{
+    // cmp byte [r12 + exit_requested], 0; jne epilogue
+    emit8(0x41); emit8(0x80);
+    emit_cpu_operand(7, offset_of(cpu, &cpu.exit_requested));
+    emit8(0x00);
+
+    emit8(0x0F); emit8(0x85);
+    exit_jumps.push_back(code.size());
+    emit32(0);
+
+    // cmp byte [r12 + IME], 0; je skip
+    emit8(0x41); emit8(0x80);
+    emit_cpu_operand(7, offset_of(cpu, &cpu.IME));
+    emit8(0x00);
+
+    emit8(0x74);
+    size_t skip = code.size();
+    emit8(0);
+
+    // IE & IF & 0x1F; jnz epilogue
+    emit_mov_rax_imm64(reinterpret_cast<uintptr_t>(&cpu.mem.get_interrupt_flag()));
+    emit8(0x0F); emit8(0xB6); emit8(0x08); // movzx ecx, byte [rax]
+    emit_mov_rax_imm64(reinterpret_cast<uintptr_t>(&cpu.mem.get_interrupt_enable()));
+    emit8(0x22); emit8(0x08); // and cl, [rax]
+    emit8(0xF6); emit8(0xC1); emit8(0x1F); // test cl, 0x1F
+
+    emit8(0x0F); emit8(0x85);
+    exit_jumps.push_back(code.size());
+    emit32(0);
+
+    code[skip] = static_cast<uint8_t>(code.size() - (skip + 1));
+}
+
+void JitCompiler::flush_cycles()
+{
+    if (pending_cycles == 0) return;
+
+    emit_add_ebx_imm32(pending_cycles);
+    pending_cycles = 0;
+}
+
+/* Register Offsets */
+int32_t JitCompiler::offset_of(Cpu& cpu, const void* member)
+{
+    return static_cast<int32_t>(static_cast<const uint8_t*>(member) - reinterpret_cast<const uint8_t*>(&cpu));
+}
+
+// B, C, D, E, H, L, [HL], A
+int32_t JitCompiler::reg8_offset(Cpu& cpu, int index)
+{
+    return offset_of(cpu, &cpu.r8[Cpu::r8_slot(index)]);
+}
+
+// BC, DE, HL, SP
+int32_t JitCompiler::reg16_offset(Cpu& cpu, int index)
+{
+    index &= 0x03;
+
+    return (index == 3) ? offset_of(cpu, &cpu.SP) : offset_of(cpu, &cpu.r16[index]);
+}
+
+/* x86-64 Encoding */
+void JitCompiler::emit16(uint16_t value)
+{
+    emit8(value & 0xFF);
+    emit8(value >> 8);
+}
+
+void JitCompiler::emit32(uint32_t value)
+{
+    emit16(value & 0xFFFF);
+    emit16(value >> 16);
+}
+
+void JitCompiler::emit64(uint64_t value)
+{
+    emit32(value & 0xFFFFFFFF);
+    emit32(value >> 32);
+}
+
+// rbx holds the cycle total, r12 the Cpu pointer. Both are callee-saved on SysV and Win64.
+void JitCompiler::emit_prologue()
+{
+    emit8(0x53); // push rbx
+    emit8(0x41); emit8(0x54); // push r12
+    emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x28); // sub rsp, 40 (shadow space + alignment)
+
+#if defined(_WIN32)
+    emit8(0x49); emit8(0x89); emit8(0xCC); // mov r12, rcx
+#else
+    emit8(0x49); emit8(0x89); emit8(0xFC); // mov r12, rdi
+#endif
+
+    emit8(0x31); emit8(0xDB); // xor ebx, ebx
+}
+
+void JitCompiler::emit_epilogue()
+{
+    emit8(0x89); emit8(0xD8); // mov eax, ebx
+    emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x28); // add rsp, 40
+    emit8(0x41); emit8(0x5C); // pop r12
+    emit8(0x5B); // pop rbx
+    emit8(0xC3); // ret
+}
+
+void JitCompiler::emit_mov_rax_imm64(uint64_t value)
+{
+    emit8(0x48); emit8(0xB8);
+    emit64(value);
+}
+
+void JitCompiler::emit_mov_arg2_imm64(uint64_t value)
+{
+#if defined(_WIN32)
+    emit8(0x48); emit8(0xBA); // mov rdx, imm64
+#else
+    emit8(0x48); emit8(0xBE); // mov rsi, imm64
+#endif
+    emit64(value);
+}
+
+void JitCompiler::emit_mov_arg1_cpu()
+{
+#if defined(_WIN32)
+    emit8(0x4C); emit8(0x89); emit8(0xE1); // mov rcx, r12
+#else
+    emit8(0x4C); emit8(0x89); emit8(0xE7); // mov rdi, r12
+#endif
+}
+
+// ModRM (mod = 10, rm = SIB) + SIB (base = r12) + disp32
+void JitCompiler::emit_cpu_operand(uint8_t reg_field, int32_t disp)
+{
+    emit8(0x84 | (reg_field << 3));
+    emit8(0x24);
+    emit32(static_cast<uint32_t>(disp));
+}
+
+void JitCompiler::emit_load8_ecx(int32_t disp)
+{
+    emit8(0x41); emit8(0x0F); emit8(0xB6); // movzx ecx, byte [r12 + disp]
+    emit_cpu_operand(X64_RCX, disp);
+}
+
+void JitCompiler::emit_store8_cl(int32_t disp)
+{
+    emit8(0x41); emit8(0x88); // mov byte [r12 + disp], cl
+    emit_cpu_operand(X64_RCX, disp);
+}
+
+void JitCompiler::emit_store8_imm(int32_t disp, uint8_t value)
+{
+    emit8(0x41); emit8(0xC6); // mov byte [r12 + disp], imm8
+    emit_cpu_operand(X64_RAX, disp);
+    emit8(value);
+}
+
+void JitCompiler::emit_store16_imm(int32_t disp, uint16_t value)
+{
+    emit8(0x66); emit8(0x41); emit8(0xC7); // mov word [r12 + disp], imm16
+    emit_cpu_operand(X64_RAX, disp);
+    emit16(value);
+}
+
+void JitCompiler::emit_inc16(int32_t disp)
+{
+    emit8(0x66); emit8(0x41); emit8(0xFF); // inc word [r12 + disp]
+    emit_cpu_operand(0, disp);
+}
+
+void JitCompiler::emit_dec16(int32_t disp)
+{
+    emit8(0x66); emit8(0x41); emit8(0xFF); // dec word [r12 + disp]
+    emit_cpu_operand(1, disp);
+}
+
+void JitCompiler::emit_add_ebx_imm32(uint32_t value)
+{
+    emit8(0x81); emit8(0xC3); // add ebx, imm32
+    emit32(value);
+}
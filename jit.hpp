@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "cpu.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GB_JIT_X64 1
+#else
+#define GB_JIT_X64 0
+#endif
+
+constexpr size_t JIT_CODE_SIZE = 8 * 1024 * 1024;
+
+/// @brief Translates hot ROM blocks into x86-64 machine code.
+///
+/// Register-only instructions are emitted natively, everything else calls its
+/// predecoded handler. A compiled block returns early after an instruction that
+/// wrote an IO/MBC register or left an interrupt pending.
+class JitCompiler
+{
+public:
+    JitCompiler();
+    ~JitCompiler();
+
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    /// @returns false if the host is not x86-64 or code memory could not be allocated.
+    bool is_available() const { return code_memory != nullptr; }
+
+    /// @returns true if the last compile failed because code memory ran out.
+    bool is_full() const { return full; }
+
+    /// @brief Compiles a block of predecoded instructions.
+    /// @returns nullptr if the block accesses IO registers, changes IME/halts, or code memory ran out.
+    Cpu::NativeBlock compile(Cpu& cpu, const Cpu::CodeBlock& block);
+
+    /// @brief Discards all compiled code.
+    void reset();
+
+private:
+    uint8_t* code_memory = nullptr;
+    size_t code_used = 0;
+    bool full = false;
+
+    std::vector<uint8_t> code; // Block being emitted
+    std::vector<size_t> exit_jumps; // rel32 fields jumping to the epilogue
+    uint32_t pending_cycles = 0; // Cycles of native instructions not yet added to the total
+
+    static bool is_compilable(const Cpu::DecodedInstruction& instruction);
+
+    /// @brief Switches code memory between writable and executable (never both, for W^X hosts).
+    /// @returns false if the protection could not be changed.
+    bool set_executable(bool executable);
+
+    /* Instruction Translation */
+    bool emit_native(Cpu& cpu, const Cpu::DecodedInstruction& instruction, bool last);
+    void emit_call(const Cpu::DecodedInstruction& instruction);
+    void emit_exit_checks(Cpu& cpu);
+    void flush_cycles();
+
+    /// @returns Offset of an 8/16-bit CPU register from the start of the Cpu object.
+    static int32_t reg8_offset(Cpu& cpu, int index);
+    static int32_t reg16_offset(Cpu& cpu, int index);
+    static int32_t offset_of(Cpu& cpu, const void* member);
+
+    /* x86-64 Encoding */
+    void emit8(uint8_t byte) { code.push_back(byte); }
+    void emit16(uint16_t value);
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+
+    void emit_prologue();
+    void emit_epilogue();
+
+    void emit_mov_rax_imm64(uint64_t value);
+    void emit_mov_arg2_imm64(uint64_t value);
+    void emit_mov_arg1_cpu();
+
+    // Memory operands are [r12 + disp32], r12 holding the Cpu pointer
+    void emit_cpu_operand(uint8_t reg_field, int32_t disp);
+    void emit_load8_ecx(int32_t disp);
+    void emit_store8_cl(int32_t disp);
+    void emit_store8_imm(int32_t disp, uint8_t value);
+    void emit_store16_imm(int32_t disp, uint16_t value);
+    void emit_inc16(int32_t disp);
+    void emit_dec16(int32_t disp);
+    void emit_add_ebx_imm32(uint32_t value);
+};
@@ -3,26 +3,47 @@
 Joypad::Joypad(Mmu& _mmu) : 
     mmu(_mmu),
     joypad_input(mmu.read_io_reg(JOYPAD_INPUT))
-{}
+{
+    // Lower nibble is read-only and follows the select bits
+    mmu.set_io_write_handler(JOYPAD_INPUT, [this](uint8_t byte) {
+        joypad_input &= 0xF;
+        joypad_input |= (byte & 0xF0);
+        update_input();
+    });
+
+    mmu.set_io_read_handler(JOYPAD_INPUT, [this]() {
+        update_input();
+        return joypad_input;
+    });
+}
 
 void Joypad::handle_inputs(const bool* state)
 {
-    if (is_dpad_selected())
-    {
-        set_key(GBJoypad::DPAD_UP, state[SDL_SCANCODE_W]);
-        set_key(GBJoypad::DPAD_DOWN, state[SDL_SCANCODE_S]);
-        set_key(GBJoypad::DPAD_LEFT, state[SDL_SCANCODE_A]);
-        set_key(GBJoypad::DPAD_RIGHT, state[SDL_SCANCODE_D]);
-    }
-    else if (is_buttons_selected())
-    {
-        set_key(GBJoypad::BUTTON_B, state[SDL_SCANCODE_J]);
-        set_key(GBJoypad::BUTTON_A, state[SDL_SCANCODE_K]);
-        set_key(GBJoypad::BUTTON_SELECT, state[SDL_SCANCODE_SPACE]);
-        set_key(GBJoypad::BUTTON_START, state[SDL_SCANCODE_RETURN]);
-    }
+    auto sample = [state](int key, uint8_t input_bit) -> uint8_t { return state[key] ? 0 : input_bit; };
+
+    dpad_keys = sample(GBInput::DPAD_UP, GBJoypad::DPAD_UP) |
+        sample(GBInput::DPAD_DOWN, GBJoypad::DPAD_DOWN) |
+        sample(GBInput::DPAD_LEFT, GBJoypad::DPAD_LEFT) |
+        sample(GBInput::DPAD_RIGHT, GBJoypad::DPAD_RIGHT);
+
+    button_keys = sample(GBInput::BUTTON_B, GBJoypad::BUTTON_B) |
+        sample(GBInput::BUTTON_A, GBJoypad::BUTTON_A) |
+        sample(GBInput::BUTTON_SELECT, GBJoypad::BUTTON_SELECT) |
+        sample(GBInput::BUTTON_START, GBJoypad::BUTTON_START);
+
+    update_input();
 }
 
+// With both groups selected a key of either pulls its line low, with none all lines read high.
+void Joypad::update_input()
+{
+    uint8_t keys = 0x0F;
+    if (is_dpad_selected()) keys &= dpad_keys;
+    if (is_buttons_selected()) keys &= button_keys;
+
+    for (uint8_t input_bit = 0x01; input_bit <= 0x08; input_bit <<= 1)
+        set_key(input_bit, (keys & input_bit) == 0);
+}
 void Joypad::reset_input()
 {
     joypad_input |= (GBJoypad::DPAD_UP |
@@ -49,6 +49,7 @@ public:
     Joypad(Mmu& _mmu);
 
     /* Input Handling */
+    /// @brief Samples the keyboard, which the low nibble of JOYP reflects until the next call.
     void handle_inputs(const bool* keyboard);
     
     void set_key(uint8_t input_bit, bool cond);
@@ -73,4 +74,11 @@ private:
     Mmu& mmu;
 
     uint8_t& joypad_input;
+
+    // Last sampled keys, 0 = pressed, so a game switching groups mid-frame reads the other group too
+    uint8_t dpad_keys = 0x0F;
+    uint8_t button_keys = 0x0F;
+
+    /// @brief Sets the low nibble of JOYP from the sampled keys of the selected group(s).
+    void update_input();
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "gameboy.hpp"
+#include "unit_tests.hpp"
 
 int main(int argc, char** argv)
 {
@@ -12,6 +13,9 @@ int main(int argc, char** argv)
 
     std::string rom_file = std::string(argv[1]);
 
+    if (rom_file == "--unit-tests")
+        return GBTests::run_unit_tests() ? 0 : 1;
+
     std::string save_file{};
     if (argc > 2)
         save_file = std::string(argv[2]);
@@ -19,5 +23,5 @@ int main(int argc, char** argv)
     Gameboy gameboy("./test_roms/" + rom_file, save_file);
     gameboy.run();
 
-    return 0;
+    return gameboy.is_locked_up() ? 1 : 0;
 }
\ No newline at end of file
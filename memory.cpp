@@ -4,11 +4,16 @@
 #include <filesystem>
 #include <iostream>
 #include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
 
 Mmu::Mmu(Cartridge* _cartridge) : 
     cartridge(_cartridge)
 {
     initialize_memory();
+    map_pages();
+    set_default_io_handlers();
 }
 
 void Mmu::initialize_memory()
@@ -26,6 +31,8 @@ void Mmu::load_cartridge(Cartridge* new_cartridge)
 {
     cartridge = new_cartridge;
     std::copy(cartridge->rom.begin(), cartridge->rom.begin() + BANK_N_START, rom_data.begin());
+
+    map_rom_pages();
 }
 
 bool Mmu::load_boot_rom(const std::string& path)
@@ -53,17 +60,371 @@ bool Mmu::load_boot_rom(const std::string& path)
 
 void Mmu::dma_transfer(uint8_t source)
 {
-    // Should I worry about DMA bus conflicts??
-    uint16_t source_address = (source << 8);
-    for (int i = 0; i < 0xA0; ++i)
+    // A transfer restarted mid-way reads its source like a fresh one
+    if (dma_cycles_left)
+    {
+        dma_cycles_left = 0;
+        map_pages();
+    }
+
+    // Nothing can change the source or OAM until the transfer ends, so copying it all at once
+    // is indistinguishable from copying a byte per M-cycle. The source never crosses a page.
+    if (const uint8_t* page = read_pages[source])
+        std::memcpy(oam_data.data(), page, DMA_LENGTH);
+    else
+    {
+        uint16_t source_address = (source << 8);
+        for (int i = 0; i < DMA_LENGTH; ++i)
+            oam_data[i] = read_region(source_address + i);
+    }
+
+    mark_dirty(OAM_START);
+    ++stats.dma_transfers;
+
+    dma_cycles_left = DMA_CYCLES;
+    dma_starting = true;
+
+    // Leave every access to the slow path, which only lets the IO registers and HRAM through
+    read_pages.fill(nullptr);
+    write_pages.fill(nullptr);
+}
+
+void Mmu::advance_dma(uint32_t cycles)
+{
+    if (dma_starting)
+    {
+        dma_starting = false;
+        return;
+    }
+
+    dma_cycles_left = (cycles < dma_cycles_left) ? dma_cycles_left - cycles : 0;
+
+    if (!dma_cycles_left)
+        map_pages();
+}
+
+/* Page Table */
+void Mmu::map_pages()
+{
+    // Everything is mapped again once OAM DMA ends
+    if (dma_cycles_left) return;
+
+    read_pages.fill(nullptr);
+    write_pages.fill(nullptr);
+
+    map_rom_pages();
+
+    for (size_t page = VRAM_START >> 8; page <= VRAM_END >> 8; ++page)
+        map_vram_page(static_cast<uint8_t>(page));
+
+    for (size_t page = WORK_RAM_START >> 8; page <= WORK_RAM_END >> 8; ++page)
+        map_work_ram_page(static_cast<uint8_t>(page));
+}
+
+void Mmu::map_rom_pages()
+{
+    if (dma_cycles_left) return;
+
+    const uint8_t* bank_zero = rom_data.data();
+    const uint8_t* bank_n = rom_data.data() + BANK_N_START;
+
+    if (cartridge)
+    {
+        bank_zero = cartridge->get_rom_bank_data(BANK_ZERO_START);
+        bank_n = cartridge->get_rom_bank_data(BANK_N_START);
+    }
+
+    for (size_t page = 0; page < BANK_SIZE >> 8; ++page)
+    {
+        map_page(page, bank_zero ? bank_zero + (page << 8) : nullptr, nullptr);
+        map_page(page + (BANK_N_START >> 8), bank_n ? bank_n + (page << 8) : nullptr, nullptr);
+    }
+}
+
+void Mmu::map_work_ram_page(uint8_t page)
+{
+    if (dma_cycles_left) return;
+
+    uint8_t* data = work_ram.data() + (page << 8) - WORK_RAM_START;
+
+    // Writes to watched pages have to invalidate the code cached from them
+    uint8_t* writable = (code_pages[page] || clean_pages[page]) ? nullptr : data;
+
+    map_page(page, data, writable);
+
+    // Echo RAM mirrors all but the last 512 bytes of WRAM
+    size_t echo_page = page + ((ECHO_RAM_START - WORK_RAM_START) >> 8);
+    if (echo_page <= (ECHO_RAM_END >> 8))
+        map_page(echo_page, data, writable);
+}
+
+void Mmu::map_vram_page(uint8_t page)
+{
+    if (dma_cycles_left) return;
+
+    uint8_t* data = vram.data() + (page << 8) - VRAM_START;
+    map_page(page, data, clean_pages[page] ? nullptr : data);
+}
+
+void Mmu::watch_code_page(uint8_t page, bool watch)
+{
+    code_pages.set(page, watch);
+
+    if (page >= (WORK_RAM_START >> 8) && page <= (WORK_RAM_END >> 8))
+        map_work_ram_page(page);
+}
+
+/* Dirty Page Tracking */
+// VRAM, WRAM, OAM and HRAM
+static std::bitset<256> tracked_pages()
+{
+    std::bitset<256> pages{};
+
+    for (size_t page = VRAM_START >> 8; page <= VRAM_END >> 8; ++page)
+        pages.set(page);
+    for (size_t page = WORK_RAM_START >> 8; page <= WORK_RAM_END >> 8; ++page)
+        pages.set(page);
+
+    pages.set(OAM_START >> 8);
+    pages.set(HIGH_RAM_START >> 8);
+
+    return pages;
+}
+
+size_t Mmu::add_dirty_tracker()
+{
+    auto it = std::find_if(dirty_trackers.begin(), dirty_trackers.end(),
+        [](const DirtyTracker& tracker) { return !tracker.active; });
+
+    if (it == dirty_trackers.end())
+        it = dirty_trackers.insert(it, DirtyTracker{});
+
+    it->active = true;
+    it->pages.memory = tracked_pages();
+    it->pages.cart_ram.set();
+
+    return static_cast<size_t>(it - dirty_trackers.begin());
+}
+
+void Mmu::remove_dirty_tracker(size_t tracker)
+{
+    dirty_trackers.at(tracker).active = false;
+    update_clean_pages();
+}
+
+const DirtyPages& Mmu::get_dirty_pages(size_t tracker)
+{
+    collect_cart_ram_writes();
+    return dirty_trackers.at(tracker).pages;
+}
+
+void Mmu::clear_dirty_pages(size_t tracker)
+{
+    // Writes not passed on yet still count for the other trackers
+    collect_cart_ram_writes();
+
+    DirtyPages& pages = dirty_trackers.at(tracker).pages;
+    pages.memory.reset();
+    pages.cart_ram.reset();
+
+    update_clean_pages();
+}
+
+void Mmu::mark_all_dirty()
+{
+    for (DirtyTracker& tracker : dirty_trackers)
+    {
+        tracker.pages.memory = tracked_pages();
+        tracker.pages.cart_ram.set();
+    }
+
+    update_clean_pages();
+}
+
+void Mmu::mark_dirty(int address)
+{
+    // Neither the unusable area nor the IO registers/IE count
+    if ((address > OAM_END && address < HIGH_RAM_START) || address > HIGH_RAM_END) return;
+
+    uint8_t page = (address >> 8) & 0xFF;
+
+    // Echo RAM writes land in WRAM
+    if (page >= (ECHO_RAM_START >> 8) && page <= (ECHO_RAM_END >> 8))
+        page -= (ECHO_RAM_START - WORK_RAM_START) >> 8;
+
+    if (!clean_pages[page]) return;
+
+    for (DirtyTracker& tracker : dirty_trackers)
+    {
+        if (tracker.active)
+            tracker.pages.memory.set(page);
+    }
+
+    // Dirty for every tracker now, so further writes can take the fast path
+    clean_pages.reset(page);
+
+    if (page >= (VRAM_START >> 8) && page <= (VRAM_END >> 8))
+        map_vram_page(page);
+    else if (page >= (WORK_RAM_START >> 8) && page <= (WORK_RAM_END >> 8))
+        map_work_ram_page(page);
+}
+
+void Mmu::update_clean_pages()
+{
+    std::bitset<256> dirty_everywhere{};
+    dirty_everywhere.set();
+
+    bool tracking = false;
+    for (const DirtyTracker& tracker : dirty_trackers)
+    {
+        if (!tracker.active) continue;
+
+        dirty_everywhere &= tracker.pages.memory;
+        tracking = true;
+    }
+
+    clean_pages = tracking ? (tracked_pages() & ~dirty_everywhere) : std::bitset<256>{};
+
+    map_pages();
+}
+
+void Mmu::collect_cart_ram_writes()
+{
+    if (!cartridge) return;
+
+    auto written = cartridge->take_written_ram_pages();
+    if (written.none()) return;
+
+    for (DirtyTracker& tracker : dirty_trackers)
     {
-        uint8_t byte = read_byte(source_address + i);
-        write_byte(byte, OAM_START + i);
+        if (tracker.active)
+            tracker.pages.cart_ram |= written;
     }
 }
 
+/* Access Traps */
+void Mmu::set_page_traps(const std::bitset<256>& read, const std::bitset<256>& write)
+{
+    read_traps = read;
+    write_traps = write;
+
+    map_pages();
+}
+
+/* Bulk Access */
+uint8_t* Mmu::plain_span(uint16_t address, uint16_t length, bool write)
+{
+    uint16_t last = address + length - 1;
+
+    if (dma_cycles_left && address < HIGH_RAM_START) return nullptr;
+    if ((write ? write_traps : read_traps)[address >> 8]) return nullptr;
+
+    // The first write to a clean page has to mark it dirty
+    if (write && clean_pages[address >> 8]) return nullptr;
+
+    if (address >= VRAM_START && last <= VRAM_END)
+        return vram.data() + (address - VRAM_START);
+    if (address >= OAM_START && last <= OAM_END)
+        return oam_data.data() + (address - OAM_START);
+
+    // Writes to watched pages have to invalidate the code cached from them
+    if (write && code_pages[address >> 8]) return nullptr;
+
+    if (address >= WORK_RAM_START && last <= WORK_RAM_END)
+        return work_ram.data() + (address - WORK_RAM_START);
+    if (address >= HIGH_RAM_START && last <= HIGH_RAM_END)
+        return high_ram.data() + (address - HIGH_RAM_START);
+
+    return nullptr;
+}
+
+void Mmu::copy_block(uint16_t destination, uint16_t source, uint32_t length)
+{
+    while (length > 0)
+    {
+        // Chunks never cross a page, so each one lies in a single region
+        uint16_t chunk = static_cast<uint16_t>(std::min<uint32_t>({
+            length, 0x100u - (destination & 0xFF), 0x100u - (source & 0xFF) }));
+
+        uint8_t* dst = plain_span(destination, chunk, true);
+        uint8_t* src = plain_span(source, chunk, false);
+
+        // A destination just above the source repeats bytes already copied, which memmove would not
+        if (dst && src && !(dst > src && dst < src + chunk))
+        {
+            std::memmove(dst, src, chunk);
+            count_block_access(source, chunk, false);
+            count_block_access(destination, chunk, true);
+        }
+        else if (dst)
+        {
+            for (uint16_t i = 0; i < chunk; ++i)
+                dst[i] = read_byte(source + i);
+
+            count_block_access(destination, chunk, true);
+        }
+        else
+        {
+            for (uint16_t i = 0; i < chunk; ++i)
+                write_byte(read_byte(source + i), destination + i);
+        }
+
+        destination += chunk;
+        source += chunk;
+        length -= chunk;
+    }
+}
+
+void Mmu::fill_block(uint16_t destination, uint8_t byte, uint32_t length)
+{
+    while (length > 0)
+    {
+        uint16_t chunk = static_cast<uint16_t>(std::min<uint32_t>(length, 0x100u - (destination & 0xFF)));
+
+        if (uint8_t* dst = plain_span(destination, chunk, true))
+        {
+            std::memset(dst, byte, chunk);
+            count_block_access(destination, chunk, true);
+        }
+        else
+        {
+            for (uint16_t i = 0; i < chunk; ++i)
+                write_byte(byte, destination + i);
+        }
+
+        destination += chunk;
+        length -= chunk;
+    }
+}
+
+uint16_t Mmu::get_rom_bank(uint16_t address) const
+{
+    if (cartridge) return cartridge->get_rom_bank(address);
+    
+    return address / BANK_SIZE;
+}
+
+uint16_t Mmu::get_bank(uint16_t address) const
+{
+    if (address <= BANK_N_END) return get_rom_bank(address);
+    if (address >= CARTRIDGE_RAM_START && address <= CARTRIDGE_RAM_END && cartridge) return cartridge->get_ram_bank();
+
+    return 0;
+}
+
 /* Writing from memory */
-void Mmu::write_byte(uint8_t byte, int address)
+void Mmu::write_unmapped(uint8_t byte, int address)
+{
+    if (dma_cycles_left && address < IO_REGISTERS_START) return;
+
+    write_region(byte, address);
+    mark_dirty(address);
+
+    if (write_traps[(address >> 8) & 0xFF] && access_trap_callback)
+        access_trap_callback(static_cast<uint16_t>(address), byte, true);
+}
+
+void Mmu::write_region(uint8_t byte, int address)
 {
     switch (address & 0xF000)
     {
@@ -77,6 +438,10 @@ void Mmu::write_byte(uint8_t byte, int address)
     case 0x6000:
     case 0x7000:
         cartridge->memory_write(byte, address);
+        map_rom_pages();
+
+        // MBC register writes can remap code
+        if (code_write_callback) code_write_callback(address);
         break;
     
     /* VRAM */
@@ -96,26 +461,43 @@ void Mmu::write_byte(uint8_t byte, int address)
     case 0xC000:
     case 0xD000:
         work_ram.at(address - 0xC000) = byte;
+        notify_code_write(address);
         break;
     
     /* Echo RAM */
     case 0xE000:
         work_ram.at(address - 0xE000) = byte;
+        notify_code_write(address - 0x2000);
         break;
     
     case 0xF000:
-        if (address <= ECHO_RAM_END)
+        // HRAM shares its page with the IO registers, so it is checked first
+        if (address >= HIGH_RAM_START && address <= HIGH_RAM_END)
+        {
+            high_ram[address - HIGH_RAM_START] = byte;
+            notify_code_write(address);
+        }
+        else if (address <= ECHO_RAM_END)
+        {
             work_ram.at(address - 0xE000) = byte;
+            notify_code_write(address - 0x2000);
+        }
         else if (address <= OAM_END)
             oam_data.at(address - OAM_START) = byte;
         else if (address <= UNUSABLE_END)
             std::cout << "Illegal write to UNUSABLE @ " << std::hex << address << '\n';
         else if (address <= IO_REGISTERS_END)
+        {
             write_io_reg(byte, address);
-        else if (address <= HIGH_RAM_END)
-            high_ram.at(address - HIGH_RAM_START) = byte;
+
+            // IO writes can change timing/interrupt state that compiled code assumes is fixed
+            if (code_write_callback) code_write_callback(address);
+        }
         else 
+        {
             interrupt_enable = byte;
+            if (code_write_callback) code_write_callback(address);
+        }
         
         break;
     }
@@ -123,38 +505,65 @@ void Mmu::write_byte(uint8_t byte, int address)
 
 void Mmu::write_io_reg(uint8_t byte, int address)
 {
+    const IoHandler& handler = io_handlers.at(address - IO_REGISTERS_START);
 
-    switch(address)
-    {
-    // Lower nibble is read-only
-    case JOYPAD_INPUT:
-        {
-            uint8_t& joypad_input = io_registers.at(JOYPAD_INPUT - IO_REGISTERS_START);
-            joypad_input &= 0xF;
-            joypad_input |= (byte & 0xF0);
-        }
-        break;
-    
-    case LCD_STATUS:
-        io_registers.at(LCD_STATUS - IO_REGISTERS_START) = byte & 0xF8;
-        break;
+    if (handler.write)
+        handler.write(byte);
+    else
+        io_registers[address - IO_REGISTERS_START] = byte;
+}
 
-    case LCD_Y_COORDINATE:
-        break;
+/* IO Register Handlers */
+void Mmu::set_io_write_handler(uint16_t address, std::function<void(uint8_t)> handler)
+{
+    io_handlers.at(address - IO_REGISTERS_START).write = std::move(handler);
+}
 
-    case DMA:
-        io_registers.at(DMA - IO_REGISTERS_START) = byte;
-        dma_transfer(byte);
-        break;
+void Mmu::set_io_read_handler(uint16_t address, std::function<uint8_t()> handler)
+{
+    io_handlers.at(address - IO_REGISTERS_START).read = std::move(handler);
+}
 
-    default:
-        io_registers.at(address - IO_REGISTERS_START) = byte;
-        break;
-    }
+// Registers the MMU itself owns. The PPU, timer etc. register theirs on construction.
+void Mmu::set_default_io_handlers()
+{
+    // Lower nibble is read-only
+    set_io_write_handler(JOYPAD_INPUT, [this](uint8_t byte) {
+        uint8_t& joypad_input = io_registers[JOYPAD_INPUT - IO_REGISTERS_START];
+        joypad_input &= 0xF;
+        joypad_input |= (byte & 0xF0);
+    });
+
+    set_io_write_handler(DMA, [this](uint8_t byte) {
+        io_registers[DMA - IO_REGISTERS_START] = byte;
+        dma_transfer(byte);
+    });
 }
 
 /* Reading from memory */
-uint8_t Mmu::read_byte(int address) 
+uint8_t Mmu::read_unmapped(int address)
+{
+    // During OAM DMA the CPU can only reach the IO registers and HRAM
+    if (dma_cycles_left && address < IO_REGISTERS_START) return 0xFF;
+
+    uint8_t value = read_region(address);
+
+    if (read_traps[(address >> 8) & 0xFF] && access_trap_callback)
+        access_trap_callback(static_cast<uint16_t>(address), value, false);
+
+    return value;
+}
+
+uint8_t Mmu::peek_byte(uint16_t address)
+{
+    // IO read handlers can have effects of their own
+    if (address >= IO_REGISTERS_START && address <= IO_REGISTERS_END)
+        return io_registers[address - IO_REGISTERS_START];
+
+    return read_region(address);
+}
+
+uint8_t Mmu::read_region(int address) 
 { 
     switch (address & 0xF000)
     {
@@ -190,7 +599,10 @@ uint8_t Mmu::read_byte(int address)
         return work_ram.at(address - 0xE000);
     
     case 0xF000:
-        if (address <= ECHO_RAM_END)
+        // HRAM shares its page with the IO registers, so it is checked first
+        if (address >= HIGH_RAM_START && address <= HIGH_RAM_END)
+            return high_ram[address - HIGH_RAM_START];
+        else if (address <= ECHO_RAM_END)
             return work_ram.at(address - 0xE000);
         else if (address <= OAM_END)
             return oam_data.at(address - OAM_START);
@@ -201,19 +613,10 @@ uint8_t Mmu::read_byte(int address)
         }
         else if (address <= IO_REGISTERS_END)
         {
-            switch(address)
-            {
-                case JOYPAD_INPUT:
-                    if ((JOYPAD_INPUT & 0x30) == 0x30)
-                        return 0x3F;
-                    else 
-                        return io_registers.at(JOYPAD_INPUT - IO_REGISTERS_START);
-                default:
-                    return io_registers.at(address - IO_REGISTERS_START);
-            } 
+            const IoHandler& handler = io_handlers[address - IO_REGISTERS_START];
+
+            return handler.read ? handler.read() : io_registers[address - IO_REGISTERS_START];
         }
-        else if (address <= HIGH_RAM_END)
-            return high_ram.at(address - HIGH_RAM_START);
         else 
             return interrupt_enable;
     
@@ -223,6 +626,70 @@ uint8_t Mmu::read_byte(int address)
     }
 }
 
+/* Access Statistics */
+MemoryStats Mmu::get_memory_stats() const
+{
+    MemoryStats totals = stats;
+    if (cartridge) totals.banks = cartridge->get_bank_switch_stats();
+
+    return totals;
+}
+
+MemoryStats MemoryStats::operator-(const MemoryStats& earlier) const
+{
+    MemoryStats difference = *this;
+
+    for (size_t i = 0; i < MEMORY_REGION_COUNT; ++i)
+    {
+        difference.reads[i] -= earlier.reads[i];
+        difference.writes[i] -= earlier.writes[i];
+    }
+
+    for (size_t i = 0; i < IO_REGISTERS_SIZE; ++i)
+    {
+        difference.io_reads[i] -= earlier.io_reads[i];
+        difference.io_writes[i] -= earlier.io_writes[i];
+    }
+
+    difference.banks.register_writes -= earlier.banks.register_writes;
+    difference.banks.rom_switches -= earlier.banks.rom_switches;
+    difference.banks.ram_switches -= earlier.banks.ram_switches;
+    difference.dma_transfers -= earlier.dma_transfers;
+
+    return difference;
+}
+
+void MemoryStats::print(std::ostream& out) const
+{
+#if GB_PROFILE_MEMORY
+    char line[64];
+
+    out << "Region       Reads      Writes\n";
+    for (size_t i = 0; i < MEMORY_REGION_COUNT; ++i)
+    {
+        std::snprintf(line, sizeof(line), "%-6s %11llu %11llu\n", memory_region_name(static_cast<MemoryRegion>(i)),
+            static_cast<unsigned long long>(reads[i]), static_cast<unsigned long long>(writes[i]));
+        out << line;
+    }
+
+    // Only registers that were accessed at all
+    for (size_t i = 0; i < IO_REGISTERS_SIZE; ++i)
+    {
+        if (!io_reads[i] && !io_writes[i]) continue;
+
+        std::snprintf(line, sizeof(line), "  $%04X %11llu %11llu\n", static_cast<unsigned>(IO_REGISTERS_START + i),
+            static_cast<unsigned long long>(io_reads[i]), static_cast<unsigned long long>(io_writes[i]));
+        out << line;
+    }
+#else
+    out << "Region access counts are disabled, build with GB_PROFILE_MEMORY=1\n";
+#endif
+
+    out << "MBC register writes: " << banks.register_writes << " (" << banks.rom_switches << " ROM bank switches, "
+        << banks.ram_switches << " RAM bank switches)\n";
+    out << "OAM DMA transfers: " << dma_transfers << '\n';
+}
+
 uint8_t& Mmu::read_io_reg(int address) 
 { 
     return io_registers.at(address - IO_REGISTERS_START);
@@ -4,11 +4,24 @@
 
 #include <cstdint>
 #include <array>
+#include <bitset>
+#include <functional>
 #include <iostream>
+#include <vector>
+
+// Build with -DGB_PROFILE_MEMORY=1 to count CPU reads and writes per memory region
+// and IO register. Disabled builds contain none of it.
+#ifndef GB_PROFILE_MEMORY
+#define GB_PROFILE_MEMORY 0
+#endif
 
 /// @todo Add namespaces
 constexpr size_t MEMORY_SIZE = 0x10000;
 
+/* Page Table */
+constexpr size_t MEMORY_PAGE_SIZE = 0x100;
+constexpr size_t MEMORY_PAGE_COUNT = MEMORY_SIZE / MEMORY_PAGE_SIZE;
+
 constexpr uint16_t BOOT_ROM_START = 0x0000;
 constexpr uint16_t BOOT_ROM_END = 0x00FF;
 
@@ -109,6 +122,8 @@ constexpr uint16_t LCD_Y_COORDINATE = 0xFF44;
 constexpr uint16_t LY_COMPARE = 0xFF45;
 
 constexpr uint16_t DMA = 0xFF46;
+constexpr uint16_t DMA_LENGTH = 0xA0; // Bytes copied to OAM
+constexpr uint32_t DMA_CYCLES = 640; // T-cycles the CPU is locked out of the bus for
 
 // Palatte Data
 constexpr uint16_t BG_PALETTE = 0xFF47;
@@ -127,6 +142,78 @@ constexpr uint16_t HIGH_RAM_START = 0xFF80;
 constexpr uint16_t HIGH_RAM_END = 0xFFFE;
 constexpr uint16_t HIGH_RAM_SIZE = HIGH_RAM_END - HIGH_RAM_START + 1;
 
+/* Memory Regions */
+enum class MemoryRegion : uint8_t
+{
+    Rom0, // 0x0000-0x3FFF
+    RomX, // 0x4000-0x7FFF
+    Vram,
+    Sram, // Cartridge RAM
+    Wram, // Echo RAM included
+    Oam, // Unusable memory included
+    Io, // IE included
+    Hram
+};
+
+constexpr size_t MEMORY_REGION_COUNT = 8;
+
+constexpr MemoryRegion memory_region(uint16_t address)
+{
+    if (address <= BANK_ZERO_END) return MemoryRegion::Rom0;
+    if (address <= BANK_N_END) return MemoryRegion::RomX;
+    if (address <= VRAM_END) return MemoryRegion::Vram;
+    if (address <= CARTRIDGE_RAM_END) return MemoryRegion::Sram;
+    if (address <= ECHO_RAM_END) return MemoryRegion::Wram;
+    if (address <= UNUSABLE_END) return MemoryRegion::Oam;
+    if (address <= IO_REGISTERS_END || address == INTERRUPT_ENABLE) return MemoryRegion::Io;
+
+    return MemoryRegion::Hram;
+}
+
+constexpr const char* memory_region_name(MemoryRegion region)
+{
+    switch (region)
+    {
+    case MemoryRegion::Rom0: return "ROM0";
+    case MemoryRegion::RomX: return "ROMX";
+    case MemoryRegion::Vram: return "VRAM";
+    case MemoryRegion::Sram: return "SRAM";
+    case MemoryRegion::Wram: return "WRAM";
+    case MemoryRegion::Oam: return "OAM";
+    case MemoryRegion::Io: return "IO";
+    case MemoryRegion::Hram: return "HRAM";
+    default: return "none";
+    }
+}
+
+/// @brief Memory access counters, either totals or the difference between two snapshots.
+struct MemoryStats
+{
+    // CPU accesses through the MMU, only counted with GB_PROFILE_MEMORY
+    std::array<uint64_t, MEMORY_REGION_COUNT> reads{}; // By MemoryRegion
+    std::array<uint64_t, MEMORY_REGION_COUNT> writes{};
+    std::array<uint64_t, IO_REGISTERS_SIZE> io_reads{}; // By register, from 0xFF00
+    std::array<uint64_t, IO_REGISTERS_SIZE> io_writes{};
+
+    BankSwitchStats banks;
+    uint64_t dma_transfers = 0;
+
+    MemoryStats operator-(const MemoryStats& earlier) const;
+
+    void print(std::ostream& out) const;
+};
+
+/// @brief Pages written since a dirty page tracker was added or last cleared.
+struct DirtyPages
+{
+    // 256-byte pages of the address space, for VRAM, WRAM, OAM and HRAM.
+    // Echo RAM writes mark the WRAM page they land in.
+    std::bitset<MEMORY_PAGE_COUNT> memory{};
+
+    // 256-byte pages of cartridge RAM, by offset into it
+    std::bitset<Cartridge::RAM_PAGE_COUNT> cart_ram{};
+};
+
 /// @brief Handles reads and writes to the Game Boy's addressable memory.
 /// Provides functions for accessing memory and loading cartridge/ROM data into memory.
 class Mmu
@@ -134,22 +221,136 @@ class Mmu
 public:
     Mmu(Cartridge* cartridge);
 
+    // The page table points into this object
+    Mmu(const Mmu&) = delete;
+    Mmu& operator=(const Mmu&) = delete;
+
     void initialize_memory();
 
     /* Writing to memory */
-    void write_byte(uint8_t byte, int address);
+    void write_byte(uint8_t byte, int address)
+    {
+        count_access(address, true);
+
+        if (uint8_t* page = write_pages[(address >> 8) & 0xFF])
+            page[address & 0xFF] = byte;
+        else
+            write_unmapped(byte, address);
+    }
+
     void write_io_reg(uint8_t byte, int address);
 
     /* Reading from memory */
-    uint8_t read_byte(int address);
+    uint8_t read_byte(int address)
+    {
+        count_access(address, false);
+
+        if (const uint8_t* page = read_pages[(address >> 8) & 0xFF])
+            return page[address & 0xFF];
+
+        return read_unmapped(address);
+    }
+
     uint8_t& read_io_reg(int address);
 
+    /// @brief Reads memory the way the CPU sees it outside of OAM DMA, without counting the access,
+    /// firing debugger traps or calling IO read handlers. For tools inspecting the emulated machine.
+    uint8_t peek_byte(uint16_t address);
+
+    /// @brief Reads VRAM or OAM (0x8000-0x9FFF, 0xFE00-0xFE9F) the way the PPU sees it,
+    /// i.e. unaffected by OAM DMA locking the CPU out of the bus.
+    uint8_t read_video(uint16_t address) const
+    {
+        return (address >= OAM_START) ? oam_data[address - OAM_START] : vram[address - VRAM_START];
+    }
+
     /* Loading programs into memory */
     void load_cartridge(Cartridge* cartridge);
+
+    /// @brief Maps the cartridge's ROM banks again, after they changed other than through an MBC write (e.g. ROM patches).
+    void remap_rom() { map_rom_pages(); }
     bool load_boot_rom(const std::string& path);
 
+    /* OAM DMA */
+    /// @brief Copies 160 bytes from `source` << 8 to OAM, then locks the CPU out of
+    /// everything but the IO registers and HRAM for the length of the transfer.
     void dma_transfer(uint8_t source);
 
+    /// @brief Advances a running OAM DMA transfer by a given number of cycles.
+    void tick_dma(uint32_t cycles)
+    {
+        if (dma_cycles_left) advance_dma(cycles);
+    }
+
+    /// @returns Number of cycles until the running OAM DMA transfer ends, UINT32_MAX if there is none.
+    uint32_t cycles_until_dma_end() const { return dma_cycles_left ? dma_cycles_left : UINT32_MAX; }
+
+    bool is_dma_active() const { return dma_cycles_left != 0; }
+
+    /* Bulk Access */
+    /// @brief Copies `length` bytes in ascending order, with the same result as
+    /// reading and writing them one at a time (overlapping ranges included).
+    void copy_block(uint16_t destination, uint16_t source, uint32_t length);
+
+    /// @brief Writes `byte` to `length` consecutive addresses, like as many write_byte calls.
+    void fill_block(uint16_t destination, uint8_t byte, uint32_t length);
+
+    /// @returns ROM bank currently mapped at address (0x0000-0x7FFF).
+    uint16_t get_rom_bank(uint16_t address) const;
+
+    /// @returns ROM bank mapped at a ROM address, external RAM bank mapped at 0xA000-0xBFFF, 0 elsewhere.
+    uint16_t get_bank(uint16_t address) const;
+
+    /* IO Register Handlers */
+    /// @brief Makes CPU writes to an IO register (0xFF00-0xFF7F) call `handler` instead of storing the
+    /// byte, so the unit owning it can mask it, start a transfer or update state derived from it.
+    void set_io_write_handler(uint16_t address, std::function<void(uint8_t)> handler);
+
+    /// @brief Makes CPU reads of an IO register return what `handler` returns instead of the stored value.
+    void set_io_read_handler(uint16_t address, std::function<uint8_t()> handler);
+
+    /* Code Write Notifications */
+    /// @brief Sets the function called on MBC/IO register writes and on writes to watched pages.
+    void set_code_write_callback(std::function<void(uint16_t)> callback) { code_write_callback = std::move(callback); }
+
+    /// @brief Starts/stops notifying writes to a 256-byte page of WRAM/HRAM.
+    void watch_code_page(uint8_t page, bool watch);
+
+    /* Dirty Page Tracking */
+    /// @brief Starts tracking written pages for a new consumer (e.g. incremental save states,
+    /// battery autosave or a renderer cache), with every page dirty to begin with.
+    /// @returns Id of the tracker.
+    size_t add_dirty_tracker();
+    void remove_dirty_tracker(size_t tracker);
+
+    /// @returns Pages written since the tracker was added or last cleared.
+    const DirtyPages& get_dirty_pages(size_t tracker);
+
+    /// @brief Marks every page clean for one tracker, leaving the others as they are.
+    void clear_dirty_pages(size_t tracker);
+
+    /// @brief Marks every page dirty for every tracker, e.g. after memory was replaced without going through the MMU.
+    void mark_all_dirty();
+
+    /* Access Traps */
+    /// @brief Sets the function called after every CPU read/write of a trapped page,
+    /// with the address, the byte read or written and whether it was a write.
+    void set_access_trap_callback(std::function<void(uint16_t, uint8_t, bool)> callback) { access_trap_callback = std::move(callback); }
+
+    /// @brief Sets which 256-byte pages have their reads/writes trapped. Trapped pages are
+    /// unmapped from the page table, so untrapped ones cost nothing extra.
+    void set_page_traps(const std::bitset<256>& read, const std::bitset<256>& write);
+
+    /* Access Statistics */
+    /// @returns Access counters since power on. Region and IO register counts stay 0 unless
+    /// built with GB_PROFILE_MEMORY.
+    MemoryStats get_memory_stats() const;
+
+    /* Raw Memory */
+    /// @returns WRAM/HRAM as they are, without going through the bus (e.g. for memory searches).
+    const std::array<uint8_t, WORK_RAM_SIZE>& get_work_ram() const { return work_ram; }
+    const std::array<uint8_t, HIGH_RAM_SIZE>& get_high_ram() const { return high_ram; }
+
     /* Testing */
     void load_test_tiles();
 
@@ -175,5 +376,119 @@ private:
 
     uint8_t interrupt_enable{};
 
+    /* IO Register Handlers */
+    struct IoHandler
+    {
+        std::function<uint8_t()> read;
+        std::function<void(uint8_t)> write;
+    };
+
+    std::array<IoHandler, IO_REGISTERS_SIZE> io_handlers{};
+
+    void set_default_io_handlers();
+
+    /* OAM DMA */
+    uint32_t dma_cycles_left = 0;
+    bool dma_starting = false; // The transfer starts counting at the first tick after the write
+
+    void advance_dma(uint32_t cycles);
+
+    /* Page Table */
+    // Host memory of each 256-byte page, nullptr where accesses need a handler:
+    // cartridge RAM, OAM/unusable, IO/HRAM, trapped pages and, for writes, ROM (MBC registers),
+    // watched code pages and clean pages. Everything is unmapped while OAM DMA runs.
+    std::array<const uint8_t*, MEMORY_PAGE_COUNT> read_pages{};
+    std::array<uint8_t*, MEMORY_PAGE_COUNT> write_pages{};
+
+    void map_pages();
+
+    /// @brief Maps a page for reads and/or writes (nullptr for neither), unless it is trapped.
+    void map_page(size_t page, const uint8_t* read, uint8_t* write)
+    {
+        read_pages[page] = read_traps[page] ? nullptr : read;
+        write_pages[page] = write_traps[page] ? nullptr : write;
+    }
+
+    /// @brief Points the ROM pages at the banks currently mapped. Needed after every MBC write.
+    void map_rom_pages();
+
+    /// @brief Maps a WRAM page and its echo, writable unless it is a watched code page or clean.
+    void map_work_ram_page(uint8_t page);
+
+    /// @brief Maps a VRAM page, writable unless it is clean.
+    void map_vram_page(uint8_t page);
+
+    /// @brief Slow paths of read_byte/write_byte: bus locking and access traps, then read_region/write_region.
+    uint8_t read_unmapped(int address);
+    void write_unmapped(uint8_t byte, int address);
+
+    uint8_t read_region(int address);
+    void write_region(uint8_t byte, int address);
+
+    /* Dirty Page Tracking */
+    struct DirtyTracker
+    {
+        DirtyPages pages;
+        bool active = false;
+    };
+
+    std::vector<DirtyTracker> dirty_trackers;
+
+    // Tracked pages some tracker has clean. They are unmapped for writes, so the first
+    // write to one goes through the slow path, which marks it dirty and maps it again.
+    std::bitset<256> clean_pages{};
+
+    void mark_dirty(int address);
+    void update_clean_pages();
+
+    /// @brief Passes the cartridge RAM pages written since the last call on to every tracker.
+    void collect_cart_ram_writes();
+
+    /* Access Traps */
+    std::bitset<256> read_traps{};
+    std::bitset<256> write_traps{};
+    std::function<void(uint16_t, uint8_t, bool)> access_trap_callback;
+
+    /* Access Statistics */
+    MemoryStats stats; // Bank switches are counted by the cartridge
+
+    /// @brief Counts a CPU read/write. Compiled out unless GB_PROFILE_MEMORY.
+    inline void count_access([[maybe_unused]] int address, [[maybe_unused]] bool write)
+    {
+#if GB_PROFILE_MEMORY
+        uint16_t address16 = static_cast<uint16_t>(address);
+
+        auto& regions = write ? stats.writes : stats.reads;
+        ++regions[static_cast<size_t>(memory_region(address16))];
+
+        if (address16 >= IO_REGISTERS_START && address16 <= IO_REGISTERS_END)
+            ++(write ? stats.io_writes : stats.io_reads)[address16 - IO_REGISTERS_START];
+#endif
+    }
+
+    /// @brief Counts the accesses a bulk copy/fill makes without going through read_byte/write_byte.
+    void count_block_access([[maybe_unused]] uint16_t address, [[maybe_unused]] uint16_t length, [[maybe_unused]] bool write)
+    {
+#if GB_PROFILE_MEMORY
+        for (uint16_t i = 0; i < length; ++i)
+            count_access(address + i, write);
+#endif
+    }
+
+    /* Code Write Notifications */
+    std::bitset<256> code_pages{};
+    std::function<void(uint16_t)> code_write_callback;
+
+    inline void notify_code_write(uint16_t address)
+    {
+        if (code_pages[address >> 8] && code_write_callback)
+            code_write_callback(address);
+    }
+
+    /// @returns Host memory backing [address, address + length) within one 256-byte page,
+    /// or nullptr unless it is VRAM/WRAM/OAM/HRAM (and, for writes, neither a watched code page
+    /// nor clean) and not trapped. Only HRAM is backed while OAM DMA runs.
+    uint8_t* plain_span(uint16_t address, uint16_t length, bool write);
+
     friend class Gameboy;
 };
\ No newline at end of file
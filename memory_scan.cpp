@@ -0,0 +1,248 @@
+#include "memory_scan.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define GB_SCAN_SSE2 1
+#include <emmintrin.h>
+#else
+#define GB_SCAN_SSE2 0
+#endif
+
+namespace
+{
+    template<ScanPredicate Predicate>
+    inline bool matches(uint16_t now, uint16_t before, uint16_t value)
+    {
+        if constexpr (Predicate == ScanPredicate::Equal) return now == value;
+        else if constexpr (Predicate == ScanPredicate::Changed) return now != before;
+        else if constexpr (Predicate == ScanPredicate::Unchanged) return now == before;
+        else if constexpr (Predicate == ScanPredicate::Increased) return now > before;
+        else return now < before;
+    }
+
+#if GB_SCAN_SSE2
+    /// @returns 0xFF in every byte/word lane where Predicate holds. SSE2 only compares signed
+    /// values, so unsigned ones are compared with their top bit flipped.
+    template<ScanPredicate Predicate, ScanWidth Width>
+    inline __m128i compare(__m128i now, __m128i before, __m128i value)
+    {
+        constexpr bool is_byte = (Width == ScanWidth::Byte);
+
+        auto equal = [](__m128i a, __m128i b) { return is_byte ? _mm_cmpeq_epi8(a, b) : _mm_cmpeq_epi16(a, b); };
+        auto greater = [](__m128i a, __m128i b)
+        {
+            __m128i bias = is_byte ? _mm_set1_epi8(static_cast<char>(0x80)) : _mm_set1_epi16(static_cast<short>(0x8000));
+            a = _mm_xor_si128(a, bias);
+            b = _mm_xor_si128(b, bias);
+
+            return is_byte ? _mm_cmpgt_epi8(a, b) : _mm_cmpgt_epi16(a, b);
+        };
+
+        if constexpr (Predicate == ScanPredicate::Equal) return equal(now, value);
+        else if constexpr (Predicate == ScanPredicate::Changed) return _mm_xor_si128(equal(now, before), _mm_set1_epi8(-1));
+        else if constexpr (Predicate == ScanPredicate::Unchanged) return equal(now, before);
+        else if constexpr (Predicate == ScanPredicate::Increased) return greater(now, before);
+        else return greater(before, now);
+    }
+
+    /// @returns 0xFF for each of the 16 offsets from `now`/`before` where the value starting there satisfies Predicate.
+    template<ScanPredicate Predicate, ScanWidth Width>
+    inline __m128i match_16(const uint8_t* now, const uint8_t* before, __m128i value)
+    {
+        __m128i now_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(now));
+        __m128i before_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(before));
+
+        if constexpr (Width == ScanWidth::Byte)
+            return compare<Predicate, Width>(now_low, before_low, value);
+        else
+        {
+            // Interleaving each byte with the one after it gives the word starting at every offset
+            __m128i now_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(now + 1));
+            __m128i before_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(before + 1));
+
+            __m128i first = compare<Predicate, Width>(_mm_unpacklo_epi8(now_low, now_high), _mm_unpacklo_epi8(before_low, before_high), value);
+            __m128i second = compare<Predicate, Width>(_mm_unpackhi_epi8(now_low, now_high), _mm_unpackhi_epi8(before_low, before_high), value);
+
+            // Lanes are 0 or -1, which saturate to 0x00 and 0xFF
+            return _mm_packs_epi16(first, second);
+        }
+    }
+#endif
+
+    /// @brief Clears the candidates in [0, size) whose value does not satisfy Predicate.
+    /// @returns Number of candidates left.
+    template<ScanPredicate Predicate, ScanWidth Width>
+    size_t filter_span(const uint8_t* now, const uint8_t* before, uint8_t* candidates, size_t size, uint16_t value, [[maybe_unused]] bool simd)
+    {
+        constexpr size_t VALUE_SIZE = static_cast<size_t>(Width);
+
+        // The last byte of a span starts no word
+        size_t positions = (size >= VALUE_SIZE) ? size - (VALUE_SIZE - 1) : 0;
+        size_t remaining = 0;
+        size_t i = 0;
+
+#if GB_SCAN_SSE2
+        __m128i value_vector = (Width == ScanWidth::Byte)
+            ? _mm_set1_epi8(static_cast<char>(value))
+            : _mm_set1_epi16(static_cast<short>(value));
+
+        for (; simd && i + 16 + (VALUE_SIZE - 1) <= size; i += 16)
+        {
+            __m128i* lanes = reinterpret_cast<__m128i*>(candidates + i);
+            __m128i kept = _mm_and_si128(_mm_loadu_si128(lanes), match_16<Predicate, Width>(now + i, before + i, value_vector));
+
+            _mm_storeu_si128(lanes, kept);
+            remaining += std::bitset<16>(static_cast<unsigned>(_mm_movemask_epi8(kept))).count();
+        }
+#endif
+
+        for (; i < positions; ++i)
+        {
+            uint16_t now_value = now[i];
+            uint16_t before_value = before[i];
+
+            if constexpr (Width == ScanWidth::Word)
+            {
+                now_value |= now[i + 1] << 8;
+                before_value |= before[i + 1] << 8;
+            }
+
+            if (!matches<Predicate>(now_value, before_value, value))
+                candidates[i] = 0;
+
+            remaining += (candidates[i] != 0);
+        }
+
+        for (; i < size; ++i)
+            candidates[i] = 0;
+
+        return remaining;
+    }
+
+    template<ScanPredicate Predicate>
+    size_t filter_span(ScanWidth width, const uint8_t* now, const uint8_t* before, uint8_t* candidates, size_t size, uint16_t value, bool simd)
+    {
+        return (width == ScanWidth::Byte)
+            ? filter_span<Predicate, ScanWidth::Byte>(now, before, candidates, size, value, simd)
+            : filter_span<Predicate, ScanWidth::Word>(now, before, candidates, size, value, simd);
+    }
+}
+
+MemoryScanner::MemoryScanner(Mmu& _mmu, Cartridge* _cartridge) :
+    mmu(_mmu),
+    cartridge(_cartridge)
+{}
+
+void MemoryScanner::reset(ScanWidth _width)
+{
+    width = _width;
+
+    regions.clear();
+
+    Region region;
+    region.address = WORK_RAM_START;
+    region.size = WORK_RAM_SIZE;
+    regions.push_back(region);
+
+    region.address = HIGH_RAM_START;
+    region.offset += region.size;
+    region.size = HIGH_RAM_SIZE;
+    regions.push_back(region);
+
+    // Each bank is a region, as only one is mapped at 0xA000 at a time
+    size_t ram_size = cartridge ? cartridge->ram.size() : 0;
+    for (size_t bank_offset = 0; bank_offset < ram_size; bank_offset += CARTRIDGE_RAM_SIZE)
+    {
+        region.address = CARTRIDGE_RAM_START;
+        region.bank = static_cast<uint16_t>(bank_offset / CARTRIDGE_RAM_SIZE);
+        region.offset += region.size;
+        region.size = std::min<size_t>(CARTRIDGE_RAM_SIZE, ram_size - bank_offset);
+        regions.push_back(region);
+    }
+
+    take_snapshot(current);
+    previous = current;
+    candidates.assign(current.size(), 0xFF);
+
+    // Unchanged always holds against the same snapshot, and drops the bytes that start no word
+    candidate_count = 0;
+    for (const Region& r : regions)
+        candidate_count += filter_region(r, ScanPredicate::Unchanged, 0);
+}
+
+size_t MemoryScanner::filter(ScanPredicate predicate, uint16_t value)
+{
+    if (regions.empty()) reset(width);
+
+    std::swap(previous, current);
+    take_snapshot(current);
+
+    candidate_count = 0;
+    for (const Region& region : regions)
+        candidate_count += filter_region(region, predicate, value);
+
+    return candidate_count;
+}
+
+std::vector<ScanCandidate> MemoryScanner::get_candidates(size_t max_count) const
+{
+    std::vector<ScanCandidate> found;
+
+    for (const Region& region : regions)
+    {
+        for (size_t i = 0; i < region.size && found.size() < max_count; ++i)
+        {
+            if (!candidates[region.offset + i]) continue;
+
+            ScanCandidate candidate;
+            candidate.address = static_cast<uint16_t>(region.address + i);
+            candidate.bank = region.bank;
+            candidate.value = read_value(current, region.offset + i);
+            found.push_back(candidate);
+        }
+    }
+
+    return found;
+}
+
+void MemoryScanner::take_snapshot(std::vector<uint8_t>& snapshot) const
+{
+    const auto& work_ram = mmu.get_work_ram();
+    const auto& high_ram = mmu.get_high_ram();
+    size_t ram_size = cartridge ? cartridge->ram.size() : 0;
+
+    snapshot.resize(work_ram.size() + high_ram.size() + ram_size);
+
+    std::memcpy(snapshot.data(), work_ram.data(), work_ram.size());
+    std::memcpy(snapshot.data() + work_ram.size(), high_ram.data(), high_ram.size());
+
+    if (ram_size)
+        std::memcpy(snapshot.data() + work_ram.size() + high_ram.size(), cartridge->ram.data(), ram_size);
+}
+
+size_t MemoryScanner::filter_region(const Region& region, ScanPredicate predicate, uint16_t value)
+{
+    const uint8_t* now = current.data() + region.offset;
+    const uint8_t* before = previous.data() + region.offset;
+    uint8_t* kept = candidates.data() + region.offset;
+
+    switch (predicate)
+    {
+    case ScanPredicate::Equal: return filter_span<ScanPredicate::Equal>(width, now, before, kept, region.size, value, simd_enabled);
+    case ScanPredicate::Changed: return filter_span<ScanPredicate::Changed>(width, now, before, kept, region.size, value, simd_enabled);
+    case ScanPredicate::Unchanged: return filter_span<ScanPredicate::Unchanged>(width, now, before, kept, region.size, value, simd_enabled);
+    case ScanPredicate::Increased: return filter_span<ScanPredicate::Increased>(width, now, before, kept, region.size, value, simd_enabled);
+    case ScanPredicate::Decreased: return filter_span<ScanPredicate::Decreased>(width, now, before, kept, region.size, value, simd_enabled);
+    default: return 0;
+    }
+}
+
+uint16_t MemoryScanner::read_value(const std::vector<uint8_t>& snapshot, size_t offset) const
+{
+    if (width == ScanWidth::Byte) return snapshot[offset];
+
+    return static_cast<uint16_t>(snapshot[offset] | (snapshot[offset + 1] << 8));
+}
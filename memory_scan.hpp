@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "memory.hpp"
+
+/// @brief Size of the values a memory search looks for. Words are little-endian.
+enum class ScanWidth : uint8_t { Byte = 1, Word = 2 };
+
+/// @brief What a candidate's value has to satisfy to stay one.
+enum class ScanPredicate : uint8_t
+{
+    Equal, // To the given value
+    Changed, // Since the previous snapshot
+    Unchanged,
+    Increased, // Unsigned
+    Decreased
+};
+
+/// @brief One address still matching a memory search.
+struct ScanCandidate
+{
+    uint16_t address = 0;
+    uint16_t bank = 0; // Cartridge RAM bank for 0xA000-0xBFFF, 0 elsewhere
+    uint16_t value = 0; // In the last snapshot
+};
+
+/// @brief Searches WRAM, HRAM and all of cartridge RAM for addresses whose value behaves some
+/// way across snapshots, e.g. to find where a game keeps the score or the player's health.
+///
+/// Each filter() snapshots the memory as it is and compares all of it with the previous
+/// snapshot 16 bytes at a time (SSE2, or a scalar loop on other hosts). Words never span
+/// two regions or two cartridge RAM banks.
+class MemoryScanner
+{
+public:
+    MemoryScanner(Mmu& mmu, Cartridge* cartridge);
+
+    /// @brief Starts a new search, with every address a candidate and memory as it is now as the first snapshot.
+    void reset(ScanWidth width = ScanWidth::Byte);
+
+    /// @brief Snapshots memory and keeps the candidates whose value satisfies `predicate`, compared
+    /// with `value` for Equal and with the previous snapshot otherwise.
+    /// @returns Number of candidates left.
+    size_t filter(ScanPredicate predicate, uint16_t value = 0);
+
+    size_t get_candidate_count() const { return candidate_count; }
+
+    /// @brief Enables/disables comparing 16 bytes at a time. Has no effect on hosts without SSE2,
+    /// which always use the scalar loop.
+    void set_simd_enabled(bool enabled) { simd_enabled = enabled; }
+
+    /// @returns Up to `max_count` candidates, in address order.
+    std::vector<ScanCandidate> get_candidates(size_t max_count = SIZE_MAX) const;
+
+private:
+    Mmu& mmu;
+    Cartridge* cartridge = nullptr;
+
+    ScanWidth width = ScanWidth::Byte;
+    bool simd_enabled = true;
+
+    /// @brief A span of the snapshot that is contiguous in the address space.
+    struct Region
+    {
+        uint16_t address = 0;
+        uint16_t bank = 0;
+        size_t offset = 0; // Into the snapshot
+        size_t size = 0;
+    };
+
+    std::vector<Region> regions;
+
+    std::vector<uint8_t> previous;
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> candidates; // 0xFF for a candidate, 0x00 otherwise, by snapshot offset
+    size_t candidate_count = 0;
+
+    void take_snapshot(std::vector<uint8_t>& snapshot) const;
+
+    /// @returns Number of candidates left in `region`.
+    size_t filter_region(const Region& region, ScanPredicate predicate, uint16_t value);
+
+    uint16_t read_value(const std::vector<uint8_t>& snapshot, size_t offset) const;
+};
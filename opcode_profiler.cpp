@@ -0,0 +1,140 @@
+#include "opcode_profiler.hpp"
+#include "opcodes.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <vector>
+
+/// @returns Assembly text of an opcode, e.g. "BIT 7, H" or "JR NZ, e8".
+static std::string format_instruction(const OpcodeInfo& info, uint8_t opcode)
+{
+    std::string text = info.mnemonic;
+
+    for (size_t i = 0; i < info.operands.size() && info.operands[i] != Operand::None; ++i)
+    {
+        text += (i == 0) ? " " : ", ";
+
+        if (info.operands[i] == Operand::Bit)
+            text += std::to_string((opcode >> 3) & 0x07);
+        else if (info.operands[i] == Operand::Vector)
+        {
+            char vector[4];
+            std::snprintf(vector, sizeof(vector), "$%02X", opcode & 0x38);
+            text += vector;
+        }
+        else
+            text += operand_name(info.operands[i]);
+    }
+
+    return text;
+}
+
+OpcodeProfiler::OpcodeProfiler()
+{
+    // The cheapest of many empty measurements is what reading the clock itself costs
+    clock_overhead = Clock::duration::max();
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto start = Clock::now();
+        clock_overhead = std::min(clock_overhead, Clock::now() - start);
+    }
+}
+
+void OpcodeProfiler::print_page(std::ostream& out, const std::array<OpcodeStats, 256>& page, bool is_cb, uint64_t total) const
+{
+    std::vector<int> order;
+    for (int opcode = 0; opcode < 256; ++opcode)
+        if (page[opcode].count != 0) order.push_back(opcode);
+
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return page[a].count > page[b].count; });
+
+    for (int opcode : order)
+    {
+        const OpcodeInfo& info = is_cb ? CB_OPCODES[opcode] : BASE_OPCODES[opcode];
+
+        out << std::setw(14) << page[opcode].count << "  "
+            << std::setw(6) << std::fixed << std::setprecision(2) << (100.0 * page[opcode].count / total) << "%  "
+            << (is_cb ? "$CB " : "    ") << '$' << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << opcode
+            << std::dec << std::nouppercase << std::setfill(' ') << "  " << format_instruction(info, static_cast<uint8_t>(opcode)) << '\n';
+    }
+}
+
+void OpcodeProfiler::print_report(std::ostream& out) const
+{
+    uint64_t base_total = 0, cb_total = 0;
+    for (int opcode = 0; opcode < 256; ++opcode)
+    {
+        base_total += base[opcode].count;
+        cb_total += cb[opcode].count;
+    }
+
+    out << "\n/* Opcode Profile */\n";
+    out << base_total << " instructions executed, " << cb_total << " of them CB-prefixed\n";
+    if (base_total == 0) return;
+
+    out << "\nBase opcodes:\n";
+    print_page(out, base, false, base_total);
+
+    if (cb_total != 0)
+    {
+        out << "\nCB-prefixed opcodes:\n";
+        print_page(out, cb, true, cb_total);
+    }
+
+    // Prefixed instructions are timed as a whole by their CB handler, so 0xCB itself is left out
+    struct ClassStats { uint64_t count = 0, samples = 0, sampled_ns = 0; };
+    std::map<std::string, ClassStats> classes;
+
+    auto add_page = [&](const std::array<OpcodeStats, 256>& page, const std::array<OpcodeInfo, 256>& infos, const char* prefix)
+    {
+        for (int opcode = 0; opcode < 256; ++opcode)
+        {
+            if (page[opcode].count == 0 || (&page == &base && opcode == 0xCB)) continue;
+
+            ClassStats& stats = classes[prefix + std::string(infos[opcode].mnemonic)];
+            stats.count += page[opcode].count;
+            stats.samples += page[opcode].samples;
+            stats.sampled_ns += page[opcode].sampled_ns;
+        }
+    };
+    add_page(base, BASE_OPCODES, "");
+    add_page(cb, CB_OPCODES, "CB ");
+
+    // Host time per class is estimated as its average sample times its execution count
+    std::vector<std::pair<std::string, double>> estimates;
+    double total_ns = 0;
+    for (auto& [name, stats] : classes)
+    {
+        double estimate = stats.samples ? static_cast<double>(stats.sampled_ns) / stats.samples * stats.count : 0.0;
+        estimates.emplace_back(name, estimate);
+        total_ns += estimate;
+    }
+
+    std::sort(estimates.begin(), estimates.end(), [](auto& a, auto& b) { return a.second > b.second; });
+
+    out << "\nHost cost by opcode class (1 in " << SAMPLE_INTERVAL << " handler calls timed):\n";
+    out << std::setw(10) << "class" << std::setw(16) << "executed" << std::setw(10) << "ns/op" << std::setw(12) << "est. ms" << std::setw(9) << "share" << '\n';
+
+    for (auto& [name, estimate] : estimates)
+    {
+        const ClassStats& stats = classes[name];
+        double average = stats.samples ? static_cast<double>(stats.sampled_ns) / stats.samples : 0.0;
+
+        out << std::setw(10) << name << std::setw(16) << stats.count
+            << std::setw(10) << std::fixed << std::setprecision(1) << average
+            << std::setw(12) << std::setprecision(3) << estimate / 1e6
+            << std::setw(8) << std::setprecision(2) << (total_ns > 0 ? 100.0 * estimate / total_ns : 0.0) << "%\n";
+    }
+
+    out << std::defaultfloat;
+}
+
+void OpcodeProfiler::reset()
+{
+    base.fill(OpcodeStats{});
+    cb.fill(OpcodeStats{});
+    calls = 0;
+}
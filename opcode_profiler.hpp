@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ostream>
+
+// Build with -DGB_PROFILE_OPCODES=1 to count every executed opcode and sample
+// host time per opcode class. Disabled builds contain none of it.
+#ifndef GB_PROFILE_OPCODES
+#define GB_PROFILE_OPCODES 0
+#endif
+
+/// @brief Per-opcode execution histogram (base and CB-prefixed pages) with sampled host cost.
+class OpcodeProfiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint64_t SAMPLE_INTERVAL = 64; // Every n-th handler call is timed, must be a power of 2
+
+    OpcodeProfiler();
+
+    /// @brief Counts one execution of an opcode.
+    /// @returns true if this execution should be timed.
+    bool count(uint8_t opcode) { ++base[opcode].count; return (++calls & (SAMPLE_INTERVAL - 1)) == 0; }
+    bool count_cb(uint8_t opcode) { ++cb[opcode].count; return (++calls & (SAMPLE_INTERVAL - 1)) == 0; }
+
+    void add_sample(uint8_t opcode, Clock::duration time) { base[opcode].add(time - clock_overhead); }
+    void add_cb_sample(uint8_t opcode, Clock::duration time) { cb[opcode].add(time - clock_overhead); }
+
+    /// @brief Writes both opcode pages sorted by execution count, then opcode classes
+    /// (mnemonics) sorted by estimated host time.
+    void print_report(std::ostream& out) const;
+
+    void reset();
+
+private:
+    struct OpcodeStats
+    {
+        uint64_t count = 0;
+        uint64_t samples = 0;
+        uint64_t sampled_ns = 0;
+
+        void add(Clock::duration time)
+        {
+            ++samples;
+            sampled_ns += std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(), 0);
+        }
+    };
+
+    std::array<OpcodeStats, 256> base{};
+    std::array<OpcodeStats, 256> cb{};
+    uint64_t calls = 0;
+    Clock::duration clock_overhead{}; // Cost of timing nothing, taken off every sample
+
+    void print_page(std::ostream& out, const std::array<OpcodeStats, 256>& page, bool is_cb, uint64_t total) const;
+};
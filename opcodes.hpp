@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+/// @brief Kinds of operands an SM83 instruction can take, in assembly order.
+enum class Operand : uint8_t
+{
+    None,
+
+    // Registers
+    A, B, C, D, E, H, L,
+    AF, BC, DE, HL, SP,
+
+    // Register indirect
+    IndirectBC, // [BC]
+    IndirectDE, // [DE]
+    IndirectHL, // [HL]
+    IndirectHLInc, // [HL+]
+    IndirectHLDec, // [HL-]
+    IndirectC, // [$FF00 + C]
+
+    // Immediates
+    N8,
+    N16,
+    E8, // Signed offset, relative to the next instruction for JR
+    SPPlusE8, // SP + e8
+    IndirectA8, // [$FF00 + a8]
+    A16, // Jump/call target
+    IndirectA16, // [a16]
+
+    // Encoded in the opcode bits
+    CondNZ, CondZ, CondNC, CondC,
+    Vector, // RST target, (opcode & 0x38)
+    Bit // Bit index, (opcode >> 3) & 7
+};
+
+/// @returns Assembly text of an operand kind. Bit and Vector are placeholders for the value encoded in the opcode.
+constexpr const char* operand_name(Operand operand)
+{
+    switch (operand)
+    {
+    case Operand::A: return "A";
+    case Operand::B: return "B";
+    case Operand::C: return "C";
+    case Operand::D: return "D";
+    case Operand::E: return "E";
+    case Operand::H: return "H";
+    case Operand::L: return "L";
+    case Operand::AF: return "AF";
+    case Operand::BC: return "BC";
+    case Operand::DE: return "DE";
+    case Operand::HL: return "HL";
+    case Operand::SP: return "SP";
+    case Operand::IndirectBC: return "[BC]";
+    case Operand::IndirectDE: return "[DE]";
+    case Operand::IndirectHL: return "[HL]";
+    case Operand::IndirectHLInc: return "[HL+]";
+    case Operand::IndirectHLDec: return "[HL-]";
+    case Operand::IndirectC: return "[C]";
+    case Operand::N8: return "n8";
+    case Operand::N16: return "n16";
+    case Operand::E8: return "e8";
+    case Operand::SPPlusE8: return "SP + e8";
+    case Operand::IndirectA8: return "[a8]";
+    case Operand::A16: return "a16";
+    case Operand::IndirectA16: return "[a16]";
+    case Operand::CondNZ: return "NZ";
+    case Operand::CondZ: return "Z";
+    case Operand::CondNC: return "NC";
+    case Operand::CondC: return "C";
+    case Operand::Vector: return "vec";
+    case Operand::Bit: return "u3";
+    default: return "";
+    }
+}
+
+/// @brief Static description of one base or CB-prefixed opcode.
+struct OpcodeInfo
+{
+    const char* mnemonic = "ILLEGAL";
+    uint8_t length = 1; // Bytes, prefix and operands included
+    uint8_t cycles = 0; // T-cycles, or T-cycles if the branch is not taken
+    uint8_t cycles_taken = 0; // T-cycles if the branch is taken, same as `cycles` for non-branches
+
+    // Effect on Z, N, H, C in that order: '-' unaffected, '0'/'1' reset/set, otherwise set from the result
+    const char* flags = "----";
+
+    std::array<Operand, 2> operands{ Operand::None, Operand::None };
+};
+
+namespace opcode_detail
+{
+    constexpr Operand R8[8] = { Operand::B, Operand::C, Operand::D, Operand::E, Operand::H, Operand::L, Operand::IndirectHL, Operand::A };
+    constexpr Operand R16[4] = { Operand::BC, Operand::DE, Operand::HL, Operand::SP };
+    constexpr Operand R16_STACK[4] = { Operand::BC, Operand::DE, Operand::HL, Operand::AF };
+    constexpr Operand R16_INDIRECT[4] = { Operand::IndirectBC, Operand::IndirectDE, Operand::IndirectHLInc, Operand::IndirectHLDec };
+    constexpr Operand CONDITIONS[4] = { Operand::CondNZ, Operand::CondZ, Operand::CondNC, Operand::CondC };
+
+    constexpr const char* ALU_MNEMONICS[8] = { "ADD", "ADC", "SUB", "SBC", "AND", "XOR", "OR", "CP" };
+    constexpr const char* ALU_FLAGS[8] = { "Z0HC", "Z0HC", "Z1HC", "Z1HC", "Z010", "Z000", "Z000", "Z1HC" };
+
+    constexpr const char* SHIFT_MNEMONICS[8] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+    constexpr const char* ACCUMULATOR_MNEMONICS[8] = { "RLCA", "RRCA", "RLA", "RRA", "DAA", "CPL", "SCF", "CCF" };
+    constexpr const char* ACCUMULATOR_FLAGS[8] = { "000C", "000C", "000C", "000C", "Z-0C", "-11-", "-001", "-00C" };
+
+    constexpr OpcodeInfo make(const char* mnemonic, int length, int cycles, const char* flags = "----",
+        Operand first = Operand::None, Operand second = Operand::None)
+    {
+        OpcodeInfo info;
+        info.mnemonic = mnemonic;
+        info.length = static_cast<uint8_t>(length);
+        info.cycles = static_cast<uint8_t>(cycles);
+        info.cycles_taken = static_cast<uint8_t>(cycles);
+        info.flags = flags;
+        info.operands = { first, second };
+        return info;
+    }
+
+    constexpr OpcodeInfo make_branch(const char* mnemonic, int length, int cycles, int cycles_taken,
+        Operand first, Operand second = Operand::None)
+    {
+        OpcodeInfo info = make(mnemonic, length, cycles, "----", first, second);
+        info.cycles_taken = static_cast<uint8_t>(cycles_taken);
+        return info;
+    }
+
+    /// @note Mirrors the decoding in Cpu::execute_opcode, including STOP being 1 byte
+    /// and illegal opcodes taking 0 T-cycles.
+    constexpr OpcodeInfo decode_base(uint8_t opcode)
+    {
+        const int x = opcode >> 6;
+        const int y = (opcode >> 3) & 0x07;
+        const int z = opcode & 0x07;
+        const int p = y >> 1;
+        const bool q = y & 1;
+
+        // [HL] operands take 4 more T-cycles per access
+        const bool y_is_hl = (y == 6);
+        const bool z_is_hl = (z == 6);
+
+        if (x == 0)
+        {
+            switch (z)
+            {
+            case 0:
+                if (y == 0) return make("NOP", 1, 4);
+                if (y == 1) return make("LD", 3, 20, "----", Operand::IndirectA16, Operand::SP);
+                if (y == 2) return make("STOP", 1, 4);
+                if (y == 3) return make("JR", 2, 12, "----", Operand::E8);
+                return make_branch("JR", 2, 8, 12, CONDITIONS[y - 4], Operand::E8);
+
+            case 1:
+                return q ? make("ADD", 1, 8, "-0HC", Operand::HL, R16[p])
+                         : make("LD", 3, 12, "----", R16[p], Operand::N16);
+
+            case 2:
+                return q ? make("LD", 1, 8, "----", Operand::A, R16_INDIRECT[p])
+                         : make("LD", 1, 8, "----", R16_INDIRECT[p], Operand::A);
+
+            case 3:
+                return make(q ? "DEC" : "INC", 1, 8, "----", R16[p]);
+
+            case 4:
+                return make("INC", 1, y_is_hl ? 12 : 4, "Z0H-", R8[y]);
+
+            case 5:
+                return make("DEC", 1, y_is_hl ? 12 : 4, "Z1H-", R8[y]);
+
+            case 6:
+                return make("LD", 2, y_is_hl ? 12 : 8, "----", R8[y], Operand::N8);
+
+            default:
+                return make(ACCUMULATOR_MNEMONICS[y], 1, 4, ACCUMULATOR_FLAGS[y]);
+            }
+        }
+
+        if (x == 1)
+        {
+            if (y_is_hl && z_is_hl) return make("HALT", 1, 4);
+
+            return make("LD", 1, (y_is_hl || z_is_hl) ? 8 : 4, "----", R8[y], R8[z]);
+        }
+
+        if (x == 2)
+            return make(ALU_MNEMONICS[y], 1, z_is_hl ? 8 : 4, ALU_FLAGS[y], Operand::A, R8[z]);
+
+        switch (z)
+        {
+        case 0:
+            if (y < 4) return make_branch("RET", 1, 8, 20, CONDITIONS[y]);
+            if (y == 4) return make("LDH", 2, 12, "----", Operand::IndirectA8, Operand::A);
+            if (y == 5) return make("ADD", 2, 16, "00HC", Operand::SP, Operand::E8);
+            if (y == 6) return make("LDH", 2, 12, "----", Operand::A, Operand::IndirectA8);
+            return make("LD", 2, 12, "00HC", Operand::HL, Operand::SPPlusE8);
+
+        case 1:
+            if (!q) return make("POP", 1, 12, (p == 3) ? "ZNHC" : "----", R16_STACK[p]);
+            if (p == 0) return make("RET", 1, 16);
+            if (p == 1) return make("RETI", 1, 16);
+            if (p == 2) return make("JP", 1, 4, "----", Operand::HL);
+            return make("LD", 1, 8, "----", Operand::SP, Operand::HL);
+
+        case 2:
+            if (y < 4) return make_branch("JP", 3, 12, 16, CONDITIONS[y], Operand::A16);
+            if (y == 4) return make("LDH", 1, 8, "----", Operand::IndirectC, Operand::A);
+            if (y == 5) return make("LD", 3, 16, "----", Operand::IndirectA16, Operand::A);
+            if (y == 6) return make("LDH", 1, 8, "----", Operand::A, Operand::IndirectC);
+            return make("LD", 3, 16, "----", Operand::A, Operand::IndirectA16);
+
+        case 3:
+            if (y == 0) return make("JP", 3, 16, "----", Operand::A16);
+            if (y == 1) return make("PREFIX", 2, 4); // The prefixed opcode's cycles are in CB_OPCODES
+            if (y == 6) return make("DI", 1, 4);
+            if (y == 7) return make("EI", 1, 4);
+            return {};
+
+        case 4:
+            if (y < 4) return make_branch("CALL", 3, 12, 24, CONDITIONS[y], Operand::A16);
+            return {};
+
+        case 5:
+            if (!q) return make("PUSH", 1, 16, "----", R16_STACK[p]);
+            if (p == 0) return make("CALL", 3, 24, "----", Operand::A16);
+            return {};
+
+        case 6:
+            return make(ALU_MNEMONICS[y], 2, 8, ALU_FLAGS[y], Operand::A, Operand::N8);
+
+        default:
+            return make("RST", 1, 16, "----", Operand::Vector);
+        }
+    }
+
+    constexpr OpcodeInfo decode_cb(uint8_t opcode)
+    {
+        const int x = opcode >> 6;
+        const int y = (opcode >> 3) & 0x07;
+        const int z = opcode & 0x07;
+        const bool is_hl = (z == 6);
+
+        switch (x)
+        {
+        case 0: return make(SHIFT_MNEMONICS[y], 2, is_hl ? 16 : 8, (y == 6) ? "Z000" : "Z00C", R8[z]);
+        case 1: return make("BIT", 2, is_hl ? 12 : 8, "Z01-", Operand::Bit, R8[z]);
+        case 2: return make("RES", 2, is_hl ? 16 : 8, "----", Operand::Bit, R8[z]);
+        default: return make("SET", 2, is_hl ? 16 : 8, "----", Operand::Bit, R8[z]);
+        }
+    }
+
+    template<typename Decoder>
+    constexpr std::array<OpcodeInfo, 256> make_table(Decoder decode)
+    {
+        std::array<OpcodeInfo, 256> table{};
+        for (int opcode = 0; opcode < 256; ++opcode)
+            table[opcode] = decode(static_cast<uint8_t>(opcode));
+        return table;
+    }
+}
+
+/// @brief Metadata of the 256 base opcodes, built at compile time.
+inline constexpr std::array<OpcodeInfo, 256> BASE_OPCODES = opcode_detail::make_table(opcode_detail::decode_base);
+
+/// @brief Metadata of the 256 CB-prefixed opcodes. Lengths and cycles include the prefix.
+inline constexpr std::array<OpcodeInfo, 256> CB_OPCODES = opcode_detail::make_table(opcode_detail::decode_cb);
+
+static_assert(BASE_OPCODES[0x20].cycles == 8 && BASE_OPCODES[0x20].cycles_taken == 12, "JR NZ, e8");
+static_assert(BASE_OPCODES[0xCD].length == 3 && BASE_OPCODES[0xCD].cycles == 24, "CALL a16");
+static_assert(BASE_OPCODES[0xD3].cycles == 0, "Illegal opcodes take no time");
+static_assert(CB_OPCODES[0x46].cycles == 12 && CB_OPCODES[0x86].cycles == 16, "BIT/RES u3, [HL]");
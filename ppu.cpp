@@ -21,6 +21,39 @@ Ppu::Ppu(Mmu& _mmu) :
     scanline_y(mmu.read_io_reg(LCD_Y_COORDINATE))
 {
     oam_buffer.reserve(10);
+    sync_registers();
+    register_io_handlers();
+}
+
+void Ppu::register_io_handlers()
+{
+    // Bits 0-2 of STAT are read-only
+    mmu.set_io_write_handler(LCD_STATUS, [this](uint8_t byte) {
+        lcd_status = byte & 0xF8;
+    });
+
+    // LY is read-only
+    mmu.set_io_write_handler(LCD_Y_COORDINATE, [](uint8_t) {});
+
+    mmu.set_io_write_handler(BG_PALETTE, [this](uint8_t byte) {
+        bg_palette = byte;
+        bg_colours = get_palette(byte);
+    });
+    mmu.set_io_write_handler(OBJ_PALETTE_0, [this](uint8_t byte) {
+        obj0_palette = byte;
+        obj0_colours = get_palette(byte);
+    });
+    mmu.set_io_write_handler(OBJ_PALETTE_1, [this](uint8_t byte) {
+        obj1_palette = byte;
+        obj1_colours = get_palette(byte);
+    });
+}
+
+void Ppu::sync_registers()
+{
+    bg_colours = get_palette(bg_palette);
+    obj0_colours = get_palette(obj0_palette);
+    obj1_colours = get_palette(obj1_palette);
 }
 
 // While the PPU is accessing some video-related memory, 
@@ -56,11 +89,22 @@ void Ppu::tick(uint32_t cycles)
             return;
         }
         else 
+        {
             std::cout << "LCD Turned ON!\n";
+
+            // The first scanline starts as soon as the LCD is switched on
+            cycles_elapsed = 0;
+        }
     }
     if (!check_lcdc(LCDC::LCDPpuEnable))
         return;
 
+    // Long ticks (e.g. while the CPU is halted) can span several modes
+    while (advance_mode()) {}
+}
+
+bool Ppu::advance_mode()
+{
     switch (ppu_mode)
     {
     case Mode::OamScan:
@@ -68,6 +112,7 @@ void Ppu::tick(uint32_t cycles)
         {
             oam_scan(scanline_y);
             update_ppu_mode(Mode::Drawing);
+            return true;
         }
         break;
     case Mode::Drawing:
@@ -75,24 +120,26 @@ void Ppu::tick(uint32_t cycles)
         {
             render_scanline(scanline_y);
             update_ppu_mode(Mode::HBlank);
+            return true;
         }
         break;
     case Mode::HBlank:
         if (cycles_elapsed >= GBTiming::CYCLES_PER_SCANLINE)
         {
-            cycles_elapsed %= GBTiming::CYCLES_PER_SCANLINE;
+            cycles_elapsed -= GBTiming::CYCLES_PER_SCANLINE;
             set_scanline(scanline_y + 1);
 
             if (scanline_y >= GBResolution::HEIGHT)
                 update_ppu_mode(Mode::VBlank);
             else
                 update_ppu_mode(Mode::OamScan);
+            return true;
         }
         break;
     case Mode::VBlank:
         if (cycles_elapsed >= GBTiming::CYCLES_PER_SCANLINE)
         {
-            cycles_elapsed %= GBTiming::CYCLES_PER_SCANLINE;
+            cycles_elapsed -= GBTiming::CYCLES_PER_SCANLINE;
             set_scanline(scanline_y + 1);
 
             if (scanline_y >= GBTiming::TOTAL_SCANLINES)
@@ -100,9 +147,95 @@ void Ppu::tick(uint32_t cycles)
                 set_scanline(0);
                 update_ppu_mode(Mode::OamScan);
             }
+            return true;
         }
         break;
     }
+
+    return false;
+}
+
+uint32_t Ppu::cycles_until_next_event() const
+{
+    // Turning the LCD on/off takes effect on the next tick
+    if (check_lcdc(LCDC::LCDPpuEnable) != lcd_was_on)
+        return 0;
+
+    uint32_t next_event = GBTiming::CYCLES_PER_SCANLINE;
+
+    if (!check_lcdc(LCDC::LCDPpuEnable))
+        next_event = GBTiming::CYCLES_PER_FRAME;
+    else if (ppu_mode == Mode::OamScan)
+        next_event = GBTiming::CYCLES_OAM_SCAN;
+    else if (ppu_mode == Mode::Drawing)
+        next_event = GBTiming::CYCLES_OAM_SCAN + GBTiming::CYCLES_DRAWING_MIN;
+
+    return (cycles_elapsed < next_event) ? next_event - cycles_elapsed : 0;
+}
+
+// Walks the mode/scanline schedule without changing any state.
+uint32_t Ppu::cycles_until_next_interrupt(uint8_t interrupt_enable) const
+{
+    if (check_lcdc(LCDC::LCDPpuEnable) != lcd_was_on)
+        return 0;
+
+    if (!check_lcdc(LCDC::LCDPpuEnable))
+        return (cycles_elapsed < GBTiming::CYCLES_PER_FRAME) ? GBTiming::CYCLES_PER_FRAME - cycles_elapsed : 0;
+
+    const bool lcd_enabled = (interrupt_enable & static_cast<uint8_t>(Interrupts::LCD)) != 0;
+    const bool lyc_enabled = lcd_enabled && check_lcd_status(LCDStatus::LycIntSelect);
+
+    Mode mode = ppu_mode;
+    uint32_t line = scanline_y;
+    uint32_t elapsed = cycles_elapsed;
+    uint32_t total = 0;
+
+    while (true)
+    {
+        uint32_t next_event = GBTiming::CYCLES_PER_SCANLINE;
+        if (mode == Mode::OamScan)
+            next_event = GBTiming::CYCLES_OAM_SCAN;
+        else if (mode == Mode::Drawing)
+            next_event = GBTiming::CYCLES_OAM_SCAN + GBTiming::CYCLES_DRAWING_MIN;
+
+        if (elapsed > next_event) return total;
+
+        total += next_event - elapsed;
+        elapsed = next_event;
+
+        switch (mode)
+        {
+        case Mode::OamScan:
+            mode = Mode::Drawing;
+            break;
+
+        case Mode::Drawing:
+            mode = Mode::HBlank;
+            if (lcd_enabled && check_lcd_status(LCDStatus::Mode0Select)) return total;
+            break;
+
+        case Mode::HBlank:
+            elapsed = 0;
+            ++line;
+            if (lyc_enabled && line == ly_compare) return total;
+
+            // VBlank always ends the frame
+            if (line >= GBResolution::HEIGHT) return total;
+
+            mode = Mode::OamScan;
+            if (lcd_enabled && check_lcd_status(LCDStatus::Mode2Select)) return total;
+            break;
+
+        case Mode::VBlank:
+            elapsed = 0;
+            ++line;
+            if (lyc_enabled && line == ly_compare) return total;
+
+            // Stop at the start of the next frame as well
+            if (line >= GBTiming::TOTAL_SCANLINES) return total;
+            break;
+        }
+    }
 }
 
 /* Scanline Methods */
@@ -236,8 +369,6 @@ void Ppu::render_bg_scanline(uint8_t screen_y)
     
     bool use_9C00_tile_map = check_lcdc(LCDC::BgTileMapArea);
 
-    auto palette = get_palette(bg_palette);
-
     // 21 unique tiles will need to be rendered at most
     for (int tile_x = 0; tile_x < GBResolution::TILES_PER_ROW_VISIBLE_MAX; ++tile_x)
     {
@@ -249,7 +380,7 @@ void Ppu::render_bg_scanline(uint8_t screen_y)
         int last_tile_screen_x = screen_x - tile_offset_x;
         auto tile_pixels = decode_tile_row(tile_row.first, tile_row.second); 
 
-        write_pixels(tile_pixels, last_tile_screen_x, screen_y, palette);
+        write_pixels(tile_pixels, last_tile_screen_x, screen_y, bg_colours);
     }
 }
 
@@ -265,8 +396,6 @@ void Ppu::render_window_scanline(uint8_t screen_y)
 
     bool use_9C00_tile_map = check_lcdc(LCDC::WindowTileMap);
 
-    auto palette = get_palette(bg_palette);
-
     // Given the fact the window does not loop, 
     // there could range from 0 to 21 tiles to render on the screen at any given scanline.
     // Need to calculate based on the window_scroll_x and window_scroll_y values.
@@ -277,7 +406,7 @@ void Ppu::render_window_scanline(uint8_t screen_y)
         
         auto tile_row = fetch_tile_row(screen_x, window_internal_scanline_y, use_9C00_tile_map);
         auto tile_pixels = decode_tile_row(tile_row.first, tile_row.second); 
-        write_pixels(tile_pixels, tile_map_x, screen_y, palette);
+        write_pixels(tile_pixels, tile_map_x, screen_y, bg_colours);
     }
 
     ++window_internal_scanline_y;
@@ -288,9 +417,6 @@ void Ppu::render_sprites_scanline(uint8_t screen_y)
     bool is_8x16 = check_lcdc(LCDC::ObjSize);
     int max_obj_height_idx = is_8x16 ? 15 : 7;
 
-    auto obj_palette_0 = get_palette(obj0_palette);
-    auto obj_palette_1 = get_palette(obj1_palette);
-
     for (const GBSprite& sprite : oam_buffer)
     {
         // Convert sprite position to screen coordinates
@@ -302,8 +428,8 @@ void Ppu::render_sprites_scanline(uint8_t screen_y)
             screen_y - obj_screen_y; 
 
         auto& palette = (sprite.dmg_palette_number == 0) ? 
-            obj_palette_0 : 
-            obj_palette_1;
+            obj0_colours : 
+            obj1_colours;
 
         int tile_num = (is_8x16) ? (sprite.tile_number & 0xFE) : sprite.tile_number;
 
@@ -331,16 +457,16 @@ void Ppu::oam_scan(uint8_t screen_y)
 
         uint16_t start_addr = OAM_START + static_cast<uint16_t>(sizeof(GBSprite)) * i;
 
-        uint8_t y_pos = mmu.read_byte(start_addr);
-        uint8_t x_pos = mmu.read_byte(start_addr + 1);
+        uint8_t y_pos = mmu.read_video(start_addr);
+        uint8_t x_pos = mmu.read_video(start_addr + 1);
         if (x_pos == 0) continue;
 
         int obj_screen_y = static_cast<int>(y_pos) - 16;
         if (screen_y < obj_screen_y) continue;
         if (screen_y >= obj_screen_y + obj_height) continue;
 
-        uint8_t tile_num = mmu.read_byte(start_addr + 2);
-        uint8_t attrib = mmu.read_byte(start_addr + 3);
+        uint8_t tile_num = mmu.read_video(start_addr + 2);
+        uint8_t attrib = mmu.read_video(start_addr + 3);
 
         oam_buffer.emplace_back(y_pos, x_pos, tile_num, attrib); 
     }
@@ -362,7 +488,7 @@ std::pair<uint8_t, uint8_t> Ppu::fetch_tile_row(int tile_map_x, int tile_map_y,
     int tile_id_offset = tile_x + (GBResolution::TILES_PER_ROW * tile_y); 
 
     uint16_t tile_map_start = use_9C00_tile_map ? TILE_MAP_9C00_START : TILE_MAP_9800_START;
-    uint8_t tile_id = mmu.read_byte(tile_map_start + tile_id_offset);
+    uint8_t tile_id = mmu.read_video(tile_map_start + tile_id_offset);
 
     // Points to first row of tile
     uint16_t tile_address = check_lcdc(LCDC::BgWindowTileDataArea) ?
@@ -374,8 +500,8 @@ std::pair<uint8_t, uint8_t> Ppu::fetch_tile_row(int tile_map_x, int tile_map_y,
         + ((tile_map_y % GBTile::SIZE_PIXELS) * GBTile::BYTES_PER_ROW);
 
     // Get first two bytes of tile data to obtain one tile row
-    uint8_t tile_row_first_byte = mmu.read_byte(row_address);
-    uint8_t tile_row_second_byte = mmu.read_byte(row_address + 1);
+    uint8_t tile_row_first_byte = mmu.read_video(row_address);
+    uint8_t tile_row_second_byte = mmu.read_video(row_address + 1);
 
     return std::make_pair(tile_row_first_byte, tile_row_second_byte);
 }
@@ -388,8 +514,8 @@ std::pair<uint8_t, uint8_t> Ppu::fetch_sprite_tile_row(int tile_id, int tile_map
         + (tile_map_y * GBTile::BYTES_PER_ROW); // Points to right tile row
 
     // Get first two bytes of tile data to obtain one tile row
-    uint8_t tile_row_first_byte = mmu.read_byte(row_address);
-    uint8_t tile_row_second_byte = mmu.read_byte(row_address + 1);
+    uint8_t tile_row_first_byte = mmu.read_video(row_address);
+    uint8_t tile_row_second_byte = mmu.read_video(row_address + 1);
 
     return std::make_pair(tile_row_first_byte, tile_row_second_byte);
 }
@@ -135,6 +135,21 @@ public:
     /// @param cycles Number of CPU cycles to advance.
     void tick(uint32_t cycles);
 
+    /// @returns Number of cycles until the PPU next changes mode, LY or finishes a frame.
+    uint32_t cycles_until_next_event() const;
+
+    /// @param interrupt_enable Value of the IE register.
+    /// @returns Number of cycles until the PPU may next request an enabled interrupt or finishes a frame.
+    uint32_t cycles_until_next_interrupt(uint8_t interrupt_enable) const;
+
+    /// @brief Performs the next mode transition if enough cycles have elapsed.
+    /// @returns true if the mode changed.
+    bool advance_mode();
+
+    /// @brief Recomputes the state decoded from the palette registers, after they were
+    /// overwritten directly (e.g. by loading a save).
+    void sync_registers();
+
     /* OAM Scan */
     void oam_scan(uint8_t screen_y);
 
@@ -217,6 +232,11 @@ private:
     uint8_t& window_scroll_y;
     uint8_t& scanline_y;
 
+    // Palettes decoded from BGP/OBP0/OBP1 whenever they are written
+    std::array<uint8_t, 4> bg_colours{};
+    std::array<uint8_t, 4> obj0_colours{};
+    std::array<uint8_t, 4> obj1_colours{};
+
     std::vector<GBSprite> oam_buffer{};
 
     // Keep track of raw colour indices per scanline
@@ -234,5 +254,7 @@ private:
     inline void set_scanline(uint8_t new_scanline);
     inline void update_coincidence_flag();
 
+    void register_io_handlers();
+
     friend class Gameboy;
 };
\ No newline at end of file
@@ -1,7 +1,30 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 struct Settings
 {
     bool debug_mode = false;
     bool save_stage_trigger = false;
+    bool opcode_profile_trigger = false;
+    bool call_profile_trigger = false;
+    bool debugger_resume_trigger = false;
+    bool memory_stats_trigger = false;
+
+    std::string call_profile_path = "call_profile.folded"; // Folded stacks, e.g. for flamegraph.pl
+    std::string bus_trace_path = "bus_trace.bin"; // Written by GB_TRACE_BUS builds, see BusTrace for the format
+
+    bool use_block_cache = true; // Execute from predecoded instruction blocks
+    bool use_jit = true; // Compile hot ROM blocks to native code (x86-64 only, needs the block cache)
+    bool skip_idle_loops = true; // Fast-forward ROM loops that only poll LY/STAT/IF etc. until the next event
+    bool accurate_timing = false; // Advance the timer/PPU on every memory access inside an instruction (much slower)
+    std::vector<std::string> cheat_codes; // GameShark/Game Genie codes enabled on power on
+
+    bool watchdog = false; // Stop with a diagnostic when the program hangs, e.g. on an illegal opcode (for unattended runs)
+
+    // CPU T-cycles per timer/PPU T-cycle. Above 1 only the CPU is overclocked, so games whose
+    // logic overruns a frame stop slowing down while video and timer rates stay the same.
+    uint32_t cpu_speed = 1;
 };
\ No newline at end of file
@@ -8,46 +8,13 @@
 
 #include "cpu.hpp"
 #include "json.hpp"
+#include "unit_tests.hpp"
 
 using json = nlohmann::json;
 
 
 namespace GBTests
 {
-    /// @brief Compares two values and throws an exception if they differ.
-    /// @tparam T type of values being compared. Must support equality comparison.
-    /// @param val Value being checked.
-    /// @param other_val Value compared against.
-    /// @param name Descriptive label used in error output and exception messages.
-    /// @throws `std::runtime_error` thrown when values are not equal
-    template<typename T>
-    void check_val(T val, T other_val, std::string name)
-    {   
-        if (val != other_val) 
-        {
-            // To prevent printing the ascii character instead of number for uint8_t, uint16_t etc.
-            if constexpr (std::is_arithmetic<T>::value)
-                std::cout << name << " Expected: " << +other_val << " Got: " << +val << '\n';
-            else
-                std::cout << name << " Expected: " << other_val << " Got: " << val << '\n';
-            
-            throw std::runtime_error(std::string("Fail on ") + name);
-        }
-    }
-
-    /// @brief Converts integer into hexidecimal string representation.
-    /// @param num The integer value to convert.
-    /// @return A lowercase hexadecimal string representing the input number.
-    std::string int_to_hex(int num)
-    {
-        std::stringstream stream;
-
-        if (num < 0x10) stream << "0";
-        stream << std::hex << num;
-
-        return stream.str();
-    }
-
     /// @brief Runs instruction tests over a specified opcode range.
     /// @param cpu
     /// @param cpu
@@ -1,6 +1,7 @@
 #include "timer.hpp"
 
 #include <iostream>
+#include <algorithm>
 
 Timer::Timer(Mmu& _mmu) : 
     mmu(_mmu),
@@ -8,23 +9,38 @@ Timer::Timer(Mmu& _mmu) :
     tima(mmu.read_io_reg(TIMER_COUNTER)),
     tma(mmu.read_io_reg(TIMER_MODULO)),
     tac(mmu.read_io_reg(TIMER_CONTROL))
-{}
+{
+    decode_tac();
+
+    mmu.set_io_write_handler(TIMER_CONTROL, [this](uint8_t byte) {
+        tac = byte;
+        decode_tac();
+    });
+}
+
+void Timer::decode_tac()
+{
+    tima_enable = (tac & 0b100) != 0;
+    clock_freq = clock_select_freq[tac & 0b11];
+}
 
 void Timer::tick(uint32_t cycles)
 {
     div_counter += cycles;
     div = (div_counter >> 8) & 0xFF;
 
-    bool tima_enable = (tac & 0b100) != 0;
-    uint32_t clock_freq = clock_select_freq[tac & 0b11];
-
     if (!tima_enable) return;
 
     timer_counter += cycles;
-    if (timer_counter >= clock_freq)
+    if (timer_counter < clock_freq) return;
+
+    // Long ticks (e.g. while the CPU is halted) can span several increments,
+    // but a count left over from a slower clock select only causes one.
+    uint32_t increments = (timer_counter - cycles < clock_freq) ? timer_counter / clock_freq : 1;
+    timer_counter %= clock_freq;
+
+    for (; increments > 0; --increments)
     {
-        timer_counter %= clock_freq;
-        
         if (tima + 1 > 0xFF)
         {
             tima = tma;
@@ -35,6 +51,28 @@ void Timer::tick(uint32_t cycles)
     }
 }
 
+uint32_t Timer::cycles_until_next_event() const
+{
+    uint32_t div_cycles = 0x100 - (div_counter & 0xFF);
+
+    if (!tima_enable) return div_cycles;
+
+    uint32_t tima_cycles = (timer_counter < clock_freq) ? clock_freq - timer_counter : 1;
+
+    return std::min(div_cycles, tima_cycles);
+}
+
+uint32_t Timer::cycles_until_next_interrupt() const
+{
+    if (!tima_enable) return UINT32_MAX;
+
+    uint32_t increments_left = 0x100 - tima;
+
+    if (timer_counter >= clock_freq) return 0;
+
+    return (clock_freq - timer_counter) + (increments_left - 1) * clock_freq;
+}
+
 void Timer::test(uint32_t cycles)
 {
     tick(cycles);
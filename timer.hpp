@@ -15,6 +15,16 @@ public:
     /// @param cycles number of cycles to advance.
     void tick(uint32_t cycles);
     void test(uint32_t cycles);
+
+    /// @returns Number of cycles until DIV or TIMA next changes.
+    uint32_t cycles_until_next_event() const;
+
+    /// @returns Number of cycles until TIMA overflows and requests an interrupt.
+    uint32_t cycles_until_next_interrupt() const;
+
+    /// @brief Recomputes the state decoded from TAC, after the registers were
+    /// overwritten directly (e.g. by loading a save).
+    void sync_registers() { decode_tac(); }
     
 private:
     static constexpr std::array<uint16_t, 4> clock_select_freq { 1024, 16, 64, 256 };
@@ -27,6 +37,12 @@ private:
     uint8_t& tma; // Timer Modulo; When TIMA overflow: reset value to this
     uint8_t& tac; // Controls behaviour for TIMA
 
-    uint16_t div_counter;
-    uint16_t timer_counter;
+    uint16_t div_counter{};
+    uint32_t timer_counter{};
+
+    // Decoded from TAC whenever it is written
+    bool tima_enable = false;
+    uint32_t clock_freq = clock_select_freq[0];
+
+    void decode_tac();
 };
\ No newline at end of file
@@ -0,0 +1,1273 @@
+#pragma once
+
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <random>
+
+#include "cartridge.hpp"
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "jit.hpp"
+#include "opcodes.hpp"
+#include "joypad.hpp"
+#include "debugger.hpp"
+#include "cheats.hpp"
+#include "memory_scan.hpp"
+
+// Self-contained tests of the emulator core, run with `--unit-tests`.
+// The SingleStepTests runner in tests.hpp needs the JSON test data and json.hpp.
+namespace GBTests
+{
+    /// @brief Compares two values and throws an exception if they differ.
+    /// @tparam T type of values being compared. Must support equality comparison.
+    /// @param val Value being checked.
+    /// @param other_val Value compared against.
+    /// @param name Descriptive label used in error output and exception messages.
+    /// @throws `std::runtime_error` thrown when values are not equal
+    template<typename T>
+    void check_val(T val, T other_val, std::string name)
+    {
+        if (val != other_val)
+        {
+            // To prevent printing the ascii character instead of number for uint8_t, uint16_t etc.
+            if constexpr (std::is_arithmetic<T>::value)
+                std::cout << name << " Expected: " << +other_val << " Got: " << +val << '\n';
+            else
+                std::cout << name << " Expected: " << other_val << " Got: " << val << '\n';
+
+            throw std::runtime_error(std::string("Fail on ") + name);
+        }
+    }
+
+    /// @brief Converts integer into hexidecimal string representation.
+    /// @param num The integer value to convert.
+    /// @return A lowercase hexadecimal string representing the input number.
+    inline std::string int_to_hex(int num)
+    {
+        std::stringstream stream;
+
+        if (num < 0x10) stream << "0";
+        stream << std::hex << num;
+
+        return stream.str();
+    }
+
+    /// @brief check_val() for loops over many cases, which only builds the label once a case fails.
+    template<typename T, typename Describe>
+    void check_case(T val, T other_val, Describe describe)
+    {
+        if (val != other_val)
+            check_val(val, other_val, describe());
+    }
+
+    /// @returns Space separated "name=$XX" pairs, to label a failing case.
+    inline std::string describe_case(std::initializer_list<std::pair<const char*, int>> values)
+    {
+        std::stringstream stream;
+        stream << std::hex;
+
+        for (const auto& [name, value] : values)
+            stream << name << "=$" << value << ' ';
+
+        return stream.str();
+    }
+
+    /// @brief A Game Boy without a display, running a ROM built by a test.
+    struct TestSystem
+    {
+        Cartridge cartridge;
+        Mmu mmu;
+        Cpu cpu;
+
+        TestSystem(std::vector<uint8_t> rom = std::vector<uint8_t>(0x8000), std::vector<uint8_t> ram = {}) :
+            cartridge(rom, ram),
+            mmu(&cartridge),
+            cpu(mmu)
+        {}
+
+        /// @brief Writes `code` to memory at `address` through the MMU.
+        void load(uint16_t address, const std::vector<uint8_t>& code)
+        {
+            for (size_t i = 0; i < code.size(); ++i)
+                mmu.write_byte(code[i], address + static_cast<uint16_t>(i));
+        }
+
+        /// @brief Runs `count` instructions starting at `address`.
+        void run(uint16_t address, int count = 1)
+        {
+            cpu.get_pc() = address;
+            for (int i = 0; i < count; ++i)
+                cpu.execute_instruction();
+        }
+    };
+
+    /* Lazy Flags */
+    constexpr uint16_t CODE_ADDRESS = 0xC000; // Test code runs from WRAM
+    constexpr uint16_t LOOP_ADDRESS = 0x0150; // Block cache tests run from ROM
+
+    constexpr uint8_t make_flags(bool zero, bool subtraction, bool half_carry, bool carry)
+    {
+        return (zero << 7) | (subtraction << 6) | (half_carry << 5) | (carry << 4);
+    }
+
+    constexpr bool zero_of(uint8_t flags) { return flags & 0x80; }
+    constexpr bool subtraction_of(uint8_t flags) { return flags & 0x40; }
+    constexpr bool half_carry_of(uint8_t flags) { return flags & 0x20; }
+    constexpr bool carry_of(uint8_t flags) { return flags & 0x10; }
+
+    struct FlagResult
+    {
+        uint8_t value = 0;
+        uint8_t flags = 0;
+    };
+
+    /// @brief Eager reference of ADD/ADC/SUB/SBC/AND/XOR/OR/CP A, `b`, by the opcode's bits 3-5.
+    inline FlagResult reference_alu(int operation, uint8_t a, uint8_t b, bool carry)
+    {
+        int c = (operation == 1 || operation == 3) ? carry : 0;
+
+        switch (operation)
+        {
+        case 0:
+        case 1:
+        {
+            int result = a + b + c;
+            return { static_cast<uint8_t>(result), make_flags((result & 0xFF) == 0, false, (a & 0xF) + (b & 0xF) + c > 0xF, result > 0xFF) };
+        }
+        case 2:
+        case 3:
+        case 7:
+        {
+            int result = a - b - c;
+            uint8_t value = (operation == 7) ? a : static_cast<uint8_t>(result);
+            return { value, make_flags((result & 0xFF) == 0, true, (a & 0xF) < (b & 0xF) + c, result < 0) };
+        }
+        case 4: return { static_cast<uint8_t>(a & b), make_flags((a & b) == 0, false, true, false) };
+        case 5: return { static_cast<uint8_t>(a ^ b), make_flags((a ^ b) == 0, false, false, false) };
+        default: return { static_cast<uint8_t>(a | b), make_flags((a | b) == 0, false, false, false) };
+        }
+    }
+
+    /// @brief Eager reference of the CB-prefixed RLC/RRC/RL/RR/SLA/SRA/SWAP/SRL, by the opcode's bits 3-5.
+    /// The A rotates (RLCA etc.) are the same, except that they always clear Z.
+    inline FlagResult reference_shift(int operation, uint8_t value, bool carry)
+    {
+        int result = 0;
+        bool carry_out = false;
+
+        switch (operation)
+        {
+        case 0: result = (value << 1) | (value >> 7); carry_out = value & 0x80; break;
+        case 1: result = (value >> 1) | (value << 7); carry_out = value & 0x01; break;
+        case 2: result = (value << 1) | carry; carry_out = value & 0x80; break;
+        case 3: result = (value >> 1) | (carry << 7); carry_out = value & 0x01; break;
+        case 4: result = value << 1; carry_out = value & 0x80; break;
+        case 5: result = (value >> 1) | (value & 0x80); carry_out = value & 0x01; break;
+        case 6: result = (value << 4) | (value >> 4); break;
+        default: result = value >> 1; carry_out = value & 0x01; break;
+        }
+
+        uint8_t byte = static_cast<uint8_t>(result);
+        return { byte, make_flags(byte == 0, false, false, carry_out) };
+    }
+
+    inline FlagResult reference_daa(uint8_t a, uint8_t flags)
+    {
+        bool carry = carry_of(flags);
+
+        if (!subtraction_of(flags))
+        {
+            if (carry || a > 0x99) { a += 0x60; carry = true; }
+            if (half_carry_of(flags) || (a & 0x0F) > 0x09) a += 0x06;
+        }
+        else
+        {
+            if (carry) a -= 0x60;
+            if (half_carry_of(flags)) a -= 0x06;
+        }
+
+        return { a, make_flags(a == 0, subtraction_of(flags), false, carry) };
+    }
+
+    /// @brief Flags after ADD SP, e8 and LD HL, SP + e8, which come from the low byte as unsigned.
+    constexpr uint8_t reference_sp_offset_flags(uint16_t sp, uint8_t offset)
+    {
+        return make_flags(false, false, (sp & 0xF) + (offset & 0xF) > 0xF, (sp & 0xFF) + offset > 0xFF);
+    }
+
+    /// @brief Compares the lazily evaluated flags of every flag-setting instruction with an eager
+    /// reference, both read back through F and consumed by a following instruction
+    /// (ADC/SBC, DAA, RLA/RRA, CCF, PUSH AF and conditional jumps).
+    void test_lazy_flags()
+    {
+        TestSystem system;
+        Cpu& cpu = system.cpu;
+
+        const uint8_t flag_inputs[] = { 0x00, 0x10, 0xE0, 0xF0 };
+
+        auto set_registers = [&](uint8_t a, uint8_t f, uint8_t b)
+        {
+            cpu.get_F() = f;
+            cpu.get_A() = a;
+            cpu.get_bc().high = b;
+        };
+
+        // ADD/ADC/SUB/SBC/AND/XOR/OR/CP A, B
+        for (int operation = 0; operation < 8; ++operation)
+        {
+            system.load(CODE_ADDRESS, { static_cast<uint8_t>(0x80 | (operation << 3)) });
+
+            for (int a = 0; a < 0x100; ++a)
+            for (int b = 0; b < 0x100; ++b)
+            for (uint8_t f : flag_inputs)
+            {
+                set_registers(a, f, b);
+                system.run(CODE_ADDRESS);
+
+                FlagResult expected = reference_alu(operation, a, b, carry_of(f));
+                auto describe = [&] { return "ALU $" + int_to_hex(0x80 | (operation << 3)) + ' ' + describe_case({ { "a", a }, { "b", b }, { "f", f } }); };
+                check_case(cpu.get_A(), expected.value, describe);
+                check_case(cpu.get_F(), expected.flags, describe);
+            }
+        }
+
+        // INC B / DEC B keep the carry
+        for (int decrement = 0; decrement < 2; ++decrement)
+        {
+            system.load(CODE_ADDRESS, { static_cast<uint8_t>(decrement ? 0x05 : 0x04) });
+
+            for (int b = 0; b < 0x100; ++b)
+            for (uint8_t f : flag_inputs)
+            {
+                set_registers(0, f, b);
+                system.run(CODE_ADDRESS);
+
+                uint8_t result = static_cast<uint8_t>(decrement ? b - 1 : b + 1);
+                bool half_carry = decrement ? (b & 0xF) == 0 : (b & 0xF) == 0xF;
+                auto describe = [&] { return std::string(decrement ? "DEC B " : "INC B ") + describe_case({ { "b", b }, { "f", f } }); };
+                check_case(cpu.get_bc().high, result, describe);
+                check_case(cpu.get_F(), make_flags(result == 0, decrement, half_carry, carry_of(f)), describe);
+            }
+        }
+
+        // DAA on every A and flag combination
+        system.load(CODE_ADDRESS, { 0x27 });
+        for (int a = 0; a < 0x100; ++a)
+        for (int f = 0; f < 0x100; f += 0x10)
+        {
+            set_registers(a, f, 0);
+            system.run(CODE_ADDRESS);
+
+            FlagResult expected = reference_daa(a, f);
+            auto describe = [&] { return "DAA " + describe_case({ { "a", a }, { "f", f } }); };
+            check_case(cpu.get_A(), expected.value, describe);
+            check_case(cpu.get_F(), expected.flags, describe);
+        }
+
+        // Instructions reading the flags of a pending ADD/SUB/ADC/SBC
+        struct FlagReader
+        {
+            const char* name;
+            uint8_t opcode;
+        };
+
+        const FlagReader readers[] = { { "ADC", 0x88 }, { "SBC", 0x98 }, { "DAA", 0x27 }, { "RLA", 0x17 }, { "RRA", 0x1F }, { "CCF", 0x3F }, { "CPL", 0x2F }, { "SCF", 0x37 } };
+
+        for (int operation : { 0, 1, 2, 3 })
+        for (const FlagReader& reader : readers)
+        {
+            system.load(CODE_ADDRESS, { static_cast<uint8_t>(0x80 | (operation << 3)), reader.opcode });
+
+            for (int a = 0; a < 0x100; ++a)
+            for (int b = 0; b < 0x100; ++b)
+            {
+                set_registers(a, 0x10, b);
+                system.run(CODE_ADDRESS, 2);
+
+                FlagResult first = reference_alu(operation, a, b, true);
+                FlagResult expected;
+
+                switch (reader.opcode)
+                {
+                case 0x88: expected = reference_alu(1, first.value, b, carry_of(first.flags)); break;
+                case 0x98: expected = reference_alu(3, first.value, b, carry_of(first.flags)); break;
+                case 0x27: expected = reference_daa(first.value, first.flags); break;
+                case 0x17:
+                case 0x1F:
+                    expected = reference_shift(reader.opcode == 0x17 ? 2 : 3, first.value, carry_of(first.flags));
+                    expected.flags &= ~0x80;
+                    break;
+                case 0x3F: expected = { first.value, make_flags(zero_of(first.flags), false, false, !carry_of(first.flags)) }; break;
+                case 0x2F: expected = { static_cast<uint8_t>(~first.value), static_cast<uint8_t>(first.flags | 0x60) }; break;
+                default: expected = { first.value, make_flags(zero_of(first.flags), false, false, true) }; break;
+                }
+
+                auto describe = [&] { return "ALU $" + int_to_hex(0x80 | (operation << 3)) + " then " + reader.name + ' ' + describe_case({ { "a", a }, { "b", b } }); };
+                check_case(cpu.get_A(), expected.value, describe);
+                check_case(cpu.get_F(), expected.flags, describe);
+            }
+        }
+
+        // RLCA/RRCA/RLA/RRA always clear Z
+        for (int operation = 0; operation < 4; ++operation)
+        {
+            system.load(CODE_ADDRESS, { static_cast<uint8_t>(0x07 | (operation << 3)) });
+
+            for (int a = 0; a < 0x100; ++a)
+            for (uint8_t f : flag_inputs)
+            {
+                set_registers(a, f, 0);
+                system.run(CODE_ADDRESS);
+
+                FlagResult expected = reference_shift(operation, a, carry_of(f));
+                auto describe = [&] { return "Rotate A $" + int_to_hex(0x07 | (operation << 3)) + ' ' + describe_case({ { "a", a }, { "f", f } }); };
+                check_case(cpu.get_A(), expected.value, describe);
+                check_case(cpu.get_F(), static_cast<uint8_t>(expected.flags & ~0x80), describe);
+            }
+        }
+
+        // CB-prefixed shifts and BIT on B
+        for (int operation = 0; operation < 8; ++operation)
+        {
+            system.load(CODE_ADDRESS, { 0xCB, static_cast<uint8_t>(operation << 3) });
+
+            for (int b = 0; b < 0x100; ++b)
+            for (uint8_t f : flag_inputs)
+            {
+                set_registers(0, f, b);
+                system.run(CODE_ADDRESS);
+
+                FlagResult expected = reference_shift(operation, b, carry_of(f));
+                auto describe = [&] { return "CB $" + int_to_hex(operation << 3) + ' ' + describe_case({ { "b", b }, { "f", f } }); };
+                check_case(cpu.get_bc().high, expected.value, describe);
+                check_case(cpu.get_F(), expected.flags, describe);
+            }
+        }
+
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            system.load(CODE_ADDRESS, { 0xCB, static_cast<uint8_t>(0x40 | (bit << 3)) });
+
+            for (int b = 0; b < 0x100; ++b)
+            for (uint8_t f : flag_inputs)
+            {
+                set_registers(0, f, b);
+                system.run(CODE_ADDRESS);
+
+                auto describe = [&] { return "BIT " + std::to_string(bit) + ", B " + describe_case({ { "b", b }, { "f", f } }); };
+                check_case(cpu.get_F(), make_flags(!(b & (1 << bit)), false, true, carry_of(f)), describe);
+            }
+        }
+
+        // ADD HL, BC keeps Z and carries out of bits 11 and 15
+        system.load(CODE_ADDRESS, { 0x09 });
+        for (int hl = 0; hl < 0x10000; hl += 0x0FF1)
+        for (int bc = 0; bc < 0x10000; bc += 0x00F7)
+        for (uint8_t f : { uint8_t(0x00), uint8_t(0xF0) })
+        {
+            cpu.get_F() = f;
+            cpu.get_hl().r16 = static_cast<uint16_t>(hl);
+            cpu.get_bc().r16 = static_cast<uint16_t>(bc);
+            system.run(CODE_ADDRESS);
+
+            uint16_t result = static_cast<uint16_t>(hl + bc);
+            uint8_t flags = make_flags(zero_of(f), false, (hl & 0xFFF) + (bc & 0xFFF) > 0xFFF, hl + bc > 0xFFFF);
+            auto describe = [&] { return "ADD HL, BC " + describe_case({ { "hl", hl }, { "bc", bc }, { "f", f } }); };
+            check_case(cpu.get_hl().r16, result, describe);
+            check_case(cpu.get_F(), flags, describe);
+        }
+
+        // ADD SP, e8 and LD HL, SP + e8
+        for (uint8_t opcode : { uint8_t(0xE8), uint8_t(0xF8) })
+        for (int offset = 0; offset < 0x100; ++offset)
+        {
+            system.load(CODE_ADDRESS, { opcode, static_cast<uint8_t>(offset) });
+
+            for (int sp = 0; sp < 0x10000; sp += 0x0F3)
+            for (uint8_t f : { uint8_t(0x00), uint8_t(0xF0) })
+            {
+                cpu.get_F() = f;
+                cpu.get_sp() = static_cast<uint16_t>(sp);
+                system.run(CODE_ADDRESS);
+
+                uint16_t result = static_cast<uint16_t>(sp + static_cast<int8_t>(offset));
+                uint16_t got = (opcode == 0xE8) ? cpu.get_sp() : cpu.get_hl().r16;
+                auto describe = [&] { return std::string(opcode == 0xE8 ? "ADD SP, e8 " : "LD HL, SP + e8 ") + describe_case({ { "sp", sp }, { "e8", offset }, { "f", f } }); };
+                check_case(got, result, describe);
+                check_case(cpu.get_F(), reference_sp_offset_flags(static_cast<uint16_t>(sp), static_cast<uint8_t>(offset)), describe);
+            }
+        }
+
+        // PUSH AF and conditional jumps right after a pending CP/DEC
+        system.load(CODE_ADDRESS, { 0xB8, 0xF5, 0x38, 0x01, 0x00, 0x20, 0x01 }); // CP B; PUSH AF; JR C, +1; NOP; JR NZ, +1
+        for (int a = 0; a < 0x100; ++a)
+        for (int b = 0; b < 0x100; ++b)
+        {
+            set_registers(a, 0x00, b);
+            cpu.get_sp() = 0xD000;
+            system.run(CODE_ADDRESS, 3);
+
+            FlagResult expected = reference_alu(7, a, b, false);
+            auto describe = [&] { return "CP B then PUSH AF/JR " + describe_case({ { "a", a }, { "b", b } }); };
+            check_case(system.mmu.read_byte(0xCFFE), expected.flags, describe);
+
+            uint16_t after_jr_c = carry_of(expected.flags) ? CODE_ADDRESS + 5 : CODE_ADDRESS + 4;
+            check_case(cpu.get_pc(), after_jr_c, describe);
+
+            if (!carry_of(expected.flags))
+            {
+                system.run(CODE_ADDRESS + 5);
+                check_case(cpu.get_pc(), static_cast<uint16_t>(zero_of(expected.flags) ? CODE_ADDRESS + 7 : CODE_ADDRESS + 8), describe);
+            }
+        }
+
+        std::cout << "Passed Test: lazy flags\n";
+    }
+
+    /* Joypad */
+    /// @brief Keys are sampled once per frame, but JOYP shows the group selected when it is read.
+    void test_joypad_select()
+    {
+        TestSystem system;
+        Joypad joypad(system.mmu);
+
+        bool keyboard[SDL_SCANCODE_COUNT] = {};
+        keyboard[GBInput::BUTTON_A] = true;
+        keyboard[GBInput::DPAD_LEFT] = true;
+
+        // Sampled while the buttons are selected
+        system.mmu.write_byte(0x10, JOYPAD_INPUT);
+        joypad.handle_inputs(keyboard);
+        check_val<uint8_t>(system.mmu.read_byte(JOYPAD_INPUT) & 0x0F, 0x0F & ~GBJoypad::BUTTON_A, "JOYP, buttons");
+        check_val<uint8_t>(system.mmu.get_interrupt_flag() & static_cast<uint8_t>(Interrupts::JoyPad), static_cast<uint8_t>(Interrupts::JoyPad), "IF after a key press");
+
+        // Switching group mid-frame, without sampling again
+        system.mmu.write_byte(0x20, JOYPAD_INPUT);
+        check_val<uint8_t>(system.mmu.read_byte(JOYPAD_INPUT) & 0x0F, 0x0F & ~GBJoypad::DPAD_LEFT, "JOYP, d-pad");
+
+        system.mmu.write_byte(0x00, JOYPAD_INPUT);
+        check_val<uint8_t>(system.mmu.read_byte(JOYPAD_INPUT) & 0x0F, 0x0F & ~(GBJoypad::BUTTON_A | GBJoypad::DPAD_LEFT), "JOYP, both");
+
+        system.mmu.write_byte(0x30, JOYPAD_INPUT);
+        check_val<uint8_t>(system.mmu.read_byte(JOYPAD_INPUT) & 0x0F, 0x0F, "JOYP, none");
+
+        keyboard[GBInput::BUTTON_A] = false;
+        system.mmu.write_byte(0x10, JOYPAD_INPUT);
+        joypad.handle_inputs(keyboard);
+        check_val<uint8_t>(system.mmu.read_byte(JOYPAD_INPUT) & 0x0F, 0x0F, "JOYP after a release");
+
+        std::cout << "Passed Test: joypad select\n";
+    }
+
+    /* Debugger */
+    /// @brief The checked run loop dispatches interrupts as a step of their own, so a breakpoint
+    /// on a vector stops before the handler's first instruction, halted or not.
+    void test_interrupt_vector_breakpoint()
+    {
+        std::vector<uint8_t> rom(0x8000);
+        rom[VBLANK_INTERRUPT_START] = 0xD9; // RETI
+
+        const uint8_t main_loop[] = { 0xFB, 0x76, 0x00, 0x18, 0xFB }; // EI; HALT; NOP; JR -5
+        std::copy(std::begin(main_loop), std::end(main_loop), rom.begin() + 0x150);
+
+        TestSystem system(rom);
+        Cpu& cpu = system.cpu;
+        Debugger debugger(system.mmu);
+
+        int hits = 0;
+        debugger.add_breakpoint(VBLANK_INTERRUPT_START, ANY_BANK, [&hits](const WatchHit&) { ++hits; }, false);
+
+        auto should_stop = [&] { return cpu.get_halted_state() ? debugger.is_paused() : debugger.before_instruction(cpu.get_pc()); };
+
+        system.mmu.get_interrupt_enable() = static_cast<uint8_t>(Interrupts::VBlank);
+        cpu.get_pc() = 0x150;
+
+        for (int frame = 0; frame < 5; ++frame)
+        {
+            cpu.execute_cycles_checked(1000, should_stop);
+            system.mmu.get_interrupt_flag() |= static_cast<uint8_t>(Interrupts::VBlank);
+            cpu.execute_cycles_checked(1000, should_stop);
+        }
+
+        check_val(hits, 5, "Breakpoint hits on the VBlank vector");
+
+        std::cout << "Passed Test: interrupt vector breakpoint\n";
+    }
+
+    /// @brief Watchpoints on WRAM or echo RAM trigger on accesses through either mirror.
+    void test_echo_watchpoints()
+    {
+        TestSystem system;
+        Debugger debugger(system.mmu);
+
+        int echo_hits = 0;
+        int work_ram_hits = 0;
+        debugger.add_watchpoint(0xE000, 0xE0FF, static_cast<uint8_t>(WatchAccess::Write), ANY_BANK, [&echo_hits](const WatchHit&) { ++echo_hits; }, false);
+        debugger.add_watchpoint(0xC100, 0xC1FF, static_cast<uint8_t>(WatchAccess::Read), ANY_BANK, [&work_ram_hits](const WatchHit&) { ++work_ram_hits; }, false);
+
+        system.mmu.write_byte(0x12, 0xC010);
+        system.mmu.write_byte(0x34, 0xE020);
+        system.mmu.write_byte(0x56, 0xC110); // Outside of the echo range's WRAM
+        check_val(echo_hits, 2, "Write hits on an echo RAM range");
+
+        system.mmu.read_byte(0xC180);
+        system.mmu.read_byte(0xE180);
+        system.mmu.read_byte(0xE010);
+        check_val(work_ram_hits, 2, "Read hits on a WRAM range");
+
+        std::cout << "Passed Test: echo watchpoints\n";
+    }
+
+    /* Memory */
+    /// @brief peek_byte() sees memory through OAM DMA and without firing debugger traps.
+    void test_peek_byte()
+    {
+        TestSystem system;
+        Debugger debugger(system.mmu);
+
+        system.load(CODE_ADDRESS, { 0x18, 0xFE }); // JR -2
+
+        int hits = 0;
+        debugger.add_watchpoint(CODE_ADDRESS, CODE_ADDRESS + 1, static_cast<uint8_t>(WatchAccess::Read), ANY_BANK, [&hits](const WatchHit&) { ++hits; }, false);
+
+        check_val<uint8_t>(system.mmu.peek_byte(CODE_ADDRESS), 0x18, "Peeked opcode");
+        check_val<uint8_t>(system.mmu.peek_byte(CODE_ADDRESS + 1), 0xFE, "Peeked operand");
+        check_val(hits, 0, "Watchpoint hits from peeks");
+
+        system.mmu.read_byte(CODE_ADDRESS);
+        check_val(hits, 1, "Watchpoint hits from a read");
+
+        system.mmu.dma_transfer(CODE_ADDRESS >> 8);
+        system.mmu.tick_dma(4);
+        check_val<uint8_t>(system.mmu.read_byte(CODE_ADDRESS), 0xFF, "Read during OAM DMA");
+        check_val<uint8_t>(system.mmu.peek_byte(CODE_ADDRESS), 0x18, "Peek during OAM DMA");
+
+        std::cout << "Passed Test: peek byte\n";
+    }
+
+    /// @brief Decoding cached blocks and analysing idle loops don't fire read watchpoints on
+    /// the code they look at, e.g. a jump table sharing its page with the code.
+    void test_code_page_watchpoints()
+    {
+        std::vector<uint8_t> rom(0x8000);
+        const uint8_t code[] = { 0xFA, 0x00, 0xC0, 0xFE, 0x01, 0x20, 0xF9 }; // LD A, [0xC000]; CP 0x01; JR NZ, -7
+        std::copy(std::begin(code), std::end(code), rom.begin() + 0x4000);
+
+        TestSystem system(rom);
+        Cpu& cpu = system.cpu;
+        Debugger debugger(system.mmu);
+        cpu.set_block_cache_enabled(true);
+        cpu.set_idle_loop_skip_enabled(true);
+
+        int hits = 0;
+        debugger.add_watchpoint(0x4000, 0x40FF, static_cast<uint8_t>(WatchAccess::Read), ANY_BANK, [&hits](const WatchHit&) { ++hits; }, false);
+
+        cpu.get_pc() = 0x4000;
+        cpu.get_sp() = 0xFFFE;
+        for (int frame = 0; frame < 4; ++frame)
+            cpu.execute_cycles(1000);
+
+        for (int frame = 0; frame < 4; ++frame)
+            cpu.execute_cycles_checked(1000, [] { return false; });
+
+        check_val<uint16_t>(cpu.get_pc() & 0xFF00, 0x4000, "PC inside the loop");
+        check_val(hits, 0, "Watchpoint hits from running the watched code");
+
+        std::cout << "Passed Test: code page watchpoints\n";
+    }
+
+    /// @brief A ROM block first decoded during OAM DMA holds the ROM's code, not the 0xFF the
+    /// CPU reads meanwhile, so it still runs correctly once the transfer has ended.
+    void test_block_decode_during_dma()
+    {
+        std::vector<uint8_t> rom(0x8000);
+        const uint8_t code[] = { 0x3E, 0x42, 0x47, 0x04, 0x18, 0xFE }; // LD A, 0x42; LD B, A; INC B; JR -2
+        std::copy(std::begin(code), std::end(code), rom.begin() + LOOP_ADDRESS);
+
+        TestSystem system(rom);
+        Cpu& cpu = system.cpu;
+        cpu.set_block_cache_enabled(true);
+
+        system.mmu.dma_transfer(CODE_ADDRESS >> 8);
+        system.mmu.tick_dma(4);
+        cpu.get_pc() = LOOP_ADDRESS;
+        cpu.get_sp() = 0xFFFE;
+        cpu.execute_instruction();
+
+        system.mmu.tick_dma(1000);
+        check_val(system.mmu.is_dma_active(), false, "OAM DMA over");
+
+        cpu.get_pc() = LOOP_ADDRESS;
+        for (int i = 0; i < 3; ++i)
+            cpu.execute_instruction();
+
+        check_val<uint8_t>(cpu.get_A(), 0x42, "A after the block");
+        check_val<uint8_t>(cpu.get_bc().high, 0x43, "B after the block");
+        check_val<uint16_t>(cpu.get_pc(), LOOP_ADDRESS + 4, "PC after the block");
+
+        std::cout << "Passed Test: block decode during DMA\n";
+    }
+
+    /* Cartridge */
+    /// @returns A ROM of `banks` 16 KiB banks, each starting with its bank number, with the given header type and sizes.
+    inline std::vector<uint8_t> make_banked_rom(size_t banks, uint8_t type, uint8_t rom_size, uint8_t ram_size)
+    {
+        std::vector<uint8_t> rom(banks * 0x4000);
+
+        for (size_t bank = 0; bank < banks; ++bank)
+            rom[bank * 0x4000] = static_cast<uint8_t>(bank);
+
+        rom[CARTRIDGE_TYPE] = type;
+        rom[ROM_SIZE] = rom_size;
+        rom[RAM_SIZE] = ram_size;
+
+        return rom;
+    }
+
+    /// @brief ROM bank numbers wrap at the ROM's size, missing or disabled RAM banks read 0xFF
+    /// and ignore writes, and 2 KiB of RAM is mirrored across 0xA000-0xBFFF.
+    void test_cartridge_mapping()
+    {
+        {
+            TestSystem system(make_banked_rom(8, Cartridge::MBC5, 0x02, Cartridge::NoRam));
+            Mmu& mmu = system.mmu;
+
+            mmu.write_byte(9, 0x2000);
+            check_val<uint8_t>(mmu.read_byte(0x4000), 1, "MBC5 bank 9 of 8");
+
+            mmu.write_byte(3, 0x2000);
+            mmu.write_byte(1, 0x3000);
+            check_val<uint8_t>(mmu.read_byte(0x4000), 3, "MBC5 bank 0x103 of 8");
+
+            mmu.write_byte(0, 0x2000);
+            mmu.write_byte(0, 0x3000);
+            check_val<uint8_t>(mmu.read_byte(0x4000), 0, "MBC5 bank 0");
+        }
+
+        {
+            TestSystem system(make_banked_rom(8, Cartridge::MBC3RamBattery, 0x02, Cartridge::Bank8K), std::vector<uint8_t>(0x2000));
+            Mmu& mmu = system.mmu;
+
+            check_val<uint8_t>(mmu.read_byte(0xA000), 0xFF, "MBC3 RAM disabled");
+
+            mmu.write_byte(0x0A, 0x0000);
+            mmu.write_byte(0x42, 0xA000);
+            check_val<uint8_t>(mmu.read_byte(0xA000), 0x42, "MBC3 RAM bank 0");
+
+            mmu.write_byte(2, 0x4000);
+            check_val<uint8_t>(mmu.read_byte(0xA000), 0xFF, "MBC3 missing RAM bank 2");
+            mmu.write_byte(0x99, 0xA000);
+
+            mmu.write_byte(0, 0x4000);
+            check_val<uint8_t>(mmu.read_byte(0xA000), 0x42, "MBC3 RAM bank 0 after a write to a missing bank");
+
+            mmu.write_byte(0x00, 0x0000);
+            check_val<uint8_t>(mmu.read_byte(0xA000), 0xFF, "MBC3 RAM disabled again");
+        }
+
+        {
+            TestSystem system(make_banked_rom(2, Cartridge::RomRam, 0x00, 0x01), std::vector<uint8_t>(0x800));
+            Mmu& mmu = system.mmu;
+
+            mmu.write_byte(0x5A, 0xA001);
+            check_val<uint8_t>(mmu.read_byte(0xA801), 0x5A, "2 KiB RAM mirrored at 0xA801");
+            check_val<uint8_t>(mmu.read_byte(0xB801), 0x5A, "2 KiB RAM mirrored at 0xB801");
+
+            mmu.write_byte(0xA5, 0xBFFF);
+            check_val<uint8_t>(mmu.read_byte(0xA7FF), 0xA5, "2 KiB RAM written through 0xBFFF");
+        }
+
+        std::cout << "Passed Test: cartridge mapping\n";
+    }
+
+    /* Bulk Loops */
+    /// @brief Fills WRAM and VRAM with a pattern, so copies and fills can be told apart.
+    inline void fill_test_pattern(Mmu& mmu)
+    {
+        for (uint32_t address = VRAM_START; address < 0xA000; ++address)
+            mmu.write_byte(static_cast<uint8_t>(address * 3 + 1), address);
+
+        for (uint32_t address = WORK_RAM_START; address < 0xE000; ++address)
+            mmu.write_byte(static_cast<uint8_t>(address * 7 + 5), address);
+    }
+
+    /// @brief Registers, cycles and RAM after running a loop.
+    struct LoopResult
+    {
+        std::array<uint16_t, 6> registers{}; // AF, BC, DE, HL, SP, PC
+        uint32_t cycles = 0;
+        std::vector<uint8_t> memory; // VRAM, then WRAM
+    };
+
+    /// @returns The registers and RAM of `system` after a run that took `cycles` T-cycles.
+    inline LoopResult loop_result(TestSystem& system, uint32_t cycles)
+    {
+        Cpu& cpu = system.cpu;
+
+        LoopResult result;
+        result.cycles = cycles;
+        result.registers = { static_cast<uint16_t>((cpu.get_A() << 8) | cpu.get_F()), cpu.get_bc().r16,
+            cpu.get_de().r16, cpu.get_hl().r16, cpu.get_sp(), cpu.get_pc() };
+
+        for (uint32_t address = VRAM_START; address < 0xA000; ++address)
+            result.memory.push_back(system.mmu.peek_byte(address));
+        for (uint32_t address = WORK_RAM_START; address < 0xE000; ++address)
+            result.memory.push_back(system.mmu.peek_byte(address));
+
+        return result;
+    }
+
+    /// @brief Compares the registers, cycles and memory of a run against a reference run.
+    inline void check_loop_result(const LoopResult& result, const LoopResult& reference, const std::string& name)
+    {
+        const char* register_names[] = { "AF", "BC", "DE", "HL", "SP", "PC" };
+        for (size_t i = 0; i < result.registers.size(); ++i)
+            check_val(result.registers[i], reference.registers[i], name + register_names[i]);
+
+        check_val(result.cycles, reference.cycles, name + "cycles");
+
+        for (size_t i = 0; i < result.memory.size(); ++i)
+        {
+            uint32_t address = (i < VRAM_SIZE) ? VRAM_START + i : WORK_RAM_START + (i - VRAM_SIZE);
+            check_case(result.memory[i], reference.memory[i], [&] { return name + "byte at $" + int_to_hex(address); });
+        }
+    }
+
+    struct BulkLoopCase
+    {
+        const char* name;
+        std::vector<uint8_t> code; // Runs from LOOP_ADDRESS, followed by JR -2
+        uint8_t a;
+        uint16_t bc;
+        uint16_t de;
+        uint16_t hl;
+        uint32_t budget;
+        bool batched; // Whether the block cache runs it as a bulk loop
+    };
+
+    inline LoopResult run_loop(const BulkLoopCase& loop, bool block_cache)
+    {
+        std::vector<uint8_t> rom(0x8000);
+        std::copy(loop.code.begin(), loop.code.end(), rom.begin() + LOOP_ADDRESS);
+        rom[LOOP_ADDRESS + loop.code.size()] = 0x18; // JR -2
+        rom[LOOP_ADDRESS + loop.code.size() + 1] = 0xFE;
+
+        TestSystem system(rom);
+        Cpu& cpu = system.cpu;
+        fill_test_pattern(system.mmu);
+
+        cpu.set_block_cache_enabled(block_cache);
+        cpu.get_A() = loop.a;
+        cpu.get_bc().r16 = loop.bc;
+        cpu.get_de().r16 = loop.de;
+        cpu.get_hl().r16 = loop.hl;
+        cpu.get_sp() = 0xFFFE;
+        cpu.get_pc() = LOOP_ADDRESS;
+
+        return loop_result(system, cpu.execute_cycles(loop.budget));
+    }
+
+    /// @returns Cycles the block cache takes for the first instruction of the loop, which are
+    /// those of every batched iteration if it runs as a bulk loop.
+    inline uint32_t first_step_cycles(const BulkLoopCase& loop)
+    {
+        std::vector<uint8_t> rom(0x8000);
+        std::copy(loop.code.begin(), loop.code.end(), rom.begin() + LOOP_ADDRESS);
+
+        TestSystem system(rom);
+        Cpu& cpu = system.cpu;
+
+        cpu.set_block_cache_enabled(true);
+        cpu.get_A() = loop.a;
+        cpu.get_bc().r16 = loop.bc;
+        cpu.get_de().r16 = loop.de;
+        cpu.get_hl().r16 = loop.hl;
+        cpu.get_pc() = LOOP_ADDRESS;
+        cpu.set_cycle_budget(loop.budget);
+
+        return cpu.execute_instruction();
+    }
+
+    /// @brief Runs copy and fill loops through the block cache's bulk path and the interpreter,
+    /// expecting the same registers, cycles and memory, and checks which loops get batched.
+    void test_bulk_loops()
+    {
+        const std::vector<uint8_t> copy_hl_c = { 0x2A, 0x12, 0x13, 0x0D, 0x20, 0xFA }; // LD A, [HL+]; LD [DE], A; INC DE; DEC C; JR NZ
+        const std::vector<uint8_t> copy_de_b = { 0x1A, 0x22, 0x13, 0x05, 0x20, 0xFA }; // LD A, [DE]; LD [HL+], A; INC DE; DEC B; JR NZ
+        const std::vector<uint8_t> copy_hl_bc = { 0x2A, 0x12, 0x13, 0x0B, 0x78, 0xB1, 0x20, 0xF8 }; // ...; DEC BC; LD A, B; OR C; JR NZ
+        const std::vector<uint8_t> clear_bc = { 0xAF, 0x22, 0x0B, 0x78, 0xB1, 0x20, 0xF9 }; // XOR A; LD [HL+], A; DEC BC; LD A, B; OR C; JR NZ
+        const std::vector<uint8_t> fill_bc = { 0x22, 0x0B, 0x78, 0xB1, 0x20, 0xFA }; // LD [HL+], A; DEC BC; LD A, B; OR C; JR NZ
+        const std::vector<uint8_t> fill_down_b = { 0x3E, 0x5A, 0x32, 0x05, 0x20, 0xFA }; // LD A, 0x5A; LD [HL-], A; DEC B; JR NZ
+
+        const BulkLoopCase cases[] = {
+            { "copy", copy_hl_c, 0, 0x0040, 0x8100, 0xC000, 100000, true },
+            { "copy, destination just above the source", copy_hl_c, 0, 0x0080, 0xC001, 0xC000, 100000, true },
+            { "copy, destination just below the source", copy_hl_c, 0, 0x0080, 0xC000, 0xC001, 100000, true },
+            { "copy from [DE], destination just above the source", copy_de_b, 0, 0x8000, 0xC010, 0xC011, 100000, true },
+            { "copy across pages into echo RAM onto its source", copy_hl_c, 0, 0x00F0, 0xE001, 0xC000, 100000, true },
+            { "copy, C = 0", copy_hl_c, 0, 0x0000, 0xC800, 0xC000, 100000, true },
+            { "copy, BC = 0, cut off by the budget", copy_hl_bc, 0, 0x0000, 0x8000, 0xC000, 200000, true }, // A full pass would reach IO
+            { "copy cut off by the budget", copy_hl_c, 0, 0x0080, 0x8100, 0xC000, 1000, true },
+            { "copy cut off mid-instruction", copy_hl_c, 0, 0x0080, 0x8100, 0xC000, 1010, true },
+            { "clear, BC", clear_bc, 0x77, 0x0300, 0, 0xC100, 100000, true },
+            { "clear cut off by the budget", clear_bc, 0x77, 0x0300, 0, 0xC100, 2000, true },
+            { "fill with A clobbered by LD A, B", fill_bc, 0x77, 0x0300, 0, 0xC100, 100000, false },
+            { "fill down, B = 0", fill_down_b, 0, 0x0000, 0, 0xC3FF, 100000, true },
+        };
+
+        for (const BulkLoopCase& loop : cases)
+        {
+            LoopResult interpreted = run_loop(loop, false);
+            LoopResult cached = run_loop(loop, true);
+            std::string name = std::string("Bulk loop \"") + loop.name + "\" ";
+
+            check_loop_result(cached, interpreted, name);
+
+            // Run one at a time, no instruction of the loop takes more than 12 T-cycles.
+            // Opcode profiles count every iteration, so nothing is batched there.
+            check_val(first_step_cycles(loop) > 12, loop.batched && !GB_PROFILE_OPCODES, name + "batched");
+        }
+
+        std::cout << "Passed Test: bulk loops\n";
+    }
+
+    /* JIT */
+    struct JitCase
+    {
+        const char* name;
+        std::vector<uint8_t> code; // Followed by a JR back to its start
+        int bank_operand; // Index of a byte set to the bank number in every ROM bank's copy of the code run from 0x4000+, or -1 to run it from bank 0
+        uint8_t interrupt_enable;
+        bool ime; // Entered through EI
+        uint16_t hl;
+    };
+
+    inline uint16_t jit_block_address(const JitCase& block)
+    {
+        return (block.bank_operand < 0) ? LOOP_ADDRESS : BANK_N_START + LOOP_ADDRESS;
+    }
+
+    inline std::vector<uint8_t> make_jit_rom(const JitCase& block)
+    {
+        constexpr size_t BANKS = 4;
+        std::vector<uint8_t> rom = make_banked_rom(BANKS, Cartridge::MBC5, 0x01, Cartridge::NoRam);
+        rom[VBLANK_INTERRUPT_START] = 0xD9; // RETI
+
+        uint16_t address = jit_block_address(block);
+        const uint8_t entry[] = { static_cast<uint8_t>(block.ime ? 0xFB : 0xF3), 0xC3, static_cast<uint8_t>(address), static_cast<uint8_t>(address >> 8) }; // EI/DI; JP address
+        std::copy(std::begin(entry), std::end(entry), rom.begin() + 0x100);
+
+        std::vector<uint8_t> code = block.code;
+        code.push_back(0x18); // JR to the start
+        code.push_back(static_cast<uint8_t>(-static_cast<int>(code.size() + 1)));
+
+        for (size_t bank = 0; bank < ((block.bank_operand < 0) ? 1 : BANKS); ++bank)
+        {
+            if (block.bank_operand >= 0) code[block.bank_operand] = static_cast<uint8_t>(bank);
+            std::copy(code.begin(), code.end(), rom.begin() + bank * 0x4000 + LOOP_ADDRESS);
+        }
+
+        return rom;
+    }
+
+    /// @brief Registers, cycles and RAM after running a block, and where execute_cycles() returned.
+    struct JitResult
+    {
+        LoopResult state;
+        std::vector<uint32_t> stops; // Cycles run by the end of each execute_cycles()
+    };
+
+    /// @brief Runs `system` from the block's entry until at least `budget` T-cycles have passed,
+    /// restarting execute_cycles() whenever it returns, like it is run between timer/PPU events.
+    inline JitResult run_jit_system(TestSystem& system, const JitCase& block, bool jit, uint32_t budget)
+    {
+        Cpu& cpu = system.cpu;
+
+        system.mmu.get_interrupt_enable() = block.interrupt_enable;
+        cpu.set_block_cache_enabled(true);
+        cpu.set_jit_enabled(jit);
+        cpu.get_hl().r16 = block.hl;
+        cpu.get_de().r16 = WORK_RAM_START + 0x1000;
+        cpu.get_sp() = 0xFFFE;
+        cpu.get_pc() = 0x100;
+
+        JitResult result;
+        uint32_t cycles = 0;
+
+        while (cycles < budget)
+        {
+            cycles += cpu.execute_cycles(budget - cycles);
+            result.stops.push_back(cycles);
+        }
+
+        result.state = loop_result(system, cycles);
+        return result;
+    }
+
+    /// @brief Runs a block far past JIT_THRESHOLD executions.
+    inline JitResult run_jit_block(const JitCase& block, bool jit)
+    {
+        TestSystem system(make_jit_rom(block));
+        fill_test_pattern(system.mmu);
+
+        return run_jit_system(system, block, jit, 40000);
+    }
+
+    /// @returns Cycles the block cache takes for a step into the hot block, which are those of
+    /// all the instructions the compiled block ran if it was compiled.
+    inline uint32_t hot_step_cycles(const JitCase& block)
+    {
+        TestSystem system(make_jit_rom(block));
+        Cpu& cpu = system.cpu;
+        run_jit_system(system, block, true, 40000);
+
+        // Not an interrupt dispatch, should the run have ended with one pending
+        system.mmu.get_interrupt_flag() = 0;
+
+        cpu.get_pc() = jit_block_address(block);
+        cpu.set_cycle_budget(1000);
+        return cpu.execute_instruction();
+    }
+
+    /// @brief Runs hot ROM blocks with and without the JIT, expecting the same registers,
+    /// cycles and memory, and execute_cycles() to return after the same instructions,
+    /// including in blocks that have to leave compiled code early.
+    void test_jit_blocks()
+    {
+        constexpr uint8_t VBLANK = static_cast<uint8_t>(Interrupts::VBlank);
+
+        const JitCase cases[] = {
+            // LD B, 0x12; LD C, B; INC BC; DEC DE; LD A, 0x77; LD L, A; DI
+            { "native only", { 0x06, 0x12, 0x48, 0x03, 0x1B, 0x3E, 0x77, 0x6F, 0xF3 }, -1, 0, false, 0xC000 },
+            // LD A, [HL+]; ADD A, B; LD [DE], A; INC DE; INC B; LD C, A
+            { "calling handlers", { 0x2A, 0x80, 0x12, 0x13, 0x04, 0x4F }, -1, 0, false, 0xC000 },
+            // INC C; LD A, C; AND 0x03; LD [0x2000], A; LD A, bank; LD [DE], A; INC DE
+            { "exit after an MBC write", { 0x0C, 0x79, 0xE6, 0x03, 0xEA, 0x00, 0x20, 0x3E, 0x00, 0x12, 0x13 }, 8, 0, false, 0xC000 },
+            // INC A; LD [HL], A; LD B, A; INC B
+            { "exit after an IO write", { 0x3C, 0x77, 0x47, 0x04 }, -1, 0, false, 0xFF42 },
+            // LD A, C; LD [HL], A; INC C; LD [DE], A; INC DE
+            { "exit after an IE write", { 0x79, 0x77, 0x0C, 0x12, 0x13 }, -1, 0, false, INTERRUPT_ENABLE },
+            // LD A, 0x01; LD [HL], A; INC B; LD A, B; LD [DE], A; INC DE
+            { "exit after a pending interrupt", { 0x3E, 0x01, 0x77, 0x04, 0x78, 0x12, 0x13 }, -1, VBLANK, true, INTERRUPT_FLAG },
+        };
+
+        for (const JitCase& block : cases)
+        {
+            JitResult interpreted = run_jit_block(block, false);
+            JitResult compiled = run_jit_block(block, true);
+            std::string name = std::string("JIT block \"") + block.name + "\" ";
+
+            check_loop_result(compiled.state, interpreted.state, name);
+
+            check_val(compiled.stops.size(), interpreted.stops.size(), name + "execute_cycles() runs");
+            for (size_t i = 0; i < compiled.stops.size(); ++i)
+                check_case(compiled.stops[i], interpreted.stops[i], [&] { return name + "end of run " + std::to_string(i); });
+
+            // A step into the compiled block runs more than its first instruction
+            uint8_t first_cycles = BASE_OPCODES[block.code[0]].cycles;
+            check_val(hot_step_cycles(block) > first_cycles, GB_JIT_X64 && !GB_PROFILE_OPCODES, name + "compiled");
+        }
+
+        std::cout << "Passed Test: JIT blocks\n";
+    }
+
+    /// @brief Mmu::copy_block() matches copying byte by byte, overlapping ranges included.
+    void test_copy_block()
+    {
+        struct Copy
+        {
+            uint16_t destination;
+            uint16_t source;
+            uint32_t length;
+        };
+
+        const Copy copies[] = {
+            { 0xC001, 0xC000, 0x180 }, // Repeats the first byte
+            { 0xC000, 0xC001, 0x180 },
+            { 0xC080, 0xC000, 0x200 },
+            { 0xC000, 0xC0FF, 0x200 },
+            { 0x8000, 0xC0F0, 0x400 }, // WRAM to VRAM, across pages
+            { 0xE001, 0xC000, 0x180 }, // Onto its own source through echo RAM
+            { 0xC000, 0xE001, 0x180 },
+            { 0xFF80, 0xC000, 0x7F }, // HRAM
+        };
+
+        for (const Copy& copy : copies)
+        {
+            TestSystem bulk;
+            TestSystem reference;
+            fill_test_pattern(bulk.mmu);
+            fill_test_pattern(reference.mmu);
+
+            bulk.mmu.copy_block(copy.destination, copy.source, copy.length);
+            for (uint32_t i = 0; i < copy.length; ++i)
+                reference.mmu.write_byte(reference.mmu.read_byte(copy.source + i), copy.destination + i);
+
+            for (uint32_t address = VRAM_START; address <= HIGH_RAM_END; ++address)
+            {
+                if (address >= CARTRIDGE_RAM_START && address < WORK_RAM_START) continue;
+
+                check_case(bulk.mmu.peek_byte(address), reference.mmu.peek_byte(address), [&] {
+                    return "copy_block " + describe_case({ { "destination", copy.destination }, { "source", copy.source }, { "length", static_cast<int>(copy.length) } })
+                        + "byte at $" + int_to_hex(address);
+                });
+            }
+        }
+
+        std::cout << "Passed Test: copy block\n";
+    }
+
+    /* Cheats */
+    /// @brief Decodes known GameShark and Game Genie codes, then applies them: GameShark codes
+    /// to the mapped memory or a given cartridge RAM bank, Game Genie codes to the ROM banks
+    /// holding their compare value.
+    void test_cheats()
+    {
+        std::vector<uint8_t> rom = make_banked_rom(8, Cartridge::MBC5RamBattery, 0x02, Cartridge::Bank32K);
+        rom[0x2 * 0x4000 + 0x0123] = 0x08;
+        rom[0x5 * 0x4000 + 0x0123] = 0x08;
+        rom[0x3 * 0x4000 + 0x0123] = 0x07;
+
+        TestSystem system(rom, std::vector<uint8_t>(0x8000));
+        Mmu& mmu = system.mmu;
+        CheatEngine cheats(mmu, &system.cartridge);
+
+        auto decode = [&cheats](const std::string& code)
+        {
+            if (!cheats.add_code(code)) throw std::runtime_error("Fail on decoding " + code);
+            return cheats.get_cheats().back();
+        };
+
+        // ttvvaaaa, the address little-endian
+        Cheat cheat = decode("01FF34C1");
+        check_val(cheat.type == CheatType::GameShark, true, "01FF34C1 type");
+        check_val<uint8_t>(cheat.code_type, 0x01, "01FF34C1 code type");
+        check_val<uint8_t>(cheat.value, 0xFF, "01FF34C1 value");
+        check_val<uint16_t>(cheat.address, 0xC134, "01FF34C1 address");
+
+        cheat = decode("830500A0");
+        check_val<uint8_t>(cheat.code_type, 0x83, "830500A0 code type");
+        check_val<uint8_t>(cheat.value, 0x05, "830500A0 value");
+        check_val<uint16_t>(cheat.address, 0xA000, "830500A0 address");
+
+        cheat = decode("81770FA1");
+        check_val<uint16_t>(cheat.address, 0xA10F, "81770FA1 address");
+
+        // ABC-DEF(-GHI): AB value, address 0xFCDE with F inverted, GI the compare rotated and XORed with 0xBA
+        cheat = decode("3E1-4AF");
+        check_val(cheat.type == CheatType::GameGenie, true, "3E1-4AF type");
+        check_val<uint8_t>(cheat.value, 0x3E, "3E1-4AF value");
+        check_val<uint16_t>(cheat.address, 0x014A, "3E1-4AF address");
+        check_val(cheat.compare, -1, "3E1-4AF compare");
+
+        cheat = decode("991-23B-C4A");
+        check_val<uint8_t>(cheat.value, 0x99, "991-23B-C4A value");
+        check_val<uint16_t>(cheat.address, 0x4123, "991-23B-C4A address");
+        check_val(cheat.compare, 0x08, "991-23B-C4A compare");
+
+        cheat = decode("000-00B-E6A");
+        check_val<uint16_t>(cheat.address, 0x4000, "000-00B-E6A address");
+        check_val(cheat.compare, 0x00, "000-00B-E6A compare");
+        cheats.remove_cheat(cheat.id);
+
+        check_val(cheats.add_code("01FF3412"), 0u, "GameShark code writing ROM");
+        check_val(cheats.add_code("3E1-4A7"), 0u, "Game Genie code patching RAM");
+        check_val(cheats.add_code("3E1-4AX"), 0u, "Code with a non-hex digit");
+
+        // Game Genie codes patch bank 0, and only the switchable banks holding the compare value
+        check_val<uint8_t>(mmu.read_byte(0x014A), 0x3E, "Patched bank 0");
+
+        for (uint8_t bank = 1; bank < 8; ++bank)
+        {
+            mmu.write_byte(bank, 0x2000);
+
+            uint8_t original = rom[bank * 0x4000 + 0x0123];
+            uint8_t expected = (original == 0x08) ? 0x99 : original;
+            check_val(mmu.read_byte(0x4123), expected, "Bank " + std::to_string(bank) + " at 0x4123");
+        }
+
+        // GameShark codes, with the 8x codes writing their RAM bank whichever is mapped
+        mmu.write_byte(0x0A, 0x0000);
+        mmu.write_byte(0x00, 0x4000);
+        cheats.apply_ram_cheats();
+
+        check_val<uint8_t>(mmu.read_byte(0xC134), 0xFF, "GameShark write to WRAM");
+        check_val<uint8_t>(system.cartridge.ram[3 * 0x2000], 0x05, "GameShark write to RAM bank 3");
+        check_val<uint8_t>(system.cartridge.ram[1 * 0x2000 + 0x010F], 0x77, "GameShark write to RAM bank 1");
+        check_val<uint8_t>(mmu.read_byte(0xA000), 0x00, "RAM bank 0 after banked GameShark writes");
+
+        // Disabling a Game Genie code restores the ROM
+        cheats.set_enabled(cheats.get_cheats()[3].id, false);
+        check_val<uint8_t>(mmu.read_byte(0x014A), 0x00, "Bank 0 with the patch disabled");
+
+        std::cout << "Passed Test: cheats\n";
+    }
+
+    /* Memory Search */
+    inline std::string describe_candidates(const std::vector<ScanCandidate>& candidates)
+    {
+        std::stringstream stream;
+        stream << candidates.size() << " candidates" << std::hex;
+
+        for (size_t i = 0; i < std::min<size_t>(candidates.size(), 8); ++i)
+            stream << " " << candidates[i].bank << ':' << candidates[i].address << '=' << candidates[i].value;
+
+        return stream.str();
+    }
+
+    inline bool same_candidates(const std::vector<ScanCandidate>& a, const std::vector<ScanCandidate>& b)
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const ScanCandidate& x, const ScanCandidate& y) {
+            return x.address == y.address && x.bank == y.bank && x.value == y.value;
+        });
+    }
+
+    /// @brief The SIMD memory search keeps the same candidates as the scalar one, for bytes and
+    /// words and every predicate, and words never span the end of WRAM, HRAM or a RAM bank.
+    void test_memory_scan()
+    {
+        TestSystem system(make_banked_rom(2, Cartridge::MBC5RamBattery, 0x00, Cartridge::Bank32K), std::vector<uint8_t>(0x8000));
+        Mmu& mmu = system.mmu;
+        Cartridge& cartridge = system.cartridge;
+
+        std::mt19937 random(7);
+
+        // Few distinct values, so every predicate keeps some candidates and drops others
+        auto mutate = [&](int writes)
+        {
+            for (int i = 0; i < writes; ++i)
+            {
+                uint8_t value = random() % 3;
+
+                switch (random() % 3)
+                {
+                case 0: mmu.write_byte(value, WORK_RAM_START + random() % WORK_RAM_SIZE); break;
+                case 1: mmu.write_byte(value, HIGH_RAM_START + random() % HIGH_RAM_SIZE); break;
+                default: cartridge.ram[random() % cartridge.ram.size()] = value; break;
+                }
+            }
+        };
+
+        const ScanPredicate predicates[] = { ScanPredicate::Changed, ScanPredicate::Unchanged, ScanPredicate::Increased,
+            ScanPredicate::Decreased, ScanPredicate::Equal };
+
+        for (ScanWidth width : { ScanWidth::Byte, ScanWidth::Word })
+        {
+            for (int search = 0; search < 8; ++search)
+            {
+                MemoryScanner simd(mmu, &cartridge);
+                MemoryScanner scalar(mmu, &cartridge);
+                scalar.set_simd_enabled(false);
+
+                mutate(40000);
+                simd.reset(width);
+                scalar.reset(width);
+
+                for (int step = 0; step < 6; ++step)
+                {
+                    ScanPredicate predicate = predicates[(search + step) % std::size(predicates)];
+                    uint16_t value = random() % 3;
+                    if (width == ScanWidth::Word) value |= (random() % 3) << 8;
+
+                    mutate(2000);
+                    size_t count = simd.filter(predicate, value);
+                    check_val(scalar.filter(predicate, value), count, "Scalar candidate count");
+
+                    std::vector<ScanCandidate> expected = scalar.get_candidates();
+                    std::vector<ScanCandidate> found = simd.get_candidates();
+                    check_case(same_candidates(found, expected), true, [&] { return "SIMD search found " + describe_candidates(found) + ", scalar " + describe_candidates(expected); });
+                    check_val(found.size(), count, "Listed candidates");
+                }
+            }
+        }
+
+        // Region ends, with the bytes past them making up the word that is searched for
+        const uint16_t region_ends[] = { WORK_RAM_START + WORK_RAM_SIZE - 1, HIGH_RAM_END, CARTRIDGE_RAM_END };
+
+        std::fill(cartridge.ram.begin(), cartridge.ram.end(), 0x00);
+        for (uint32_t address = WORK_RAM_START; address < WORK_RAM_START + WORK_RAM_SIZE; ++address) mmu.write_byte(0x00, address);
+        for (uint32_t address = HIGH_RAM_START; address <= HIGH_RAM_END; ++address) mmu.write_byte(0x00, address);
+
+        mmu.write_byte(0x34, 0xDFFF);
+        mmu.write_byte(0x34, HIGH_RAM_END);
+        for (size_t bank = 0; bank < 4; ++bank)
+        {
+            cartridge.ram[bank * 0x2000 + 0x1FFF] = 0x34;
+            if (bank < 3) cartridge.ram[(bank + 1) * 0x2000] = 0x12;
+        }
+        mmu.write_byte(0x12, HIGH_RAM_START);
+
+        for (bool use_simd : { true, false })
+        {
+            MemoryScanner scanner(mmu, &cartridge);
+            scanner.set_simd_enabled(use_simd);
+            scanner.reset(ScanWidth::Word);
+
+            check_val<size_t>(scanner.filter(ScanPredicate::Equal, 0x1234), 0, "Words spanning regions");
+
+            // Every other word ends inside its region
+            scanner.reset(ScanWidth::Word);
+            for (const ScanCandidate& candidate : scanner.get_candidates())
+            {
+                for (uint16_t end : region_ends)
+                    check_case(candidate.address != end, true, [&] { return "Word candidate at the end of a region $" + int_to_hex(end); });
+            }
+
+            scanner.reset(ScanWidth::Byte);
+            check_val<size_t>(scanner.filter(ScanPredicate::Equal, 0x34), 6, "Bytes at region ends");
+        }
+
+        std::cout << "Passed Test: memory scan\n";
+    }
+
+    /// @brief Runs every unit test, reporting the ones that fail.
+    /// @returns true if all of them passed.
+    bool run_unit_tests()
+    {
+        struct UnitTest
+        {
+            const char* name;
+            void (*run)();
+        };
+
+        const UnitTest tests[] = {
+            { "lazy flags", test_lazy_flags },
+            { "joypad select", test_joypad_select },
+            { "interrupt vector breakpoint", test_interrupt_vector_breakpoint },
+            { "echo watchpoints", test_echo_watchpoints },
+            { "peek byte", test_peek_byte },
+            { "code page watchpoints", test_code_page_watchpoints },
+            { "block decode during DMA", test_block_decode_during_dma },
+            { "cartridge mapping", test_cartridge_mapping },
+            { "bulk loops", test_bulk_loops },
+            { "JIT blocks", test_jit_blocks },
+            { "copy block", test_copy_block },
+            { "cheats", test_cheats },
+            { "memory scan", test_memory_scan },
+        };
+
+        int failed = 0;
+        for (const UnitTest& test : tests)
+        {
+            try
+            {
+                test.run();
+            }
+            catch (const std::exception& error)
+            {
+                std::cout << "Failed Test: " << test.name << " (" << error.what() << ")\n";
+                ++failed;
+            }
+        }
+
+        std::cout << (std::size(tests) - failed) << '/' << std::size(tests) << " unit tests passed\n";
+
+        return failed == 0;
+    }
+}
@@ -0,0 +1,99 @@
+#include "watchdog.hpp"
+#include "opcodes.hpp"
+
+#include <cstdio>
+#include <string>
+
+/// @returns "bank:address" in hex for ROM addresses, "address" otherwise.
+static std::string format_address(Mmu& mmu, uint16_t address)
+{
+    char text[16];
+
+    if (address <= BANK_N_END)
+        std::snprintf(text, sizeof(text), "%02X:%04X", mmu.get_rom_bank(address), address);
+    else
+        std::snprintf(text, sizeof(text), "%04X", address);
+
+    return text;
+}
+
+bool Watchdog::check(Cpu& cpu, Mmu& mmu, uint32_t cycles)
+{
+    LockupReason reason = LockupReason::None;
+
+    uint16_t pc = cpu.get_pc();
+    uint8_t interrupt_enable = mmu.get_interrupt_enable() & 0x1F;
+    bool interrupts_blocked = !cpu.get_ime() || interrupt_enable == 0;
+
+    stalled_batches = (cycles == 0) ? stalled_batches + 1 : 0;
+
+    if (cpu.get_invalid_opcode_address() >= 0)
+    {
+        reason = LockupReason::InvalidOpcode;
+        pc = static_cast<uint16_t>(cpu.get_invalid_opcode_address());
+        cpu.clear_invalid_opcode();
+    }
+    // HALT ends once IE & IF is non-zero, whether or not IME is set
+    else if (cpu.get_halted_state() && interrupt_enable == 0)
+        reason = LockupReason::HaltForever;
+    else if (interrupts_blocked && !cpu.get_halted_state() && is_self_jump(mmu, pc))
+        reason = LockupReason::SelfLoop;
+    else if (stalled_batches >= MAX_STALLED_BATCHES)
+        reason = LockupReason::NoProgress;
+
+    if (reason == LockupReason::None) return false;
+
+    // HALT has already moved PC past itself
+    if (reason == LockupReason::HaltForever)
+        --pc;
+
+    report.reason = reason;
+    report.pc = pc;
+    report.bank = mmu.get_rom_bank(pc);
+    report.opcode = mmu.peek_byte(pc);
+    report.ime = cpu.get_ime();
+    report.interrupt_enable = mmu.get_interrupt_enable();
+    report.history = cpu.get_pc_history();
+
+    return true;
+}
+
+void Watchdog::print_report(std::ostream& out, Mmu& mmu) const
+{
+    char line[64];
+
+    out << "Lockup: " << lockup_reason_name(report.reason) << '\n';
+
+    out << "PC: " << format_address(mmu, report.pc) << '\n';
+
+    std::snprintf(line, sizeof(line), "Opcode: $%02X (%s)\n", report.opcode, BASE_OPCODES[report.opcode].mnemonic);
+    out << line;
+
+    std::snprintf(line, sizeof(line), "IME: %d, IE: $%02X\n", report.ime, report.interrupt_enable);
+    out << line;
+
+    // Banks are the ones mapped now, which a bank switch since may have changed
+    out << "Last instructions:\n";
+    for (uint16_t address : report.history)
+    {
+        uint8_t opcode = mmu.peek_byte(address);
+        const OpcodeInfo& info = (opcode == 0xCB) ? CB_OPCODES[mmu.peek_byte(static_cast<uint16_t>(address + 1))] : BASE_OPCODES[opcode];
+
+        out << "  " << format_address(mmu, address) << ' ' << info.mnemonic << '\n';
+    }
+}
+
+bool Watchdog::is_self_jump(Mmu& mmu, uint16_t address)
+{
+    uint8_t opcode = mmu.peek_byte(address);
+
+    // JR -2
+    if (opcode == 0x18)
+        return mmu.peek_byte(static_cast<uint16_t>(address + 1)) == 0xFE;
+
+    // JP a16
+    if (opcode == 0xC3)
+        return (mmu.peek_byte(static_cast<uint16_t>(address + 1)) | (mmu.peek_byte(static_cast<uint16_t>(address + 2)) << 8)) == address;
+
+    return false;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <ostream>
+
+#include "cpu.hpp"
+#include "memory.hpp"
+
+/// @brief Why the emulated program can never make progress again.
+enum class LockupReason : uint8_t
+{
+    None,
+    InvalidOpcode, // Real hardware hangs on the 11 unused opcodes
+    SelfLoop, // JR -2 / JP to itself with no interrupt able to leave it
+    HaltForever, // HALT with no interrupt enabled to wake it, e.g. DI; HALT with IE = 0
+    NoProgress // Batches keep running without emulated time advancing
+};
+
+constexpr const char* lockup_reason_name(LockupReason reason)
+{
+    switch (reason)
+    {
+    case LockupReason::InvalidOpcode: return "invalid opcode";
+    case LockupReason::SelfLoop: return "jump to itself with interrupts blocked";
+    case LockupReason::HaltForever: return "HALT with no interrupt enabled";
+    case LockupReason::NoProgress: return "no emulated time passing";
+    default: return "none";
+    }
+}
+
+/// @brief State of the CPU at the time a lockup was detected.
+struct LockupReport
+{
+    LockupReason reason = LockupReason::None;
+    uint16_t pc = 0; // Address of the offending instruction
+    uint16_t bank = 0; // ROM bank mapped at `pc`, meaningless outside of ROM
+    uint8_t opcode = 0;
+    bool ime = false;
+    uint8_t interrupt_enable = 0;
+    std::array<uint16_t, Cpu::PC_HISTORY_SIZE> history{}; // Oldest first
+};
+
+/// @brief Detects emulated programs that have hung, so unattended runs can stop them.
+///
+/// All checks run once per batch and see compiled and fast-forwarded loops the same as
+/// interpreted ones. The report's PC history is only recorded while enabled with
+/// Cpu::set_pc_history_enabled(), the one cost per instruction.
+class Watchdog
+{
+public:
+    static constexpr uint32_t MAX_STALLED_BATCHES = 1 << 16; // Consecutive batches without device cycles
+
+    /// @brief Checks the CPU after a batch that advanced the timer/PPU by `cycles`.
+    /// @returns true if it locked up, see get_report().
+    bool check(Cpu& cpu, Mmu& mmu, uint32_t cycles);
+
+    const LockupReport& get_report() const { return report; }
+
+    /// @brief Writes the report as "key: value" lines, with the recent instructions disassembled.
+    void print_report(std::ostream& out, Mmu& mmu) const;
+
+private:
+    uint32_t stalled_batches = 0;
+    LockupReport report;
+
+    /// @returns true if the instruction at `address` is a JR/JP to itself.
+    static bool is_self_jump(Mmu& mmu, uint16_t address);
+};